@@ -1,6 +1,9 @@
 #pragma once
 
+#include <atomic>
 #include <functional>
+#include <string>
+#include <stdint.h>
 
 #include "noncopyable.h"
 #include "Socket.h"
@@ -13,8 +16,12 @@ class Acceptor : noncopyable
 {
 public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress &)>;
+    // 每次accept之前调用，返回false表示暂不接受新连接
+    using AcceptGate = std::function<bool()>;
 
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
+    // 接管一个已经bind(可能也已listen)的监听socket，如前一个进程通过SCM_RIGHTS交来的fd
+    Acceptor(EventLoop *loop, int listenFd);
     ~Acceptor();
 
     // 设置新连接的回调函数
@@ -23,13 +30,52 @@ public:
     bool listening() const { return listening_; }
     // 监听本地端口
     void listen();
+    // 不再接受新连接，socket保持打开，已在内核队列中的连接留给共享该socket的其他进程或之后的listen()
+    void stopListening();
+    // 在所属loop线程中调用，停止监听并关闭本进程的监听fd(共享该socket的其他进程不受影响)，之后fd()返回-1
+    void closeListening();
+    int fd() const { return acceptSocket_.fd(); }
+    // 监听socket已交给其他进程时调用，析构时不再删除Unix域socket文件
+    void keepUnixPathOnClose() { unixPath_.clear(); }
+    // 设置监听socket的SO_INCOMING_CPU，同一端口的reuseport组内，内核优先把连接交给与处理软中断的CPU一致的监听socket
+    void setIncomingCpu(int cpu) { acceptSocket_.setIncomingCpu(cpu); }
+    // 接入闸门不放行时暂停(关闭可读事件)，连接留在内核的accept队列中，直到resume()
+    void setAcceptGate(const AcceptGate &gate) { acceptGate_ = gate; }
+    bool paused() const { return paused_; }
+    // 在所属loop线程中调用，恢复被闸门暂停的监听，仍然过载时下一次可读事件会再次暂停；已stopListening()时不做任何事
+    void resume();
+    // 每次可读事件最多接受的连接数，避免一次accept风暴饿死同一loop上的其他连接
+    void setMaxAcceptsPerEvent(int maxAccepts) { maxAcceptsPerEvent_ = maxAccepts; }
+
+    // 统计计数，可在其他线程读取
+    uint64_t acceptedCount() const { return accepted_.load(std::memory_order_relaxed); }
+    // 监听socket可读事件的次数，accepted/acceptEvents即平均每次事件批量接受的连接数
+    uint64_t acceptEvents() const { return acceptEvents_.load(std::memory_order_relaxed); }
+    // fd耗尽(EMFILE/ENFILE)时借助预留fd接受后立即关闭的连接数
+    uint64_t droppedForFdLimit() const { return droppedForFdLimit_.load(std::memory_order_relaxed); }
+    uint64_t acceptErrors() const { return acceptErrors_.load(std::memory_order_relaxed); }
+
 private:
+    static const int kDefaultMaxAcceptsPerEvent = 64;
+
     // 处理新用户的连接事件
     void handleRead();
+    // fd耗尽时，释放预留的fd接受一个连接并立即关闭，让对端及时得到通知，同时让监听socket不再一直可读
+    void dropConnectionWithIdleFd();
 
     EventLoop *loop_;   // main loop(baseLoop)
     Socket acceptSocket_;    // 专门用于接受新连接的socket，server socket
     Channel acceptChannel_; // 专门用于监听新连接acceptSocket_的channel
     NewConnectionCallback NewConnectionCallback_;   // 新连接的回调函数
+    AcceptGate acceptGate_;
     bool listening_;   // 标识是否在监听
+    bool paused_;      // 被接入闸门暂停
+    int idleFd_;       // 预留的空闲fd(打开/dev/null)，fd耗尽时腾出位置
+    int maxAcceptsPerEvent_;
+    std::string unixPath_;  // 监听文件系统中的Unix域地址时，析构时删除该文件
+
+    std::atomic<uint64_t> accepted_;
+    std::atomic<uint64_t> acceptEvents_;
+    std::atomic<uint64_t> droppedForFdLimit_;
+    std::atomic<uint64_t> acceptErrors_;
 };
\ No newline at end of file
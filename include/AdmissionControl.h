@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "TokenBucket.h"
+
+/**
+ * TcpServer的过载保护：限制总连接数、每个loop的连接数、每个对端IP的连接数、接入速率，
+ * 以及所有连接输出缓冲区的总字节数(慢消费者积压的数据是服务端内存失控的主要来源)
+ * 各项为0表示不限制；可在多个accept线程中同时调用
+ **/
+class AdmissionControl : noncopyable
+{
+public:
+    enum OverloadAction
+    {
+        // 接受后立即关闭(RST)，对端马上得到失败，适合客户端会重试其他实例的场景
+        kRejectAndClose,
+        // 暂停Acceptor的可读事件，新连接留在内核的accept队列中等待，队列满后由内核丢弃SYN，客户端自行重传
+        // 对端IP的连接数超限时只能在接受之后才知道，仍然按kRejectAndClose处理
+        kPauseAccepting
+    };
+
+    struct Limits
+    {
+        size_t maxConnections = 0;
+        size_t maxConnectionsPerLoop = 0;
+        size_t maxConnectionsPerIp = 0;
+        double acceptRate = 0.0;        // 每秒接受的连接数
+        double acceptBurst = 0.0;       // 允许突发的连接数
+        // 输出缓冲区总量超过maxOutputBufferBytes时不再接受新连接；
+        // 超过shedOutputBufferBytes时关闭输出缓冲区最大的连接，直到回落到maxOutputBufferBytes以下
+        size_t maxOutputBufferBytes = 0;
+        size_t shedOutputBufferBytes = 0;
+        OverloadAction action = kRejectAndClose;
+    };
+
+    enum Verdict
+    {
+        kAdmit,
+        kOverConnections,
+        kOverLoopConnections,
+        kOverPeerConnections,
+        kOverAcceptRate,
+        kOverMemory,
+        kNumVerdicts
+    };
+
+    explicit AdmissionControl(const Limits &limits);
+
+    const Limits &limits() const { return limits_; }
+
+    // 与对端无关的检查，通过且consumeToken为true时扣除一个接入令牌；
+    // accept之前的预先检查不扣令牌，否则最后一次返回EAGAIN的accept也会白白用掉一个
+    Verdict admit(size_t connections, size_t loopConnections, size_t outputBufferBytes, bool consumeToken = true);
+    // 对端IP的连接数检查，通过时计数加一，连接关闭时要调用release
+    Verdict admitPeer(const InetAddress &peer);
+    void release(const InetAddress &peer);
+
+    // 按原因统计被拒绝的连接
+    void recordRejected(Verdict verdict) { rejected_[verdict].fetch_add(1, std::memory_order_relaxed); }
+    uint64_t rejected(Verdict verdict) const { return rejected_[verdict].load(std::memory_order_relaxed); }
+
+    static const char *verdictName(Verdict verdict);
+
+private:
+    // IP地址的原始字节，Unix域地址返回空串(不限制)
+    static std::string peerKey(const InetAddress &peer);
+
+    const Limits limits_;
+    std::mutex mutex_;
+    TokenBucket acceptBucket_;                          // 受mutex_保护
+    std::unordered_map<std::string, size_t> peers_;     // 受mutex_保护
+    std::atomic<uint64_t> rejected_[kNumVerdicts];
+};
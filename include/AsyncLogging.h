@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <string.h>
+
+#include "noncopyable.h"
+#include "Thread.h"
+#include "LogFile.h"
+
+/**
+ * 异步日志后端(双缓冲)
+ * 前端(IO线程)只把格式化好的日志行memcpy到当前缓冲区，缓冲区写满或每隔flushInterval秒
+ * 由后台线程整块换走，在后台线程中写入按大小/时间滚动的LogFile，IO线程不再做磁盘IO
+ * 配合 Logger::setOutput 使用，日志级别已经在每行的前缀中
+ **/
+class AsyncLogging : noncopyable
+{
+public:
+    // 磁盘跟不上、排队的缓冲区达到上限时的处理方式
+    enum OverflowPolicy
+    {
+        kDrop,  // 丢弃新的日志行并计数，IO线程永不阻塞
+        kBlock  // 阻塞写日志的线程，直到后台线程腾出缓冲区
+    };
+
+    AsyncLogging(const std::string &basename,
+                 off_t rollSize,
+                 int flushInterval = 3,
+                 size_t maxQueuedBuffers = 16,
+                 OverflowPolicy policy = kDrop);
+    ~AsyncLogging();
+
+    // 前端接口，可在任意线程调用；不短于LogBuffer::kSize的日志行会被丢弃并计入droppedLines()
+    void append(const char *logline, size_t len);
+
+    void start();
+    void stop();
+
+    // 把所有已缓存的日志同步写入文件，FATAL日志退出进程前调用
+    void flush();
+
+    // 因缓冲区排满或单行过长被丢弃的日志行数
+    size_t droppedLines() const { return totalDropped_.load(std::memory_order_relaxed); }
+
+private:
+    // 定长日志缓冲区
+    class LogBuffer : noncopyable
+    {
+    public:
+        static const size_t kSize = 4 * 1024 * 1024;
+
+        LogBuffer() : data_(new char[kSize]), len_(0) {}
+
+        void append(const char *buf, size_t len)
+        {
+            ::memcpy(data_.get() + len_, buf, len);
+            len_ += len;
+        }
+        const char *data() const { return data_.get(); }
+        size_t length() const { return len_; }
+        size_t avail() const { return kSize - len_; }
+        void reset() { len_ = 0; }
+
+    private:
+        std::unique_ptr<char[]> data_;
+        size_t len_;
+    };
+
+    using BufferPtr = std::unique_ptr<LogBuffer>;
+    using BufferVector = std::vector<BufferPtr>;
+
+    void threadFunc();
+    // 把一批缓冲区写入文件，调用者需持有fileMutex_
+    void writeBuffers(const BufferVector &buffers);
+
+    const int flushInterval_;       // 后台线程至少每隔多少秒写一次
+    const size_t maxQueuedBuffers_; // 写满等待后台线程写入的缓冲区上限
+    const OverflowPolicy policy_;
+    std::atomic_bool running_;
+    Thread thread_;
+
+    std::mutex mutex_;              // 保护下面的缓冲区
+    std::condition_variable cond_;      // 通知后台线程有写满的缓冲区
+    std::condition_variable notFull_;   // kBlock策略下通知前端有空位
+    BufferPtr currentBuffer_;       // 前端正在写的缓冲区
+    BufferPtr nextBuffer_;          // 预备缓冲区
+    BufferVector buffers_;          // 写满待写入文件的缓冲区
+    size_t dropped_;                // 上次写入后丢弃的行数，由后台线程记入文件
+
+    std::mutex fileMutex_;          // 保证后台线程和flush()按顺序写文件
+    LogFile output_;                // 由fileMutex_保护
+    std::atomic<size_t> totalDropped_;
+};
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "noncopyable.h"
+#include "Logger.h"
+#include "LogFile.h"
+#include "Thread.h"
+#include "Timestamp.h"
+
+/**
+ * 二进制日志
+ * 每个LOG_BIN_*调用点在第一次执行时注册格式字符串，得到一个静态的格式id；之后每次调用只把
+ * 格式id、时间戳和带类型标记的原始参数字节拷贝到本线程的单生产者单消费者环形缓冲区，不做任何格式化
+ * 后台线程把各线程环形缓冲区中的记录连同格式字典原样写入LogFile，由BinaryLogging::decode离线还原成文本
+ *
+ * 支持的参数类型：整数、枚举、浮点数、C字符串、std::string、指针
+ * 环形缓冲区写满时丢弃新记录并计数，IO线程永不阻塞
+ **/
+#define LOG_BINARY(level, logmsgFormat, ...)                                                                   \
+    do                                                                                                         \
+    {                                                                                                          \
+        if (Logger::logLevel() <= level)                                                                       \
+        {                                                                                                      \
+            static const uint32_t muduoBinaryLogFormatId =                                                     \
+                BinaryLogging::registerFormat(level, __FILE__, __LINE__, logmsgFormat);                        \
+            BinaryLogging::log(muduoBinaryLogFormatId, ##__VA_ARGS__);                                         \
+        }                                                                                                      \
+    } while (0)
+
+#if MUDUO_MIN_LOG_LEVEL <= MUDUO_LOG_LEVEL_INFO
+#define LOG_BIN_INFO(logmsgFormat, ...) LOG_BINARY(INFO, logmsgFormat, ##__VA_ARGS__)
+#else
+#define LOG_BIN_INFO(logmsgFormat, ...) do {} while (0)
+#endif
+
+#if MUDUO_MIN_LOG_LEVEL <= MUDUO_LOG_LEVEL_ERROR
+#define LOG_BIN_ERROR(logmsgFormat, ...) LOG_BINARY(ERROR, logmsgFormat, ##__VA_ARGS__)
+#else
+#define LOG_BIN_ERROR(logmsgFormat, ...) do {} while (0)
+#endif
+
+#if MUDUO_MIN_LOG_LEVEL <= MUDUO_LOG_LEVEL_DEBUG
+#define LOG_BIN_DEBUG(logmsgFormat, ...) LOG_BINARY(DEBUG, logmsgFormat, ##__VA_ARGS__)
+#else
+#define LOG_BIN_DEBUG(logmsgFormat, ...) do {} while (0)
+#endif
+
+namespace BinaryLog
+{
+    // 参数的类型标记，每个参数前占一个字节
+    enum ArgType : char
+    {
+        kInt64 = 1,
+        kUInt64,
+        kDouble,
+        kString,    // uint32长度 + 字符串内容(不含'\0')
+        kPointer,
+    };
+
+    // 环形缓冲区中每条记录的头部，后面紧跟参数
+    struct RecordHeader
+    {
+        uint32_t formatId;
+        uint32_t size;      // 整条记录的字节数，包括头部
+        int64_t timestamp;  // 微秒
+    };
+
+    const uint32_t kWrapMarker = 0xffffffff;    // 环形缓冲区尾部放不下时写入，消费者见到后回到开头
+    const uint32_t kDictionaryTag = 0xfffffffe; // 日志文件中的格式字典记录
+
+    // 单个线程的单生产者单消费者环形缓冲区，生产者是所属线程，消费者是后台写日志的线程
+    class StagingBuffer : noncopyable
+    {
+    public:
+        explicit StagingBuffer(size_t capacity)
+            : data_(new char[capacity])
+            , capacity_(capacity)
+            , producerPos_(0)
+            , consumerPos_(0)
+            , retired_(false)
+        {
+        }
+        ~StagingBuffer() { delete[] data_; }
+
+        // 生产者预留size字节的连续空间，空间不足返回nullptr
+        char *reserve(size_t size)
+        {
+            size_t pos = producerPos_.load(std::memory_order_relaxed);
+            size_t consumer = consumerPos_.load(std::memory_order_acquire);
+            if (pos >= consumer)
+            {
+                // 尾部始终留出放回绕标记的空间
+                if (capacity_ - pos >= size + sizeof(kWrapMarker))
+                {
+                    return data_ + pos;
+                }
+                // 回到开头，不能追上消费者，否则满和空无法区分
+                if (consumer > size)
+                {
+                    memcpy(data_ + pos, &kWrapMarker, sizeof(kWrapMarker));
+                    return data_;
+                }
+                return nullptr;
+            }
+            return consumer - pos > size ? data_ + pos : nullptr;
+        }
+        // 生产者发布已写好的记录，ptr为reserve的返回值
+        void commit(char *ptr, size_t size)
+        {
+            producerPos_.store(ptr - data_ + size, std::memory_order_release);
+        }
+
+        const char *data() const { return data_; }
+        std::atomic<size_t> &producerPos() { return producerPos_; }
+        std::atomic<size_t> &consumerPos() { return consumerPos_; }
+        std::atomic_bool &retired() { return retired_; }
+
+    private:
+        char *data_;
+        const size_t capacity_;
+        std::atomic<size_t> producerPos_;
+        char pad_[64];                      // 生产者和消费者的位置放在不同的缓存行
+        std::atomic<size_t> consumerPos_;
+        std::atomic_bool retired_;          // 所属线程已退出，消费完后由后台线程释放
+    };
+
+    extern __thread StagingBuffer *t_stagingBuffer;
+    StagingBuffer *createStagingBuffer();
+    void recordDropped();
+
+    inline StagingBuffer *stagingBuffer()
+    {
+        if (__builtin_expect(t_stagingBuffer == nullptr, 0))
+        {
+            return createStagingBuffer();
+        }
+        return t_stagingBuffer;
+    }
+
+    // 各类参数的编码，不支持的类型在编译期报错
+    template <typename T, typename Enable = void>
+    struct ArgCodec;
+
+    template <typename T>
+    struct ArgCodec<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type>
+    {
+        static size_t size(T) { return 1 + sizeof(int64_t); }
+        static char *encode(char *p, T value)
+        {
+            *p++ = (std::is_signed<T>::value || std::is_enum<T>::value) ? kInt64 : kUInt64;
+            int64_t v = static_cast<int64_t>(value);
+            memcpy(p, &v, sizeof(v));
+            return p + sizeof(v);
+        }
+    };
+
+    template <typename T>
+    struct ArgCodec<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+    {
+        static size_t size(T) { return 1 + sizeof(double); }
+        static char *encode(char *p, T value)
+        {
+            *p++ = kDouble;
+            double v = value;
+            memcpy(p, &v, sizeof(v));
+            return p + sizeof(v);
+        }
+    };
+
+    inline char *encodeString(char *p, const char *s, uint32_t len)
+    {
+        *p++ = kString;
+        memcpy(p, &len, sizeof(len));
+        memcpy(p + sizeof(len), s, len);
+        return p + sizeof(len) + len;
+    }
+
+    template <>
+    struct ArgCodec<const char *>
+    {
+        static size_t size(const char *s) { return 1 + sizeof(uint32_t) + (s ? strlen(s) : 0); }
+        static char *encode(char *p, const char *s) { return encodeString(p, s, s ? strlen(s) : 0); }
+    };
+
+    template <>
+    struct ArgCodec<char *> : ArgCodec<const char *>
+    {
+    };
+
+    template <>
+    struct ArgCodec<std::string>
+    {
+        static size_t size(const std::string &s) { return 1 + sizeof(uint32_t) + s.size(); }
+        static char *encode(char *p, const std::string &s) { return encodeString(p, s.data(), s.size()); }
+    };
+
+    template <typename T>
+    struct ArgCodec<T *, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type>
+    {
+        static size_t size(const T *) { return 1 + sizeof(uint64_t); }
+        static char *encode(char *p, const T *ptr)
+        {
+            *p++ = kPointer;
+            uint64_t v = reinterpret_cast<uintptr_t>(ptr);
+            memcpy(p, &v, sizeof(v));
+            return p + sizeof(v);
+        }
+    };
+
+    // 数组(如字符串字面量)退化为指针，const char[N]退化为const char*
+    template <typename T>
+    using Decayed = typename std::decay<const T>::type;
+
+    inline size_t argsSize() { return 0; }
+
+    template <typename T, typename... Rest>
+    size_t argsSize(const T &arg, const Rest &...rest)
+    {
+        return ArgCodec<Decayed<T>>::size(arg) + argsSize(rest...);
+    }
+} // namespace BinaryLog
+
+class BinaryLogging : noncopyable
+{
+public:
+    BinaryLogging(const std::string &basename,
+                  off_t rollSize,
+                  int pollIntervalMs = 1);
+    ~BinaryLogging();
+
+    void start();
+    void stop();
+
+    // 写入的日志文件名，文件滚动后会变化
+    const std::string &currentFilename() const { return output_.currentFilename(); }
+
+    // 注册一个调用点的格式字符串，返回格式id，由LOG_BINARY在每个调用点只调用一次
+    static uint32_t registerFormat(int level, const char *file, int line, const char *format);
+
+    template <typename... Args>
+    static void log(uint32_t formatId, const Args &...args)
+    {
+        using namespace BinaryLog;
+        size_t size = sizeof(RecordHeader) + argsSize(args...);
+        StagingBuffer *buffer = stagingBuffer();
+        char *start = buffer->reserve(size);
+        if (start == nullptr)
+        {
+            recordDropped();
+            return;
+        }
+        RecordHeader header = {formatId, static_cast<uint32_t>(size), Timestamp::now().microSecondsSinceEpoch()};
+        memcpy(start, &header, sizeof(header));
+        char *p = start + sizeof(header);
+        int expand[] = {0, (p = ArgCodec<Decayed<Args>>::encode(p, args), 0)...};
+        (void)expand;
+        buffer->commit(start, size);
+    }
+
+    // 每个线程环形缓冲区的大小，只影响之后第一次写二进制日志的线程
+    static void setThreadBufferSize(size_t size);
+    // 因环形缓冲区写满被丢弃的记录数
+    static size_t droppedRecords();
+
+    // 把二进制日志文件还原为文本写入out，返回还原的记录数，文件格式错误时返回-1
+    static long decode(const std::string &filename, FILE *out);
+
+private:
+    void threadFunc();
+    // 把各线程缓冲区中已发布的记录写入文件，返回写入的字节数
+    size_t drain();
+    void writeNewFormats();
+    void appendOutput(const char *data, size_t len);
+
+    const int pollIntervalMs_;
+    std::atomic_bool running_;
+    Thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;  // 只用于stop()时唤醒后台线程
+
+    // 以下只在后台线程访问
+    LogFile output_;
+    std::string outputFilename_;    // 写过文件头的文件，LogFile滚动后需要在新文件中重写文件头和字典
+    std::vector<std::string> formatRecords_; // 已序列化的格式字典记录，下标即格式id
+    std::vector<BinaryLog::StagingBuffer *> buffers_;
+};
@@ -15,6 +15,8 @@ using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr &)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr &)>;
 using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
+// 输出缓冲区放不下一条消息而丢弃它或关闭连接时回调，参数为缓冲区已有的字节数和这条消息的字节数
+using OutputOverflowCallback = std::function<void(const TcpConnectionPtr &, size_t pendingBytes, size_t messageBytes)>;
 
 using MessageCallback = std::function<void(const TcpConnectionPtr &,
                                            Buffer *,
@@ -40,7 +40,7 @@ public:
     // 设置实际发生的事件类型（由 poll/epoll 填充）
     void set_revents(int revt) { revents_ = revt; }
 
-    // 修改关注的事件类型，并通知 poller 更新
+    // 修改关注的事件类型，并通知 poller 更新(延迟到本轮循环结束时批量提交)
     void enableReading() { events_ |= kReadEvent; update(); }
     void disableReading() { events_ &= ~kReadEvent; update(); }
     void enableWriting() { events_ |= kWriteEvent; update(); }
@@ -57,12 +57,16 @@ public:
     // 设置poller内部的channel的下标
     void set_index(int idx) { index_ = idx; }
 
+    // 关注事件是否有修改尚未提交给poller
+    bool updatePending() const { return updatePending_; }
+    void set_updatePending(bool pending) { updatePending_ = pending; }
+
     // 返回所属的EventLoop的指针
     EventLoop *ownerLoop() { return loop_; }
     // 在EventLoop中移除该Channel
     void remove();
 private:
-    // 通知 poller 更新该 Channel 的事件关注类型
+    // 通知 EventLoop 该 Channel 的事件关注类型有变化，在本轮循环结束时统一提交给 poller
     void update();
     // 真正分发和执行各类事件回调
     void handleEventWithGuard(Timestamp receiveTime);
@@ -76,6 +80,7 @@ private:
     int events_;        // 当前关注的事件类型
     int revents_;       // 实际发生的事件类型(由Poller填充)
     int index_;         // 该Channel在所属的Poller中的唯一标识
+    bool updatePending_; // 关注事件已修改、等待EventLoop在本轮循环结束时统一提交
 
     std::weak_ptr<void> tie_;   // 用于绑定 TcpConnection 等对象的生命周期
     bool tied_;                 // 标记是否已绑定对象
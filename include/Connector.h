@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <random>
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "TimerId.h"
+
+class Channel;
+class EventLoop;
+
+/**
+ * 主动发起连接，供TcpClient使用，与Acceptor相对
+ * 非阻塞connect，连接完成由Channel上的可写事件(EPOLLOUT)通知，再用SO_ERROR判断成败；
+ * 失败或超时后由定时器按指数退避重试，重试间隔带随机抖动，避免大量连接同时重连同一个上游
+ * 设置了最大尝试次数时，连续失败达到该次数(或遇到不可重试的错误)后放弃，并调用connectFailedCallback_
+ * 连接成功后把sockfd交给newConnectionCallback_，之后不再管理该fd
+ **/
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+    using ConnectFailedCallback = std::function<void()>;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+    // 放弃连接时在loop线程中调用；stop()不算失败，不会调用
+    void setConnectFailedCallback(const ConnectFailedCallback &cb) { connectFailedCallback_ = cb; }
+    // 单次连接的超时时间(秒)，超时后按失败重试，小于等于0表示不限制；应在start()之前设置
+    void setConnectTimeout(double seconds) { connectTimeout_ = seconds; }
+    // 重试间隔从initialMs开始每次翻倍，最大maxMs；应在start()之前设置
+    void setRetryDelay(int initialMs, int maxMs) { initRetryDelayMs_ = retryDelayMs_ = initialMs; maxRetryDelayMs_ = maxMs; }
+    // 连续失败maxAttempts次后放弃，小于等于0表示一直重试(默认)；应在start()之前设置
+    void setMaxAttempts(int maxAttempts) { maxAttempts_ = maxAttempts; }
+
+    const InetAddress &serverAddress() const { return serverAddr_; }
+    // 已发起的connect次数(含重试)
+    int attempts() const { return attempts_; }
+
+    // 可在任意线程调用
+    void start();
+    // 只能在loop线程中调用，重置重试间隔后重新连接，用于已建立的连接断开后重连
+    void restart();
+    // 可在任意线程调用，放弃正在进行的连接和已安排的重试
+    void stop();
+
+private:
+    enum States
+    {
+        kDisconnected,
+        kConnecting,
+        kConnected
+    };
+    static const int kDefaultInitRetryDelayMs = 500;
+    static const int kDefaultMaxRetryDelayMs = 30 * 1000;
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void handleTimeout();
+    // 关闭本次尝试的fd(小于0时没有fd)，按退避间隔安排重试，或者在达到最大尝试次数后放弃
+    void retry(int sockfd);
+    void giveUp();
+    // 从poller上注销并返回fd，Channel本身在本轮事件处理完后销毁
+    int removeAndResetChannel();
+    void cancelTimers();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_;  // 是否需要连接，stop()后为false
+    std::atomic_int state_;
+    std::unique_ptr<Channel> channel_;
+    NewConnectionCallback newConnectionCallback_;
+    ConnectFailedCallback connectFailedCallback_;
+
+    double connectTimeout_;
+    int initRetryDelayMs_;
+    int retryDelayMs_;
+    int maxRetryDelayMs_;
+    int attempts_;
+    int maxAttempts_;
+    int failures_;              // 连续失败次数，连接成功或重新开始时清零
+    bool timeoutTimerActive_;
+    bool retryTimerActive_;
+    TimerId timeoutTimer_;
+    TimerId retryTimer_;
+    std::minstd_rand jitter_;
+};
+
+using ConnectorPtr = std::shared_ptr<Connector>;
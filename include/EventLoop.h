@@ -2,6 +2,7 @@
 
 #include <functional>
 #include <vector>
+#include <deque>
 #include <atomic>
 #include <memory>
 #include <mutex>
@@ -21,6 +22,13 @@ class EventLoop : noncopyable
 public:
     using Functor = std::function<void()>;
 
+    // 回调任务的优先级通道
+    enum Priority
+    {
+        kNormalPriority,    // 普通任务(IO相关)，每轮循环全部执行完
+        kLowPriority        // 后台任务(统计、缓存刷新等)，受每轮预算限制，未执行完的留到下一轮
+    };
+
     EventLoop();
     ~EventLoop();
 
@@ -31,8 +39,17 @@ public:
     Timestamp pollReturnTime() const { return pollReturnTime_; }
     // 在当前loop中执行
     void runInLoop(Functor cb);
+    // 在loop线程中执行cb并等待完成，不能在其他loop线程中互相等待；用于析构时清理只能在该loop线程中访问的对象
+    void runInLoopAndWait(const Functor &cb);
     // 把上层注册的回调函数cb放入队列中，唤醒loop所在的线程执行cb
-    void queueInLoop(Functor cb);
+    void queueInLoop(Functor cb, Priority priority = kNormalPriority);
+
+    // 设置每轮循环执行低优先级任务的预算：最多maxFunctors个，最多耗时maxMicroSeconds微秒
+    void setLowPriorityBudget(size_t maxFunctors, int64_t maxMicroSeconds)
+    {
+        lowPriorityMaxFunctors_ = maxFunctors;
+        lowPriorityMaxMicroSeconds_ = maxMicroSeconds;
+    }
 
     // 在某个时刻执行回调
     TimerId runAt(const Timestamp& time, const TimerCallback& cb);
@@ -50,19 +67,44 @@ public:
     void wakeup();
 
     // EventLoop的方法 => Poller的方法
+    // updateChannel只把channel记为待更新，在本轮循环结束、poll之前统一提交
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
 
+    // 被合并或因关注事件与内核中一致而省掉的poller更新(epoll_ctl)次数，只在loop线程中读写
+    size_t elidedChannelUpdates() const { return elidedChannelUpdates_; }
+
     // 判断EventLoop对象是否在自己的线程里
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
 
+    // 负载统计，可在其他线程读取，供负载均衡策略选择loop
+    // 分配给本loop的连接数，由TcpConnection在建立/销毁时维护；TcpServer在选定loop时就先计入，
+    // 这样同一批accept的连接能看到前面刚分配出去的连接，不会都挤到批次开始前最空闲的loop上
+    int connectionCount() const { return connectionCount_.load(std::memory_order_relaxed); }
+    void addConnectionCount(int delta) { connectionCount_.fetch_add(delta, std::memory_order_relaxed); }
+    // 已投递还未执行的回调数量(包括积压的低优先级回调)
+    size_t queuedFunctors() const { return queuedFunctors_.load(std::memory_order_relaxed); }
+    // 累计处理IO事件和回调的时间(不含阻塞在poll中的时间)
+    int64_t busyMicroSeconds() const { return busyMicroSeconds_.load(std::memory_order_relaxed); }
+    // 最近约1秒内的忙碌比例(0~1)，按时间加权的指数移动平均
+    double load() const { return load_.load(std::memory_order_relaxed); }
+
+    // loop线程绑定的CPU，未绑定时为-1；由EventLoopThread在绑核后设置
+    int cpu() const { return cpu_; }
+    void setCpu(int cpu) { cpu_ = cpu; }
+
 private:
     // 给eventfd返回的文件描述符wakeupFd_绑定的事件回调 当wakeup()时 即有事件发生时 调用handleRead()读wakeupFd_的8字节 同时唤醒阻塞的epoll_wait
     void handleRead();
     
     // 执行上层回调，处理的是异步投递的回调任务，可能来自其它线程或本线程的异步操作
     void doPendingFunctors();
+    // 每轮循环结束时更新忙碌时间和负载
+    void updateLoadStats();
+
+    // 把本轮积累的关注事件修改提交给poller，最终关注事件与内核中一致的直接丢弃
+    void applyChannelUpdates();
 
     using ChannelList = std::vector<Channel *>;
 
@@ -72,6 +114,9 @@ private:
     const pid_t threadId_; // 记录当前EventLoop是被哪个线程id创建的 即标识了当前EventLoop的所属线程id
 
     Timestamp pollReturnTime_; // Poller返回发生事件的Channels的时间点
+    // updateChannel会用到，必须在timerQueue_和wakeupChannel_之前构造
+    ChannelList pendingUpdateChannels_; // 关注事件有修改、等待提交给Poller的Channel列表
+    size_t elidedChannelUpdates_;       // 省掉的poller更新次数
     std::unique_ptr<Poller> poller_;
     std::unique_ptr<TimerQueue> timerQueue_;    // 定时器队列
 
@@ -81,6 +126,18 @@ private:
     ChannelList activeChannels_; // 返回Poller检测到当前有事件发生的所有Channel列表
 
     std::atomic_bool callingPendingFunctors_; // 标识当前loop是否有需要执行的回调操作
-    std::vector<Functor> pendingFunctors_;    // 存储loop需要执行的所有回调操作
-    std::mutex mutex_;                        // 互斥锁 用来保护上面vector容器的线程安全操作
+    std::vector<Functor> pendingFunctors_;    // 存储loop需要执行的所有普通优先级回调操作
+    std::vector<Functor> lowPriorityFunctors_; // 存储投递进来的低优先级回调操作
+    std::mutex mutex_;                        // 互斥锁 用来保护上面两个vector容器的线程安全操作
+
+    std::deque<Functor> lowPriorityBacklog_;  // 已取出但受预算限制尚未执行的低优先级回调，只在loop线程中访问
+    size_t lowPriorityMaxFunctors_;           // 每轮最多执行的低优先级回调数
+    int64_t lowPriorityMaxMicroSeconds_;      // 每轮执行低优先级回调的时间预算(微秒)
+
+    std::atomic_int connectionCount_;
+    std::atomic<size_t> queuedFunctors_;
+    std::atomic<int64_t> busyMicroSeconds_;
+    std::atomic<double> load_;
+    int64_t lastIterationEnd_;                // 上一轮循环结束的时间，只在loop线程中访问
+    int cpu_;
 };
\ No newline at end of file
@@ -19,9 +19,10 @@ public:
     // 线程初始化回调，在创建新线程的EventLoop后进行初始化操作
     using ThreadInitCallback = std::function<void(EventLoop *)>;
 
-    // 接受初始化回调操作和线程名字
+    // 接受初始化回调操作、线程名字和要绑定的CPU(小于0时不绑定)
     EventLoopThread(const ThreadInitCallback &cb = ThreadInitCallback(),
-                    const std::string &name = std::string());
+                    const std::string &name = std::string(),
+                    int cpu = -1);
     ~EventLoopThread();
 
     // 启动新线程并创建EventLoop，返回新线程中的EventLoop指针
@@ -30,6 +31,8 @@ public:
 private:
     // 线程主函数，负责在新线程中创建EventLoop并执行事件循环
     void threadFunc();
+    // 把当前线程绑定到cpu_，并让之后的内存分配优先使用本地NUMA节点
+    void bindToCpu();
 
     EventLoop *loop_;   // 新线程创建的EventLoop指针
     bool exiting_;      // 标记线程是否正在退出
@@ -37,4 +40,5 @@ private:
     std::mutex mutex_;
     std::condition_variable cond_;
     ThreadInitCallback callback_;   // 线程初始化回调函数
+    int cpu_;                       // 绑定的CPU，-1表示不绑定
 };
\ No newline at end of file
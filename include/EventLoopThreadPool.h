@@ -6,8 +6,11 @@
 #include <memory>
 
 #include "noncopyable.h"
+#include "LoadBalancePolicy.h"
+
 class EventLoop;
 class EventLoopThread;
+class InetAddress;
 
 class EventLoopThreadPool : noncopyable
 {
@@ -21,11 +24,20 @@ public:
     // 设置线程数量
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
 
+    // 设置IO线程绑定的CPU列表，第i个线程绑定cpus[i % cpus.size()]，应在start()之前设置
+    // 同时会给该线程上接受的连接设置SO_INCOMING_CPU
+    void setCpuAffinity(const std::vector<int> &cpus) { cpus_ = cpus; }
+
     // 开启线程池
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
     // 获取新连接到来时选择的EventLoop
     EventLoop *getNextLoop();
+    // 按负载均衡策略为对端为peerAddr的新连接选择EventLoop，未设置策略时轮询
+    EventLoop *getNextLoop(const InetAddress &peerAddr);
+
+    // 设置负载均衡策略，应在start()之前设置
+    void setLoadBalancePolicy(const std::shared_ptr<LoadBalancePolicy> &policy) { policy_ = policy; }
 
     // 获取线程池中全部的EventLoop
     std::vector<EventLoop *> getAllLoops();
@@ -42,4 +54,6 @@ private:
     int next_;              // 新连接到来时所选择的EventLoop索引
     std::vector<std::unique_ptr<EventLoopThread>> threads_; // IO线程列表
     std::vector<EventLoop *> loops_;    // 线程池中的EventLoop列表，由EVentLoopThread创建
+    std::shared_ptr<LoadBalancePolicy> policy_;
+    std::vector<int> cpus_;             // IO线程绑定的CPU列表，为空时不绑定
 };
\ No newline at end of file
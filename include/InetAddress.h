@@ -2,25 +2,58 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <string>
 
-//InetAddress 是对 sockaddr_in 的面向对象封装，提供了构造、格式化、访问和设置等功能
+//InetAddress 是对 socket 地址的面向对象封装，提供了构造、格式化、访问和设置等功能
+//支持 AF_INET、AF_INET6 和 AF_UNIX(含以'@'开头表示的抽象命名空间)
 class InetAddress
 {
 public:
+    // ip中含':'时按IPv6解析
     explicit InetAddress(uint16_t port = 8080, std::string ip = "127.0.0.1");
     explicit InetAddress(const sockaddr_in &addr)
-        : addr_(addr)
+        : len_(sizeof(addr))
     {
+        addr_.in = addr;
     }
+    explicit InetAddress(const sockaddr_in6 &addr)
+        : len_(sizeof(addr))
+    {
+        addr_.in6 = addr;
+    }
+    // 由getsockname/accept等返回的任意地址构造，len为内核填写的实际长度
+    InetAddress(const sockaddr *addr, socklen_t len);
+
+    // Unix域socket地址，path以'@'开头时表示抽象命名空间(不在文件系统中创建文件)
+    static InetAddress fromUnixPath(const std::string &path);
+    // 已连接或已绑定的socket的本端/对端地址
+    static InetAddress localAddressOf(int sockfd);
+    static InetAddress peerAddressOf(int sockfd);
 
+    sa_family_t family() const { return addr_.sa.sa_family; }
+    bool isUnix() const { return family() == AF_UNIX; }
+    // 抽象命名空间的Unix域地址
+    bool isAbstract() const { return isUnix() && len_ > offsetof(sockaddr_un, sun_path) && addr_.un.sun_path[0] == '\0'; }
+
+    // Unix域地址返回路径(抽象命名空间以'@'开头)，未绑定的对端为空
     std::string toIp() const;
     std::string toIpPort() const;
     uint16_t toPort() const;
 
-    const sockaddr_in *getSockAddr() const { return &addr_; }
-    void setSockAddr(const sockaddr_in &addr) { addr_ = addr; }
+    const sockaddr *getSockAddr() const { return &addr_.sa; }
+    socklen_t length() const { return len_; }
+    void setSockAddr(const sockaddr *addr, socklen_t len);
 
 private:
-    sockaddr_in addr_;
-};
\ No newline at end of file
+    union
+    {
+        sockaddr sa;
+        sockaddr_in in;
+        sockaddr_in6 in6;
+        sockaddr_un un;
+    } addr_;
+    socklen_t len_;     // Unix域地址的长度与路径有关，抽象命名空间的地址靠它确定名字的结尾
+};
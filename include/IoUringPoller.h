@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+#include "Poller.h"
+#include "Timestamp.h"
+
+class Channel;
+
+/**
+ * 基于io_uring的Poller实现，直接使用io_uring_setup/io_uring_enter系统调用，不依赖liburing
+ * 每个Channel对应一个IORING_OP_POLL_ADD请求，触发后在下一次poll()时重新提交(保持LT语义)，
+ * 重新提交、修改、取消的SQE都攒到下一次io_uring_enter时批量提交，一轮循环只需一次系统调用
+ *
+ * 这只是io_uring后端的第一阶段，以下两项尚未实现，留作后续工作：
+ *   1. 多次触发的poll(IORING_POLL_ADD_MULTI)：它只在有新的唤醒时才产生完成事件，相当于边沿触发，
+ *      而TcpConnection::handleRead每次事件只readv一次，数据没读完的连接会停住；
+ *      需要先把读路径改成读到EAGAIN为止，才能换成multishot，省掉每次触发后的重新提交
+ *   2. TcpConnection基于完成事件的收发(IORING_OP_RECV/SEND配合provided buffer ring)：
+ *      忙碌的loop收发数据不再需要系统调用，但连接不能再自己调用readv/write，
+ *      Buffer要能接管内核填好的缓冲区，sendFile、限速、迁移也要随之调整，不属于Poller层面的改动
+ **/
+class IoUringPoller : public Poller
+{
+public:
+    IoUringPoller(EventLoop *loop);
+    ~IoUringPoller() override;
+
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+
+    // 内核是否支持本实现需要的io_uring特性(EXT_ARG超时、CQ不丢弃)
+    static bool isSupported();
+
+private:
+    static const unsigned kRingEntries = 1024;
+
+    // 每个fd在内核中的poll请求状态
+    struct PollState
+    {
+        uint32_t generation; // 当前poll请求的代号，编码在user_data中，用于识别过期的完成事件
+        int events;          // 当前poll请求关注的事件
+        bool armed;          // 内核中是否有尚未完成的poll请求
+    };
+
+    void armPoll(Channel *channel, PollState *state);
+    void cancelPoll(int fd, const PollState &state);
+    io_uring_sqe *getSqe();
+    int enter(unsigned toSubmit, unsigned waitNr, int timeoutMs);
+    // 完成队列溢出导致无法提交时，把完成事件移到reapedCqes_，留给下一次fillActiveChannels
+    void reapCompletions();
+    void fillActiveChannels(ChannelList *activeChannels);
+    void handleCompletion(const io_uring_cqe &cqe, ChannelList *activeChannels);
+
+    int ringfd_;
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned *sqRingMask_;
+    unsigned *sqArray_;
+    unsigned sqEntries_;
+    io_uring_sqe *sqes_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned *cqRingMask_;
+    io_uring_cqe *cqes_;
+
+    void *sqRing_;
+    size_t sqRingSize_;
+    void *cqRing_;          // 内核支持IORING_FEAT_SINGLE_MMAP时与sqRing_相同
+    size_t cqRingSize_;
+    size_t sqesSize_;
+
+    unsigned pendingSubmit_;    // 已填写但还未提交给内核的SQE数量
+    uint32_t nextGeneration_;
+    std::vector<PollState> pollStates_; // 以fd为下标，与channels_同步扩容
+    std::vector<int> firedFds_; // 上一轮触发过的fd，下一次poll()前需要重新提交poll请求
+    std::vector<io_uring_cqe> reapedCqes_;  // 提交时为腾出完成队列而提前取出的完成事件
+};
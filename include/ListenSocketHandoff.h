@@ -0,0 +1,53 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+
+class Acceptor;
+class EventLoop;
+
+/**
+ * 不停机重启时在新旧进程之间转交监听socket
+ * 旧进程在控制地址(一般是抽象命名空间的Unix域地址)上监听，新进程启动时调用receive()连上来，
+ * 旧进程先关闭控制socket(让新进程可以接着监听同一个控制地址，供下一次重启使用)，再用SCM_RIGHTS把监听fd发过去，
+ * 然后回调handoffCallback，通常开始优雅退出；两个进程共享同一个监听socket，已在内核队列中的连接不会丢失
+ * 只在所属loop线程中使用
+ **/
+class ListenSocketHandoff : noncopyable
+{
+public:
+    using ListenFdsProvider = std::function<std::vector<int>()>;
+    using HandoffCallback = std::function<void()>;
+
+    ListenSocketHandoff(EventLoop *loop, const InetAddress &controlAddr);
+    ~ListenSocketHandoff();
+
+    // 转交时调用，返回要交出的监听fd(本进程仍保留自己的fd)
+    void setListenFdsProvider(const ListenFdsProvider &provider) { provider_ = provider; }
+    // fd成功发出后调用；发送失败时不调用，重新在控制地址上等待新进程
+    void setHandoffCallback(const HandoffCallback &cb) { handoffCallback_ = cb; }
+
+    void start();
+    bool handedOff() const { return handedOff_; }
+
+    // 新进程调用，阻塞地从controlAddr上的旧进程接收监听fd；没有旧进程在监听、超时或没有完整收到全部fd时返回空
+    static std::vector<int> receive(const InetAddress &controlAddr, double timeoutSeconds);
+
+private:
+    static const int kMaxFds = 64;
+
+    void handleNewConnection(int connfd);
+    void handoff(int connfd);
+
+    EventLoop *loop_;
+    const InetAddress controlAddr_;
+    std::unique_ptr<Acceptor> acceptor_;
+    ListenFdsProvider provider_;
+    HandoffCallback handoffCallback_;
+    bool handedOff_;
+    std::shared_ptr<bool> alive_;   // 推迟执行的转交用它判断本对象是否还在
+};
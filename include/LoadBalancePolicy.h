@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+#include "noncopyable.h"
+
+class EventLoop;
+class InetAddress;
+
+/**
+ * 新连接分配到哪个subloop的策略，由EventLoopThreadPool::getNextLoop在main loop线程中调用
+ * 内置：轮询、最少连接数、最少待处理工作、按对端地址哈希
+ * kReusePortPerLoop模式下由内核分配连接，不经过策略
+ **/
+class LoadBalancePolicy : noncopyable
+{
+public:
+    virtual ~LoadBalancePolicy() = default;
+
+    // loops非空
+    virtual EventLoop *select(const std::vector<EventLoop *> &loops, const InetAddress &peerAddr) = 0;
+};
+
+// 轮询，与原来getNextLoop的行为相同
+class RoundRobinPolicy : public LoadBalancePolicy
+{
+public:
+    RoundRobinPolicy() : next_(0) {}
+    EventLoop *select(const std::vector<EventLoop *> &loops, const InetAddress &peerAddr) override;
+
+private:
+    size_t next_;
+};
+
+// 存活连接数最少的loop，适合长连接、每个连接负载相近的场景
+class LeastConnectionsPolicy : public LoadBalancePolicy
+{
+public:
+    LeastConnectionsPolicy() : next_(0) {}
+    EventLoop *select(const std::vector<EventLoop *> &loops, const InetAddress &peerAddr) override;
+
+private:
+    size_t next_;   // 并列时从不同的loop开始比较，避免总是落到第一个
+};
+
+// 待处理工作最少的loop：回调队列长度加上最近的忙碌比例，适合连接负载差异大的场景
+class LeastPendingWorkPolicy : public LoadBalancePolicy
+{
+public:
+    // busyWeight：忙碌比例为1时相当于多少个排队的回调
+    explicit LeastPendingWorkPolicy(double busyWeight = 16.0) : busyWeight_(busyWeight), next_(0) {}
+    EventLoop *select(const std::vector<EventLoop *> &loops, const InetAddress &peerAddr) override;
+
+private:
+    const double busyWeight_;
+    size_t next_;
+};
+
+// 按对端IP哈希，同一客户端的连接总在同一个loop上(方便共享loop内的缓存/会话)
+class PeerHashPolicy : public LoadBalancePolicy
+{
+public:
+    EventLoop *select(const std::vector<EventLoop *> &loops, const InetAddress &peerAddr) override;
+
+private:
+    RoundRobinPolicy fallback_;     // 没有IP的Unix域连接
+};
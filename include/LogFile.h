@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <time.h>
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+/**
+ * 日志文件，按大小或时间周期滚动
+ * 文件名为 basename.YYYYmmdd-HHMMSS.hostname.pid.log
+ * 写入先进入用户态大缓冲区，缓冲区满、调用flush()、或append时发现距上次落盘超过flushInterval毫秒才write
+ * 新文件用fallocate预分配磁盘空间(FALLOC_FL_KEEP_SIZE，文件长度仍随写入增长)
+ * threadSafe为true(直接接到Logger::setOutput上同步使用)时，LogFile自带一个后台线程每flushInterval毫秒落盘一次，
+ * 日志停止写入后缓冲区中的内容也不会一直留在内存里；FATAL日志仍需通过Logger::setFlush在退出前落盘
+ * threadSafe为false时没有后台线程，由AsyncLogging/BinaryLogging的后台线程定期flush()
+ **/
+class LogFile : noncopyable
+{
+public:
+    LogFile(const std::string &basename,
+            off_t rollSize,
+            bool threadSafe = true,
+            int flushIntervalMs = 3000,
+            int rollPeriodSeconds = 60 * 60 * 24,
+            off_t preallocateSize = -1); // 小于0时预分配rollSize，等于0时不预分配
+    ~LogFile();
+
+    void append(const char *logline, size_t len);
+    void flush();
+    // 立即切换到新文件，同一秒内不会重复滚动
+    bool rollFile();
+
+    const std::string &currentFilename() const { return filename_; }
+
+private:
+    static const size_t kBufferSize = 256 * 1024;
+
+    // 同步使用时的定时落盘线程
+    void flushThreadFunc();
+    void appendUnlocked(const char *logline, size_t len);
+    void flushUnlocked();
+    void writeToFile(const char *data, size_t len);
+    std::string getLogFileName(time_t now) const;
+
+    const std::string basename_;
+    const off_t rollSize_;
+    const int flushIntervalMs_;
+    const int rollPeriodSeconds_;
+    const off_t preallocateSize_;
+
+    std::unique_ptr<std::mutex> mutex_; // threadSafe为false时为空，由调用者保证单线程写入
+    int fd_;
+    std::string filename_;
+    std::unique_ptr<char[]> buffer_;
+    size_t bufferLen_;
+    off_t writtenBytes_;    // 当前文件已写入的字节数(包括缓冲区中的)
+
+    time_t startOfPeriod_;  // 当前文件所在滚动周期的起点
+    time_t lastRoll_;
+    int64_t lastFlushMs_;   // 单调时钟
+
+    // 定时落盘，只在threadSafe且flushInterval大于0时启动，与写入共用mutex_
+    std::unique_ptr<Thread> flushThread_;
+    std::condition_variable flushCond_;
+    bool stopping_;
+};
@@ -4,72 +4,107 @@
 #include <fstream>
 #include <map>
 #include <memory>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
 
 #include "noncopyable.h"
 
-#define LOG_INFO(logmsgFormat, ...)         \
-    do                                      \
-    {                                       \
-        Logger &logger = Logger::instance();\
-        logger.setLogLevel(INFO);           \
-        char buf[1024] = {0};               \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);\
-        logger.log(buf);                    \
-    } while (0)
+// 日志级别的数值，数值越大越严重，供预处理器比较使用
+#define MUDUO_LOG_LEVEL_DEBUG 0
+#define MUDUO_LOG_LEVEL_INFO  1
+#define MUDUO_LOG_LEVEL_ERROR 2
+#define MUDUO_LOG_LEVEL_FATAL 3
 
-#define LOG_ERROR(logmsgFormat, ...)        \
-    do                                      \
-    {                                       \
-        Logger &logger = Logger::instance();\
-        logger.setLogLevel(ERROR);          \
-        char buf[1024] = {0};               \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);\
-        logger.log(buf);                    \
+// 编译期最低日志级别，低于该级别的LOG_*宏展开为空语句，参数也不会被求值
+// 可以通过 -DMUDUO_MIN_LOG_LEVEL=2 指定；未指定时定义了MUDEBUG则为DEBUG，否则为INFO
+#ifndef MUDUO_MIN_LOG_LEVEL
+#ifdef MUDEBUG
+#define MUDUO_MIN_LOG_LEVEL MUDUO_LOG_LEVEL_DEBUG
+#else
+#define MUDUO_MIN_LOG_LEVEL MUDUO_LOG_LEVEL_INFO
+#endif
+#endif
+
+// 先做运行期级别判断，被过滤掉的日志不做任何格式化
+#define LOG_WITH_LEVEL(level, logmsgFormat, ...)                  \
+    do                                                            \
+    {                                                             \
+        if (Logger::logLevel() <= level)                          \
+        {                                                         \
+            char buf[1024];                                       \
+            snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);     \
+            Logger::instance().log(level, buf);                   \
+        }                                                         \
     } while (0)
 
+#if MUDUO_MIN_LOG_LEVEL <= MUDUO_LOG_LEVEL_INFO
+#define LOG_INFO(logmsgFormat, ...) LOG_WITH_LEVEL(INFO, logmsgFormat, ##__VA_ARGS__)
+#else
+#define LOG_INFO(logmsgFormat, ...) do {} while (0)
+#endif
+
+#if MUDUO_MIN_LOG_LEVEL <= MUDUO_LOG_LEVEL_ERROR
+#define LOG_ERROR(logmsgFormat, ...) LOG_WITH_LEVEL(ERROR, logmsgFormat, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(logmsgFormat, ...) do {} while (0)
+#endif
+
+// FATAL日志不受级别控制，记录后退出进程
 #define LOG_FATAL(logmsgFormat, ...)                      \
     do                                                    \
     {                                                     \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(FATAL);                        \
-        char buf[1024] = {0};                             \
+        char buf[1024];                                   \
         snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
+        Logger::instance().log(FATAL, buf);               \
         exit(-1);                                         \
     } while (0)
 
-#ifdef MUDEBUG
-#define LOG_DEBUG(logmsgFormat, ...)         \
-    do                                      \
-    {                                       \
-        Logger &logger = Logger::instance();\
-        logger.setLogLevel(DEBUG);          \
-        char buf[1024] = {0};               \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__);\
-        logger.log(buf);                    \
-    } while (0)
+#if MUDUO_MIN_LOG_LEVEL <= MUDUO_LOG_LEVEL_DEBUG
+#define LOG_DEBUG(logmsgFormat, ...) LOG_WITH_LEVEL(DEBUG, logmsgFormat, ##__VA_ARGS__)
 #else
-#define LOG_DEBUG(logmsgFormat, ...)
+#define LOG_DEBUG(logmsgFormat, ...) do {} while (0)
 #endif
 
 enum LogLevel
 {
-    INFO,
-    ERROR,
-    FATAL,
-    DEBUG,
+    DEBUG = MUDUO_LOG_LEVEL_DEBUG,
+    INFO = MUDUO_LOG_LEVEL_INFO,
+    ERROR = MUDUO_LOG_LEVEL_ERROR,
+    FATAL = MUDUO_LOG_LEVEL_FATAL,
 };
 
 class Logger : noncopyable
 {
 public:
+    // 日志输出目的地，参数为一整行格式化好的日志(已包含级别前缀和换行)
+    using OutputFunc = std::function<void(const char *msg, size_t len)>;
+    using FlushFunc = std::function<void()>;
+
     static Logger &instance();
-    void setLogLevel(int level);
-    void log(std::string msg);
+    // 运行期最低日志级别，低于该级别的日志直接丢弃，默认与编译期级别相同
+    static int logLevel() { return logLevel_.load(std::memory_order_relaxed); }
+    static void setLogLevel(int level) { logLevel_.store(level, std::memory_order_relaxed); }
+    // 日志级别随每条日志传入，不再依赖共享状态
+    void log(int level, const char *msg);
+
+    // 替换日志输出，例如接到AsyncLogging::append上；未设置时按级别同步写入../log下的文件
+    // 应在程序启动、还没有其它线程写日志时设置
+    void setOutput(const OutputFunc &output) { output_ = output; }
+    // FATAL日志退出进程前调用，用于把缓冲中的日志落盘
+    void setFlush(const FlushFunc &flush) { flush_ = flush; }
 
 private:
     Logger(); // 构造函数私有化
     void openLogFiles(); // 打开所有日志文件
+    // 默认输出：按级别同步写入对应的日志文件
+    void defaultOutput(int level, const char *msg, size_t len);
+
     std::map<int, std::unique_ptr<std::ofstream>> logFiles_; // 日志文件流
-    int logLevel_;
-};
\ No newline at end of file
+    std::mutex mutex_;      // 多个IO线程同时写同一个日志文件流时加锁
+    OutputFunc output_;
+    FlushFunc flush_;
+    static std::atomic_int logLevel_;
+};
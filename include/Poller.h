@@ -1,7 +1,7 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
+#include <stdint.h>
 
 #include "noncopyable.h"
 #include "Timestamp.h"
@@ -22,12 +22,37 @@ public:
     virtual void removeChannel(Channel *channel) = 0;
 
     bool hasChannel(Channel *channel) const;
+    // 返回channel当前注册在内核中的关注事件，未注册返回0
+    int registeredEvents(Channel *channel) const;
 
     static Poller *newDefaultPoller(EventLoop *loop);
 
 protected:
-    using ChannelMap = std::unordered_map<int, Channel *>;
+    // fd是小而稠密的整数，用fd直接作下标的数组保存Channel，按需扩容，修改关注事件时无需哈希查找
+    struct ChannelSlot
+    {
+        Channel *channel;       // 为nullptr表示该fd当前没有Channel
+        uint32_t generation;    // 每次有新Channel占用该fd时自增，用于识别fd被复用后的过期事件
+        int events;             // 已经注册到内核的关注事件
+    };
+    using ChannelMap = std::vector<ChannelSlot>;
+
+    // 返回fd对应的Channel，不存在返回nullptr
+    Channel *findChannel(int fd) const
+    {
+        return static_cast<size_t>(fd) < channels_.size() ? channels_[fd].channel : nullptr;
+    }
+    // 返回fd当前的代号
+    uint32_t channelGeneration(int fd) const { return channels_[fd].generation; }
+    // 登记channel，返回它占用该fd的代号
+    uint32_t addChannel(Channel *channel);
+    // 注销fd上的channel
+    void eraseChannel(Channel *channel);
+    // 记录fd在内核中注册的关注事件
+    void setRegisteredEvents(int fd, int events) { channels_[fd].events = events; }
+
     ChannelMap channels_;
+    size_t numChannels_;    // 当前登记的Channel数量
 private:
     EventLoop *ownerLoop_;
 };
\ No newline at end of file
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "Socket.h"
+
+class TcpServer;
+
+/**
+ * 多进程模式：supervisor进程bind好监听socket之后fork出numWorkers个worker进程，
+ * 每个worker有自己的EventLoop和TcpServer，进程之间不共享内存分配器，一个worker崩溃不影响其他worker
+ * kReusePortPerWorker：supervisor为每个worker创建一个SO_REUSEPORT的监听socket，由内核分配连接；
+ *                      socket一直由supervisor持有，worker重启期间分给它的连接在队列里等待，不会被拒绝
+ * kSharedListenSocket：所有worker继承同一个监听socket，谁先accept到算谁的；Unix域地址只能用这种方式
+ * supervisor在worker退出后重新fork，并通过一页共享内存汇总各worker的统计
+ * run()应在进程创建任何线程之前调用，fork只复制调用线程
+ **/
+class PreforkServer : noncopyable
+{
+public:
+    enum Option
+    {
+        kReusePortPerWorker,
+        kSharedListenSocket
+    };
+
+    static const int kMaxCounters = 8;
+
+    // 共享内存中每个worker一个槽位，独占缓存行；计数属于当前这一代worker，重启后清零
+    struct alignas(64) WorkerStats
+    {
+        std::atomic<int> pid;                   // 0表示该worker当前不在运行
+        std::atomic<uint64_t> restarts;         // supervisor重新fork该worker的次数
+        std::atomic<int64_t> heartbeat;         // worker最近一次发布统计的时间(微秒)
+        std::atomic<uint64_t> connections;      // 以下由worker定时发布
+        std::atomic<uint64_t> rejectedConnections;
+        std::atomic<int64_t> busyMicroSeconds;  // worker主loop的忙碌时间
+        std::atomic<uint64_t> counters[kMaxCounters];   // 业务自定义计数，worker直接累加
+    };
+
+    // 所有worker的汇总
+    struct Totals
+    {
+        int liveWorkers = 0;
+        uint64_t restarts = 0;
+        uint64_t connections = 0;
+        uint64_t rejectedConnections = 0;
+        int64_t busyMicroSeconds = 0;
+        uint64_t counters[kMaxCounters] = {};
+    };
+
+    // 在worker进程中、TcpServer::start()之前调用，用来设置回调、线程数等
+    using WorkerSetup = std::function<void(TcpServer &server, int workerIndex)>;
+    using ReportCallback = std::function<void(const Totals &totals)>;
+
+    PreforkServer(const InetAddress &listenAddr,
+                  const std::string &nameArg,
+                  int numWorkers,
+                  Option option = kReusePortPerWorker);
+    ~PreforkServer();
+
+    void setWorkerSetup(const WorkerSetup &cb) { workerSetup_ = cb; }
+    // 把worker依次绑定到cpus中的CPU
+    void setCpuAffinity(const std::vector<int> &cpus) { cpus_ = cpus; }
+    // 收到SIGTERM/SIGINT后worker优雅退出的时限，见TcpServer::drain
+    void setDrainSeconds(double seconds) { drainSeconds_ = seconds; }
+    // worker超过该时间没有发布统计(loop卡死)时被SIGKILL后重启，0表示不检查
+    void setHangTimeout(double seconds) { hangTimeout_ = seconds; }
+    // supervisor每隔intervalSeconds秒回调一次汇总统计
+    void setReportCallback(double intervalSeconds, const ReportCallback &cb)
+    { reportInterval_ = intervalSeconds; reportCallback_ = cb; }
+
+    // 在supervisor进程中运行，直到收到SIGTERM/SIGINT或调用stop()，所有worker退出后返回
+    void run();
+    // 可在信号处理函数中调用
+    static void stop();
+
+    int numWorkers() const { return numWorkers_; }
+    // supervisor和worker中都可以调用
+    const WorkerStats &workerStats(int index) const { return stats_[index]; }
+    Totals totals() const;
+    // 本worker的槽位，供业务累加counters；在supervisor中为空
+    WorkerStats *localStats() const { return localIndex_ >= 0 ? &stats_[localIndex_] : nullptr; }
+
+private:
+    struct Worker
+    {
+        pid_t pid = 0;
+        int64_t startTime = 0;          // 微秒
+        int64_t restartAt = 0;          // 大于0时表示在该时间重新fork
+        double backoff = 0.0;
+    };
+
+    void createListenSockets();
+    void spawn(int index);
+    // worker进程的主体，不返回
+    void runWorker(int index);
+    void reap(pid_t pid, int status);
+    void checkHungWorkers(int64_t now);
+    void shutdownWorkers();
+
+    const InetAddress listenAddr_;
+    const std::string name_;
+    const int numWorkers_;
+    const Option option_;
+
+    WorkerSetup workerSetup_;
+    std::vector<int> cpus_;
+    double drainSeconds_;
+    double hangTimeout_;
+    double reportInterval_;
+    ReportCallback reportCallback_;
+
+    std::vector<std::unique_ptr<Socket>> listenSockets_;   // supervisor持有，worker重启后继续使用
+    std::string unixPath_;  // 监听文件系统中的Unix域地址时，supervisor析构时删除该文件
+    std::vector<Worker> workers_;
+    WorkerStats *stats_;    // MAP_SHARED的匿名映射，fork之后supervisor和所有worker看到同一份
+    size_t statsBytes_;
+    int localIndex_;        // 在worker进程中为自己的下标，supervisor中为-1
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "noncopyable.h"
 
 class InetAddress;
@@ -15,6 +17,8 @@ public:
     ~Socket();
 
     int fd() const { return sockfd_; }
+    // 提前关闭fd，之后fd()返回-1，析构时不再关闭
+    void close();
     void bindAddress(const InetAddress &localaddr);
     void listen();
     int accept(InetAddress *peeraddr);
@@ -26,11 +30,18 @@ public:
     void setReuseAddr(bool on);
     // 是否允许多个socket绑定到同一端口
     void setReusePort(bool on);
+    // 设置SO_INCOMING_CPU，提示内核该socket在哪个CPU上处理
+    void setIncomingCpu(int cpu);
+    // 设置SO_MAX_PACING_RATE(字节/秒)，由内核按速率发包(fq队列规则，或Linux 4.13起TCP自身的pacing)，失败返回false
+    bool setMaxPacingRate(uint64_t bytesPerSecond);
     // 检测长连接是否断开
     void setKeepAlive(bool on);
     // 添加长连接心跳检测自定义时间功能，idle：连接空闲多少秒后开启；interval：两次检测间隔多少秒；count：断开前重试次数
     void setKeepAlive(int idle, int interval, int count);
+
+    // 删除路径上残留的Unix域socket文件；路径上是普通文件、目录等其他类型时不删除，返回false(之后bind会失败)
+    static bool removeUnixSocketFile(const char *path);
     
 private:
-    const int sockfd_;
+    int sockfd_;
 };
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Connector.h"
+#include "InetAddress.h"
+#include "TcpConnection.h"
+
+class EventLoop;
+
+/**
+ * TCP客户端，一个TcpClient管理到一个服务器的一条连接
+ * 由Connector非阻塞地建立连接，连接建立后的读写与服务端的TcpConnection完全相同
+ * 开启enableRetry()后，已建立的连接断开时会自动重连；连接失败的重试由Connector按指数退避完成，
+ * 设置了最大尝试次数时，连续失败后放弃并调用connectFailedCallback
+ * 应在loop线程中析构
+ **/
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop,
+              const InetAddress &serverAddr,
+              const std::string &nameArg);
+    ~TcpClient();
+
+    // 发起连接，可在任意线程调用
+    void connect();
+    // 关闭已建立连接的写端
+    void disconnect();
+    // 放弃正在进行的连接和重试
+    void stop();
+
+    TcpConnectionPtr connection() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop *getLoop() const { return loop_; }
+    bool retry() const { return retry_; }
+    // 已建立的连接断开后自动重连
+    void enableRetry() { retry_ = true; }
+    const std::string &name() const { return name_; }
+
+    // 单次连接超时(秒)和重试间隔，应在connect()之前设置
+    void setConnectTimeout(double seconds) { connector_->setConnectTimeout(seconds); }
+    void setRetryDelay(int initialMs, int maxMs) { connector_->setRetryDelay(initialMs, maxMs); }
+    // 连续失败多少次后放弃，小于等于0表示一直重试(默认)
+    void setMaxConnectAttempts(int maxAttempts) { connector_->setMaxAttempts(maxAttempts); }
+    // 已发起的connect次数(含重试)
+    int connectAttempts() const { return connector_->attempts(); }
+
+    // 以下回调应在connect()之前设置，不是线程安全的
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    // 放弃连接时在loop线程中调用，可以在回调中安排销毁TcpClient，但不能直接析构
+    void setConnectFailedCallback(const Connector::ConnectFailedCallback &cb) { connector_->setConnectFailedCallback(cb); }
+
+private:
+    // 在loop线程中由Connector回调
+    void newConnection(int sockfd);
+    // 在loop线程中由TcpConnection回调
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    int nextConnId_;            // 只在loop线程中访问
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_;   // 受mutex_保护
+};
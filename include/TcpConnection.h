@@ -1,14 +1,18 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <atomic>
+#include <stdint.h>
 
 #include "noncopyable.h"
 #include "InetAddress.h"
 #include "Callbacks.h"
 #include "Buffer.h"
 #include "Timestamp.h"
+#include "TokenBucket.h"
 
 class Channel;
 class EventLoop;
@@ -23,19 +27,41 @@ class Socket;
 class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
 {
 public:
+    // 输出缓冲区达到硬上限时的处理方式
+    enum OverflowPolicy
+    {
+        kDropMessage,   // 丢弃放不下的整条消息，连接保留，适合广播行情、推送等可以丢的数据
+        kForceClose     // 关闭连接
+    };
+
     TcpConnection(EventLoop *loop,
                   const std::string &nameArg,
                   int sockfd,
                   const InetAddress &localAddr,
                   const InetAddress &peerAddr);
+    // 以64位id标识连接，名字(namePrefix#id)只在第一次调用name()时才格式化，由TcpServer使用
+    TcpConnection(EventLoop *loop,
+                  uint64_t id,
+                  std::shared_ptr<const std::string> namePrefix,
+                  int sockfd,
+                  const InetAddress &localAddr,
+                  const InetAddress &peerAddr);
     ~TcpConnection();
 
-    EventLoop *getLoop() const { return loop_; }
-    const std::string &name() const { return name_; }
+    // 连接迁移后会变化，可在任意线程调用
+    EventLoop *getLoop() const { return loop_.load(std::memory_order_acquire); }
+    uint64_t id() const { return id_; }
+    int fd() const;
+    const std::string &name() const;
     const InetAddress &localAddress() const { return localAddr_; }
     const InetAddress &peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
+    bool disconnected() const { return state_ == kDisconnected; }
+    // 已从原loop注销、还未在新loop注册
+    bool migrating() const { return migrating_; }
+    // 输出缓冲区中还未写入内核的字节数，只在所属loop线程中调用
+    size_t outputBufferBytes() const { return outputBuffer_.readableBytes(); }
 
     // 发送数据
     void send(const std::string &buf);
@@ -43,6 +69,10 @@ public:
     
     // 关闭半连接(关闭服务端的写连接)
     void shutdown();
+    // 不等对端，直接关闭连接，未发送的数据被丢弃；可在任意线程调用
+    void forceClose();
+    // seconds秒后再强制关闭，期间不再接受新的发送(包括之前从其他线程投递、尚未执行的)，缓冲区中的数据(如给对端的错误提示)继续发；可在任意线程调用
+    void forceCloseWithDelay(double seconds);
 
     void setConnectionCallback(const ConnectionCallback &cb)
     { connectionCallback_ = cb; }
@@ -54,10 +84,33 @@ public:
     { closeCallback_ = cb; }
     void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark)
     { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; }
+    // 输出缓冲区的硬上限，capBytes为0表示不限制；高水位回调只是通知，超过硬上限时按policy处理
+    // kForceClose且closeDelaySeconds大于0时用forceCloseWithDelay关闭；只能在所属loop线程中调用
+    // 一条消息已有部分写入内核时不能丢弃剩下的部分(否则字节流错乱)，此时仍然追加，缓冲区可能略超上限
+    void setOutputBufferCap(size_t capBytes, OverflowPolicy policy = kForceClose, double closeDelaySeconds = 0.0);
+    void setOutputOverflowCallback(const OutputOverflowCallback &cb) { outputOverflowCallback_ = cb; }
+    // 因超过硬上限丢弃的消息数，只在所属loop线程中读取
+    uint64_t droppedMessages() const { return droppedMessages_; }
+
+    // 限制发送速率(字节/秒)，bytesPerSecond小于等于0取消限制；burstBytes为0时取20ms的量(至少4KB)
+    // 超出速率的数据留在outputBuffer_中，由定时器按令牌补充的节奏分批写出，而不是一次写给内核
+    // kernelPacing为true时优先设置SO_MAX_PACING_RATE交给内核按速率发包，设置失败再退回用户态令牌桶
+    // sendFile的数据不经过outputBuffer_，只受内核pacing限制；只能在所属loop线程中调用(如connectionCallback中)
+    void setSendRateLimit(double bytesPerSecond, double burstBytes = 0, bool kernelPacing = false);
+    // 与同一loop上其他连接共用的令牌桶，用于限制多个连接的总速率，只能在所属loop线程中使用
+    void setSharedSendBucket(const std::shared_ptr<TokenBucket> &bucket);
+    bool paced() const { return !sendBucket_.unlimited() || sharedSendBucket_; }
 
     // 连接建立
     void connectEstablished();
-    // 在EventLoop线程安全销毁连接，由TcpServer在收到closeCallback_通知后调用
+    // 连接迁移，由TcpServer::migrateConnection调用
+    // detachFromLoop在原loop线程中从poller上注销，此后loop_即指向target；attachToLoop在target线程中重新注册
+    // 迁移前已投递到原loop的写完成、高水位回调仍在原loop线程中执行；其他线程的send在迁移前后保持调用顺序
+    void detachFromLoop(EventLoop *target);
+    void attachToLoop();
+    // 处理读事件(含messageCallback_)累计耗费的时间，只在所属loop线程中读取
+    int64_t busyMicroSeconds() const { return busyMicroSeconds_; }
+    // 在EventLoop线程安全销毁连接，由TcpServer在收到closeCallback_通知后调用；之后连接处于kDisconnected，不会再触发关闭流程
     void connectDestroyed();
 
 private:
@@ -77,14 +130,33 @@ private:
     void handleClose();
     void handleError();
 
+    // 当前线程是否是连接所属的loop线程，迁移途中(已从原loop注销、还未在新loop注册)返回false
+    bool inOwnerLoop() const;
+    Channel *newChannel(EventLoop *loop, int sockfd);
+
     // 实际发送数据给客户端，data是数据首地址
     void sendInLoop(const void *data, size_t len);
+    // 在所属loop中按顺序发出其他线程send()排队的数据，迁移途中不处理
+    void flushPendingSends();
     void shutdownInLoop();
+    void forceCloseInLoop();
+    // 输出缓冲区放不下一条消息时按overflowPolicy_丢弃消息或关闭连接
+    void handleOutputOverflow(size_t pendingBytes, size_t messageBytes);
+    // 限速时代替handleWrite/sendInLoop的直接写：按可用令牌写出outputBuffer_，令牌不够时定时再写
+    void flushPaced();
+    // 令牌用完后等待补充的定时器回调
+    void onPacingTimer();
     void sendFileInLoop(int fileDescriptor, off_t offset, size_t count);
-    EventLoop *loop_; // 这里是baseloop还是subloop由TcpServer中创建的线程数决定 若为多Reactor 该loop_指向subloop 若为单Reactor 该loop_指向baseloop
-    const std::string name_;
+    std::atomic<EventLoop *> loop_; // 这里是baseloop还是subloop由TcpServer中创建的线程数决定 若为多Reactor 该loop_指向subloop 若为单Reactor 该loop_指向baseloop
+    const uint64_t id_;
+    const std::shared_ptr<const std::string> namePrefix_; // 同一个TcpServer的所有连接共享
+    mutable std::string name_;
+    mutable std::once_flag nameOnce_;
     std::atomic_int state_; // 连接状态
     bool reading_;//连接是否在监听读事件
+    std::atomic_bool migrating_; // 正在迁移到其他loop
+    std::atomic_bool closePending_; // 已调用forceClose/forceCloseWithDelay，之后执行的发送直接丢弃
+    int64_t busyMicroSeconds_;
 
     // Socket Channel 这里和Acceptor类似    Acceptor => mainloop    TcpConnection => subloop
     std::unique_ptr<Socket> socket_;
@@ -98,10 +170,24 @@ private:
     MessageCallback messageCallback_;             // 有读写消息时的回调
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成以后的回调，低水位回调
     HighWaterMarkCallback highWaterMarkCallback_; // 高水位回调
+    OutputOverflowCallback outputOverflowCallback_;
     CloseCallback closeCallback_; // 关闭连接的回调
     size_t highWaterMark_; // 高水位阈值，发送缓冲区outputBuffer_的数据量上限
+    size_t outputBufferCap_;   // 硬上限，0表示不限制
+    OverflowPolicy overflowPolicy_;
+    double overflowCloseDelay_;
+    uint64_t droppedMessages_;
+
+    // 发送限速，只在所属loop线程中访问
+    TokenBucket sendBucket_;
+    std::shared_ptr<TokenBucket> sharedSendBucket_;
+    bool pacingTimerActive_;
 
     // 数据缓冲区
     Buffer inputBuffer_;    // 接收数据的缓冲区
     Buffer outputBuffer_;   // 发送数据的缓冲区 用户send向outputBuffer_发
+
+    // 其他线程send()的数据，按调用顺序由所属loop取走写入
+    std::mutex pendingSendsMutex_;
+    std::vector<std::string> pendingSends_;
 };
@@ -9,6 +9,8 @@
 #include <memory>
 #include <atomic>
 #include <unordered_map>
+#include <vector>
+#include <stdint.h>
 
 #include "EventLoop.h"
 #include "Acceptor.h"
@@ -18,6 +20,8 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"
 #include "Buffer.h"
+#include "ListenSocketHandoff.h"
+#include "AdmissionControl.h"
 
 // 使用时设置好callback，再调用start()即可
 class TcpServer : noncopyable
@@ -25,17 +29,27 @@ class TcpServer : noncopyable
 public:
     // 用于线程池中每个 EventLoop 初始化时调用
     using ThreadInitCallback = std::function<void(EventLoop *)>;
+    // 优雅退出完成时在main loop中调用，forced为true表示截止时间到时仍有连接被强制关闭
+    using DrainedCallback = std::function<void(bool forced)>;
 
     enum Option
     {
         kNoReusePort,   // 不允许重用本地端口
-        kReusePort      // 允许重用本地端口
+        kReusePort,     // 允许重用本地端口
+        // 线程池中每个loop各自持有一个SO_REUSEPORT的Acceptor，由内核在这些监听socket之间分配新连接，
+        // 连接在接受它的线程上直接建立和服务，不经过main loop转交；线程数为0或监听Unix域地址时与kReusePort相同
+        kReusePortPerLoop
     };
 
     TcpServer(EventLoop *loop,
               const InetAddress &listenAddr,
               const std::string &nameArg,
               Option option = kNoReusePort);
+    // 接管前一个进程交来的监听socket(见ListenSocketHandoff::receive)，监听地址取自第一个fd
+    TcpServer(EventLoop *loop,
+              const std::vector<int> &inheritedListenFds,
+              const std::string &nameArg,
+              Option option = kNoReusePort);
     ~TcpServer();
 
     // 设置线程初始化回调
@@ -46,25 +60,144 @@ public:
     void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
     // 设置消息发送完成时的回调
     void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    // 设置输出缓冲区从下方越过highWaterMark时的回调
+    void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark)
+    { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; }
+    // 慢消费者保护，应在start()之前调用：每个连接的输出缓冲区不超过capBytes，超过时按policy丢弃消息或关闭连接，
+    // 见TcpConnection::setOutputBufferCap；一个读得慢的连接不会因为广播等数据把服务端内存撑大
+    void setOutputBufferCap(size_t capBytes,
+                            TcpConnection::OverflowPolicy policy = TcpConnection::kForceClose,
+                            double closeDelaySeconds = 0.0);
+    // 丢弃消息或关闭连接之后回调
+    void setOutputOverflowCallback(const OutputOverflowCallback &cb) { outputOverflowCallback_ = cb; }
+    // 因输出缓冲区超过硬上限丢弃的消息数和关闭的连接数，可在任意线程读取
+    uint64_t overflowDroppedMessages() const { return overflowDroppedMessages_.load(std::memory_order_relaxed); }
+    uint64_t overflowClosedConnections() const { return overflowClosedConnections_.load(std::memory_order_relaxed); }
 
     void setThreadNum(int numThreads);
+    // 设置新连接分配到subloop的策略，默认轮询；kReusePortPerLoop模式下由内核分配，不使用策略
+    void setLoadBalancePolicy(const std::shared_ptr<LoadBalancePolicy> &policy) { threadPool_->setLoadBalancePolicy(policy); }
+    // 把subloop线程依次绑定到cpus中的CPU，应在start()之前设置
+    void setCpuAffinity(const std::vector<int> &cpus) { threadPool_->setCpuAffinity(cpus); }
     void start();
+
+    // 把已建立的连接迁移到本服务器的另一个loop，可在任意线程调用；连接已关闭或已在target上时不做任何事
+    // 输入输出缓冲区和回调随连接对象一起迁移，不能与TcpServer的析构并发
+    void migrateConnection(const TcpConnectionPtr &conn, EventLoop *target);
+    // 开启自动负载均衡，应在start()之前调用：main loop每隔intervalSeconds秒比较各subloop的忙碌比例，
+    // 最忙与最闲的差值超过minImbalance时，把最忙loop上读事件耗时多的连接迁往最闲的loop，迁移量约为差值的一半
+    // 只剩一个耗时的连接时不迁移，否则热点只是换了个loop
+    void enableAutoRebalance(double intervalSeconds = 1.0, double minImbalance = 0.2);
+    // 累计迁移的连接数
+    uint64_t migratedConnections() const { return migratedConnections_.load(std::memory_order_relaxed); }
+
+    // 优雅退出，可在任意线程调用：关闭监听socket(已转交给新进程时只停止accept)，等已有连接自行关闭，
+    // deadlineSeconds秒后强制关闭剩下的连接，全部关闭后回调cb；退出期间draining()为true，业务层应在回复完当前请求后关闭连接(如shutdown())
+    void drain(double deadlineSeconds, const DrainedCallback &cb = DrainedCallback());
+    bool draining() const { return draining_; }
+    // 存活的连接数，可在任意线程读取
+    size_t connectionCount() const { return liveConnections_.load(std::memory_order_relaxed); }
+    // 不停机重启，应在start()之后调用：在controlAddr上等待新进程，把监听socket交给它之后开始drain
+    void enableHandoff(const InetAddress &controlAddr, double drainSeconds, const DrainedCallback &cb);
+    // 当前的监听fd，只在main loop中调用；drain关闭监听socket后不再包含
+    std::vector<int> listenFds() const;
+
+    // 发送限速，应在start()之前调用：每个连接不超过connectionBytesPerSecond(见TcpConnection::setSendRateLimit)，
+    // serverBytesPerSecond大于0时再限制所有连接的总速率，平分给各loop，同一loop上的连接共用一个令牌桶，不需要跨线程加锁
+    // 小于等于0表示不限制；kernelPacing只作用于单个连接的限速
+    void setSendRateLimit(double connectionBytesPerSecond, double serverBytesPerSecond = 0, bool kernelPacing = false);
+
+    // 过载保护，应在start()之前调用，见AdmissionControl
+    // 新连接由main loop分配时，选中的loop已达单loop上限会改投连接最少的loop，都满了才拒绝
+    void setAdmissionLimits(const AdmissionControl::Limits &limits);
+    // 以下统计可在任意线程读取
+    uint64_t rejectedConnections() const;
+    uint64_t rejectedConnections(AdmissionControl::Verdict reason) const;
+    // kPauseAccepting模式下Acceptor被暂停的次数
+    uint64_t acceptPauses() const { return acceptPauses_.load(std::memory_order_relaxed); }
+    // 因输出缓冲区总量过大被关闭的连接数
+    uint64_t shedConnections() const { return shedConnections_.load(std::memory_order_relaxed); }
+    // 最近一次采样的所有连接输出缓冲区总字节数，开启过载保护后每kAdmissionCheckInterval秒更新
+    size_t outputBufferBytes() const;
 private:
+    static constexpr double kAdmissionCheckInterval = 0.05;
+
+    TcpServer(EventLoop *loop,
+              const InetAddress &listenAddr,
+              const std::string &nameArg,
+              Option option,
+              const std::vector<int> &inheritedListenFds);
+
     // 新连接到来时的回调
     void newConnection(int sockfd, const InetAddress &peerAddr);
-    // 移除连接的端口
+    // kReusePortPerLoop模式下各loop的Acceptor接受连接后的回调
+    void newConnectionInLoop(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    // 过载检查，通过时计入连接数；不通过时以RST关闭sockfd并返回false
+    // movable为true时(由main loop分配的连接)可以把*ioLoop换成连接最少的loop
+    bool admitConnection(int sockfd, const InetAddress &peerAddr, EventLoop **ioLoop, bool movable);
+    // kPauseAccepting模式下Acceptor每次accept之前调用，acceptLoop为空表示由main loop分配的连接
+    bool acceptGate(EventLoop *acceptLoop);
+    EventLoop *leastLoadedLoop();
+    // 由main loop的定时器调用，汇总输出缓冲区、决定是否削减连接，并恢复被暂停的Acceptor
+    void checkAdmission();
+    // 连接的输出缓冲区超过硬上限时在其所属loop中回调
+    void onOutputOverflow(const TcpConnectionPtr &conn, size_t pendingBytes, size_t messageBytes);
+    // 在ioLoop上创建并建立连接，kReusePortPerLoop模式下由各loop的Acceptor在本线程直接调用
+    void establishConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    // 连接关闭时由TcpConnection在其所属loop中回调，直接从该loop的连接表中移除
     void removeConnection(const TcpConnectionPtr &conn);
-    // 实际执行在所属的EvnetLoop线程中移除连接的回调，由removeConnection传入runInLoop
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    // 在连接所属的source loop中执行，从source注销后投递到target重新注册
+    void migrateInLoop(const TcpConnectionPtr &conn, EventLoop *source, EventLoop *target);
+    void drainInLoop(double deadlineSeconds, const DrainedCallback &cb);
+    // 由main loop的定时器调用，检查连接是否都已关闭，到截止时间后强制关闭
+    void checkDrained();
+    // 在各loop中对其所有连接执行action
+    void forEachConnection(const std::function<void(const TcpConnectionPtr &)> &action);
+    // 监听fd交给新进程时调用，之后本进程的Acceptor析构时不再删除Unix域socket文件
+    std::vector<int> handOffListenFds();
+    // 由main loop的定时器调用，找出最忙和最闲的loop
+    void rebalance();
+    // 在from loop中执行，按连接最近的读事件耗时从大到小挑选，累计不超过budget(每秒忙碌微秒数)的连接迁往to
+    void moveBusiestConnections(EventLoop *from, EventLoop *to, double budget);
+
+    // 每个loop一份的连接表，以连接的fd为下标，只在所属loop线程中访问，增删都不需要加锁也不需要跨线程
+    // fd在连接析构(关闭socket)之前不会被复用，所以同一时刻一个下标只对应一个连接
+    struct ConnectionRegistry
+    {
+        std::vector<TcpConnectionPtr> connections;
+        size_t size = 0;
+        // 分配给本loop的连接数，在接受连接时就计入(连接还在排队建立时size尚未增加)，可在其他线程读取
+        std::atomic<size_t> admitted{0};
+        // 最近一次采样的本loop所有连接输出缓冲区字节数
+        std::atomic<size_t> outputBytes{0};
+        // 服务器总发送速率在本loop上的份额，本loop的连接共用；未限速时为空
+        std::shared_ptr<TokenBucket> sendBucket;
+
+        // 自动负载均衡用：上次采样时各连接的busyMicroSeconds()，下标同connections
+        std::vector<int64_t> busySamples;
+        int64_t lastSampleTime = 0;
+
+        void add(const TcpConnectionPtr &conn);
+        void remove(const TcpConnectionPtr &conn);
+        // 计算各连接自上次采样以来每秒的忙碌微秒数，rates为空时只更新采样
+        void sample(std::vector<std::pair<double, TcpConnectionPtr>> *rates);
+    };
+    ConnectionRegistry *registryFor(EventLoop *loop);
+    // 在各loop中统计输出缓冲区，keepRatio小于1时按输出缓冲区从大到小关闭连接，直到总量降到原来的keepRatio
+    void sampleOutputBuffers(ConnectionRegistry *registry, double keepRatio);
 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>; // 存储所有TcpConnection和对应名字
-    
     EventLoop * loop_;      // main loop(baseloop)
 
+    const InetAddress listenAddr_;
     const std::string ipPort_;
     const std::string name_;    // 服务器名字
+    const std::shared_ptr<const std::string> connNamePrefix_;  // 连接名字的公共前缀 name-ip:port
+    const Option option_;
 
-    std::unique_ptr<Acceptor> acceptor_;    // 运行在main loop，监听新连接事件
+    std::unique_ptr<Acceptor> acceptor_;    // 运行在main loop，监听新连接事件；kReusePortPerLoop且有线程池时或接管了监听socket时为空
+    std::vector<int> inheritedListenFds_;   // 接管的监听socket，start()时交给各Acceptor
+    // kReusePortPerLoop模式下每个subloop的Acceptor，只能在各自的loop线程中析构
+    std::vector<std::pair<EventLoop *, std::unique_ptr<Acceptor>>> loopAcceptors_;
 
     std::shared_ptr<EventLoopThreadPool> threadPool_;   // 线程池，每个线程一个loop
 
@@ -72,9 +205,51 @@ private:
     ConnectionCallback connectionCallback_; // 新连接建立或关闭时的回调
     MessageCallback messageCallback_;       // 有读写事件发生时的回调
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成后的回调
+    HighWaterMarkCallback highWaterMarkCallback_;
+    size_t highWaterMark_;
+    OutputOverflowCallback outputOverflowCallback_;
+
+    // 慢消费者保护
+    size_t outputBufferCap_;    // 0表示不限制
+    TcpConnection::OverflowPolicy overflowPolicy_;
+    double overflowCloseDelay_;
+    std::atomic<uint64_t> overflowDroppedMessages_;
+    std::atomic<uint64_t> overflowClosedConnections_;
 
     int numThreads_;    // 线程池中线程的数量
     std::atomic_int started_;   // 服务器启动的次数，用于安全启动
-    int nextConnId_;    // 标识接收到的对端的TcpConnection，自增，用于给新连接命名
-    ConnectionMap connections_; // 保存所有的连接
+    std::atomic<uint64_t> nextConnId_;  // 新连接的id，自增；多个loop可能同时接受连接
+    // 每个loop的连接表，在start()中建好后只读
+    std::unordered_map<EventLoop *, std::unique_ptr<ConnectionRegistry>> registries_;
+
+    // 自动负载均衡，以下除migratedConnections_外只在main loop中访问
+    double rebalanceInterval_;      // 小于等于0表示未开启
+    double rebalanceMinImbalance_;
+    bool rebalanceStarted_;
+    TimerId rebalanceTimer_;
+    std::vector<int64_t> lastLoopBusy_; // 上一轮各subloop的busyMicroSeconds()，下标同getAllLoops()
+    Timestamp lastRebalance_;
+    std::atomic<uint64_t> migratedConnections_;
+
+    // 优雅退出和不停机重启，以下除draining_外只在main loop中访问
+    std::atomic_bool draining_;
+    std::atomic<size_t> liveConnections_;
+    DrainedCallback drainedCallback_;
+    Timestamp drainDeadline_;
+    bool drainForced_;
+    bool drainTimerActive_;
+    TimerId drainTimer_;
+    std::unique_ptr<ListenSocketHandoff> handoff_;
+
+    // 发送限速
+    double connectionSendRate_;
+    double serverSendRate_;
+    bool kernelPacing_;
+
+    // 过载保护，admission_在start()之后只读
+    std::unique_ptr<AdmissionControl> admission_;
+    bool admissionTimerActive_;
+    TimerId admissionTimer_;
+    std::atomic<uint64_t> acceptPauses_;
+    std::atomic<uint64_t> shedConnections_;
 };
\ No newline at end of file
@@ -10,6 +10,9 @@ public:
     explicit Timestamp(int64_t microSecondsSinceEpoch);
     static Timestamp now();
     std::string toString() const;
+    // 把 "YYYY/MM/DD HH:MM:SS.uuuuuu" 写入调用者提供的缓冲区，不分配内存，返回写入的长度(不含结尾的'\0')
+    // 每个线程缓存当前这一秒格式化好的日期时间，同一秒内只需填写微秒部分；缓冲区不够时返回0
+    size_t toFormattedString(char *buf, size_t len, bool showMicroseconds = true) const;
     int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
 
     static Timestamp invalid()
@@ -26,7 +29,7 @@ private:
 
 inline Timestamp addTime(Timestamp timestamp, double seconds)
 {
-    int64_t delta = static_cast<int64_t>(seconds);
+    int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
     return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
 }
 
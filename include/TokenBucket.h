@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <stdint.h>
+
+#include "Timestamp.h"
+
+/**
+ * 令牌桶：以rate个/秒的速度补充令牌，最多积攒burst个，用于限制速率同时允许一定的突发
+ * 不是线程安全的，由使用者保证只在一个线程中使用或自行加锁
+ **/
+class TokenBucket
+{
+public:
+    // rate小于等于0表示不限速
+    TokenBucket(double rate = 0.0, double burst = 0.0)
+        : rate_(rate)
+        , burst_(std::max(burst, 1.0))
+        , tokens_(burst_)
+        , lastRefill_(Timestamp::now().microSecondsSinceEpoch())
+    {
+    }
+
+    void reset(double rate, double burst)
+    {
+        rate_ = rate;
+        burst_ = std::max(burst, 1.0);
+        tokens_ = burst_;
+        lastRefill_ = Timestamp::now().microSecondsSinceEpoch();
+    }
+
+    bool unlimited() const { return rate_ <= 0; }
+    double rate() const { return rate_; }
+    double burst() const { return burst_; }
+
+    // 令牌足够时扣除n个并返回true
+    bool tryConsume(double n = 1.0, int64_t nowMicroSeconds = Timestamp::now().microSecondsSinceEpoch())
+    {
+        if(unlimited())
+        {
+            return true;
+        }
+        refill(nowMicroSeconds);
+        if(tokens_ < n)
+        {
+            return false;
+        }
+        tokens_ -= n;
+        return true;
+    }
+
+    // 不论够不够都扣除n个，令牌可以为负，之后要先还清欠账；用于必须放行但要计入速率的情况
+    void consume(double n, int64_t nowMicroSeconds = Timestamp::now().microSecondsSinceEpoch())
+    {
+        if(!unlimited())
+        {
+            refill(nowMicroSeconds);
+            tokens_ -= n;
+        }
+    }
+
+    // 当前可用的令牌数，有欠账时为负，不限速时为无穷大
+    double available(int64_t nowMicroSeconds = Timestamp::now().microSecondsSinceEpoch())
+    {
+        if(unlimited())
+        {
+            return std::numeric_limits<double>::infinity();
+        }
+        refill(nowMicroSeconds);
+        return tokens_;
+    }
+
+    // 攒够n个令牌还需要等待的秒数，已经足够时为0
+    double secondsUntil(double n = 1.0, int64_t nowMicroSeconds = Timestamp::now().microSecondsSinceEpoch())
+    {
+        if(unlimited())
+        {
+            return 0.0;
+        }
+        refill(nowMicroSeconds);
+        return tokens_ >= n ? 0.0 : (n - tokens_) / rate_;
+    }
+
+private:
+    void refill(int64_t nowMicroSeconds)
+    {
+        if(nowMicroSeconds > lastRefill_)
+        {
+            tokens_ = std::min(burst_, tokens_ + rate_ * (nowMicroSeconds - lastRefill_) / Timestamp::kMicroSecondsPerSecond);
+            lastRefill_ = nowMicroSeconds;
+        }
+    }
+
+    double rate_;
+    double burst_;
+    double tokens_;
+    int64_t lastRefill_;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "noncopyable.h"
+#include "Channel.h"
+#include "InetAddress.h"
+#include "Timestamp.h"
+
+class EventLoop;
+class UdpEndpoint;
+
+// 收到一个数据报(开启GRO时为拆分后的一个分段)，data只在回调期间有效
+using DatagramCallback = std::function<void(UdpEndpoint *endpoint, const InetAddress &peer,
+                                            const char *data, size_t len, Timestamp receiveTime)>;
+
+/**
+ * 一个loop上的一个UDP socket，由UdpServer创建，只在所属loop线程中使用
+ * 可读时用recvmmsg一次读入一批数据报，收取用的mmsghdr/iovec/缓冲区在第一次启动时按批大小分配好，之后反复使用
+ * 回调中调用send的回复先攒在发送批次里，本批数据报处理完后用一次sendmmsg发出；
+ * 开启GSO时，发往同一对端、长度相同的连续回复合并成一个带UDP_SEGMENT的大报文，由内核(或网卡)再切分
+ **/
+class UdpEndpoint : noncopyable
+{
+public:
+    struct Options
+    {
+        int batchSize = 64;             // 每次recvmmsg/sendmmsg最多处理的报文数
+        size_t maxDatagramSize = 2048;  // 单个数据报的接收缓冲区大小，开启GRO时固定为64KB
+        bool gro = false;
+        bool gso = false;
+    };
+
+    UdpEndpoint(EventLoop *loop, int sockfd, const Options &options, const DatagramCallback &cb);
+    ~UdpEndpoint();
+
+    // 在loop线程中开始接收
+    void start();
+
+    // 只能在所属loop线程中调用；在接收回调之外调用时立即发出
+    void send(const InetAddress &peer, const void *data, size_t len);
+    // 发出发送批次中积累的回复
+    void flush();
+
+    EventLoop *getLoop() const { return loop_; }
+    int fd() const { return sockfd_; }
+
+    // 统计计数，可在其他线程读取
+    uint64_t receivedDatagrams() const { return receivedDatagrams_.load(std::memory_order_relaxed); }
+    uint64_t receiveCalls() const { return receiveCalls_.load(std::memory_order_relaxed); }
+    uint64_t sentDatagrams() const { return sentDatagrams_.load(std::memory_order_relaxed); }
+    uint64_t sendCalls() const { return sendCalls_.load(std::memory_order_relaxed); }
+    // 发送缓冲区满等原因丢弃的回复，以及因超过maxDatagramSize被截断丢弃的数据报
+    uint64_t droppedSends() const { return droppedSends_.load(std::memory_order_relaxed); }
+    uint64_t truncatedDatagrams() const { return truncatedDatagrams_.load(std::memory_order_relaxed); }
+
+private:
+    struct Outgoing
+    {
+        InetAddress peer;
+        size_t offset;  // 在outData_中的位置
+        size_t len;
+    };
+    static const int kMaxReceiveRounds = 4;    // 一次可读事件最多调用recvmmsg的次数，剩下的等下一轮(LT模式会再次通知)
+
+    void handleRead(Timestamp receiveTime);
+    void deliver(const mmsghdr &msg, const sockaddr_storage &addr, const char *data, Timestamp receiveTime);
+    // 从out_[begin]开始把可以合并的回复组成第msgIndex个报文，返回该报文包含的回复数
+    size_t buildMessage(size_t begin, size_t msgIndex);
+    void sendBatch(size_t count);
+
+    EventLoop *loop_;
+    const int sockfd_;
+    Options options_;
+    Channel channel_;
+    DatagramCallback datagramCallback_;
+    bool inReceiveBatch_;
+
+    // 接收批次，start()时分配
+    size_t bufferSize_;
+    std::vector<char> recvBuffer_;
+    std::vector<mmsghdr> recvMsgs_;
+    std::vector<iovec> recvIovecs_;
+    std::vector<sockaddr_storage> recvAddrs_;
+    std::vector<char> recvControl_;
+
+    // 发送批次
+    std::vector<Outgoing> out_;
+    std::vector<char> outData_;
+    std::vector<mmsghdr> sendMsgs_;
+    std::vector<iovec> sendIovecs_;
+    std::vector<char> sendControl_;
+    std::vector<size_t> sendMsgDatagrams_;  // 每个待发报文包含的回复数
+
+    std::atomic<uint64_t> receivedDatagrams_;
+    std::atomic<uint64_t> receiveCalls_;
+    std::atomic<uint64_t> sentDatagrams_;
+    std::atomic<uint64_t> sendCalls_;
+    std::atomic<uint64_t> droppedSends_;
+    std::atomic<uint64_t> truncatedDatagrams_;
+};
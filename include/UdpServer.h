@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "noncopyable.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "InetAddress.h"
+#include "UdpEndpoint.h"
+
+/**
+ * UDP服务器，没有连接的概念，收到的每个数据报直接交给DatagramCallback，回复用UdpEndpoint::send发回对端
+ * kSingleSocket：只有一个socket，由main loop收发，线程池不处理数据报
+ * kReusePortPerLoop：线程池中每个loop各自持有一个SO_REUSEPORT的socket，内核按四元组哈希把数据报分给这些socket
+ **/
+class UdpServer : noncopyable
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop *)>;
+
+    enum Option
+    {
+        kSingleSocket,
+        kReusePortPerLoop
+    };
+
+    UdpServer(EventLoop *loop,
+              const InetAddress &listenAddr,
+              const std::string &nameArg,
+              Option option = kSingleSocket);
+    ~UdpServer();
+
+    // 以下设置应在start()之前调用
+    void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+    void setDatagramCallback(const DatagramCallback &cb) { datagramCallback_ = cb; }
+    void setThreadNum(int numThreads) { threadPool_->setThreadNum(numThreads); }
+    void setCpuAffinity(const std::vector<int> &cpus) { threadPool_->setCpuAffinity(cpus); }
+    // 每次recvmmsg/sendmmsg最多处理的报文数
+    void setBatchSize(int batchSize) { options_.batchSize = batchSize; }
+    // 超过该大小的数据报被截断丢弃
+    void setMaxDatagramSize(size_t size) { options_.maxDatagramSize = size; }
+    // 接收时让内核把同一流的数据报合并(UDP_GRO)，回调时仍按原报文逐个交付
+    void enableGro(bool on) { options_.gro = on; }
+    // 发往同一对端、长度相同的连续回复合并成一个UDP_SEGMENT报文发送
+    void enableGso(bool on) { options_.gso = on; }
+    // 设置SO_RCVBUF(字节)，小于等于0时使用系统默认值
+    void setReceiveBufferSize(int bytes) { receiveBufferSize_ = bytes; }
+
+    void start();
+
+    const std::string &name() const { return name_; }
+    const InetAddress &listenAddress() const { return listenAddr_; }
+
+    // 所有socket的统计之和，可在任意线程读取
+    uint64_t receivedDatagrams() const;
+    uint64_t receiveCalls() const;
+    uint64_t sentDatagrams() const;
+    uint64_t sendCalls() const;
+    uint64_t droppedSends() const;
+    uint64_t truncatedDatagrams() const;
+
+private:
+    int createSocket(bool reuseport, int cpu) const;
+    uint64_t sum(uint64_t (UdpEndpoint::*counter)() const) const;
+
+    EventLoop *loop_;   // main loop(baseloop)
+    const InetAddress listenAddr_;
+    const std::string name_;
+    const Option option_;
+    std::shared_ptr<EventLoopThreadPool> threadPool_;
+    ThreadInitCallback threadInitCallback_;
+    DatagramCallback datagramCallback_;
+    UdpEndpoint::Options options_;
+    int receiveBufferSize_;
+    std::atomic_int started_;
+    // 每个socket只能在所属的loop线程中析构；start()中建好后不再改变
+    std::vector<std::unique_ptr<UdpEndpoint>> endpoints_;
+};
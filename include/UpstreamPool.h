@@ -0,0 +1,148 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "InetAddress.h"
+#include "TcpClient.h"
+#include "TimerId.h"
+#include "Timestamp.h"
+
+class Buffer;
+class EventLoop;
+
+/**
+ * 到同一个上游服务器的长连接池，每个EventLoop一个(通常在ThreadInitCallback中创建)，只在所属loop线程中使用，不需要加锁
+ * 两种用法：
+ *   checkout/checkin：独占一条连接，期间可以替换它的消息回调，checkin时恢复
+ *   call：把请求流水线地发到当前在途请求最少的连接上，用ResponseParser从响应流中切出完整响应，
+ *         按发送顺序(或按请求id)匹配回调；连接断开、超过callTimeout仍未收到响应时，回调以ok=false结束
+ * 连接数不超过maxConnections，空闲超过maxIdleSeconds的连接由定时器关闭；定时器同时对空闲连接执行健康检查，
+ * 并让等待超时的checkout以空指针、超时的call以ok=false结束
+ * 新建连接连续失败maxConnectAttempts次后放弃；此时池中已没有可用或正在建立的连接，排队的call和checkout立即失败
+ **/
+class UpstreamPool : noncopyable
+{
+public:
+    using CheckoutCallback = std::function<void(const TcpConnectionPtr &)>;    // 超时或池已停止时为空指针
+    using ResponseCallback = std::function<void(bool ok, const std::string &response)>;
+    // 从buf中切出一个完整响应放入response并返回true，数据不完整时返回false；按id匹配时同时填写requestId
+    using ResponseParser = std::function<bool(Buffer *buf, uint64_t *requestId, std::string *response)>;
+    // 对空闲连接的健康检查，返回false时关闭该连接
+    using HealthCheck = std::function<bool(const TcpConnectionPtr &)>;
+
+    UpstreamPool(EventLoop *loop, const InetAddress &serverAddr, const std::string &name);
+    ~UpstreamPool();
+
+    // 以下设置应在start()之前调用
+    void setMaxConnections(size_t n) { maxConnections_ = n; }
+    void setMaxIdleSeconds(double seconds) { maxIdleSeconds_ = seconds; }
+    void setCheckoutTimeout(double seconds) { checkoutTimeout_ = seconds; }
+    void setConnectTimeout(double seconds) { connectTimeout_ = seconds; }
+    // 新建一条连接时最多尝试几次，默认1次：连接失败时池不等Connector退避重试，由之后的请求触发新的连接
+    void setMaxConnectAttempts(int attempts) { maxConnectAttempts_ = attempts; }
+    // 一次call从提交到收到响应的最长时间，包括排队等连接的时间，小于等于0表示不限制
+    void setCallTimeout(double seconds) { callTimeout_ = seconds; }
+    // 每条连接最多的在途请求数
+    void setMaxPipelineDepth(size_t depth) { maxPipelineDepth_ = depth; }
+    void setResponseParser(const ResponseParser &parser, bool matchById = false) { parser_ = parser; matchById_ = matchById; }
+    void setHealthCheck(const HealthCheck &check) { healthCheck_ = check; }
+
+    // 开启空闲回收、健康检查和超时检查的定时器，sweepInterval为检查间隔(秒)
+    // 没有调用start()时，第一次checkout/call会以默认间隔开启定时器，保证超时总能生效
+    void start(double sweepInterval = kDefaultSweepInterval);
+
+    void checkout(const CheckoutCallback &cb);
+    // 可在该连接的回调中调用，归还在本轮事件处理完之后生效
+    void checkin(const TcpConnectionPtr &conn);
+
+    // 发送一个请求，requestId只在按id匹配时使用
+    void call(const std::string &request, const ResponseCallback &cb, uint64_t requestId = 0);
+
+    size_t totalConnections() const { return connections_.size(); }
+    size_t idleConnections() const;
+    // 累计发起的连接数，复用效果的直接体现
+    uint64_t connectsStarted() const { return connectsStarted_; }
+
+private:
+    static constexpr double kDefaultSweepInterval = 0.1;
+
+    // 在途请求，超时后回调置空：响应仍在路上，到达时直接丢弃，不影响后面的请求按顺序匹配
+    struct InflightCall
+    {
+        ResponseCallback cb;
+        Timestamp deadline;
+    };
+    struct PooledConnection
+    {
+        std::unique_ptr<TcpClient> client;
+        TcpConnectionPtr conn;          // 建立前为空
+        bool checkedOut = false;
+        Timestamp lastUsed;
+        std::deque<InflightCall> inflight;                        // 按发送顺序匹配
+        std::unordered_map<uint64_t, InflightCall> inflightById;  // 按请求id匹配
+
+        size_t inflightCount() const { return inflight.size() + inflightById.size(); }
+        bool idle() const { return conn && conn->connected() && !checkedOut && inflightCount() == 0; }
+    };
+    struct Waiter
+    {
+        CheckoutCallback cb;
+        Timestamp deadline;
+    };
+    struct PendingCall
+    {
+        std::string request;
+        ResponseCallback cb;
+        uint64_t requestId;
+        Timestamp deadline;
+    };
+
+    void checkInLoop() const;
+    PooledConnection *openConnection();
+    void onConnection(PooledConnection *pc, const TcpConnectionPtr &conn);
+    void onConnectFailed(PooledConnection *pc);
+    void onMessage(PooledConnection *pc, const TcpConnectionPtr &conn, Buffer *buf);
+    void checkinInLoop(const TcpConnectionPtr &conn);
+    // 移出连接列表，对象在本轮事件处理完之后销毁；不存在时返回空
+    std::shared_ptr<PooledConnection> detachConnection(PooledConnection *pc);
+    // 移出连接，其在途请求以ok=false结束
+    void removeConnection(PooledConnection *pc);
+    PooledConnection *findConnection(const TcpConnectionPtr &conn);
+    // 把空闲连接交给等待的checkout，把排队的请求发到有余量的连接
+    void dispatch();
+    PooledConnection *pickForCall();
+    void sendCall(PooledConnection *pc, PendingCall &call);
+    void startSweeping(double sweepInterval);
+    void sweep();
+
+    EventLoop *loop_;
+    const InetAddress serverAddr_;
+    const std::string name_;
+    size_t maxConnections_;
+    double maxIdleSeconds_;
+    double checkoutTimeout_;
+    double connectTimeout_;
+    int maxConnectAttempts_;
+    double callTimeout_;
+    size_t maxPipelineDepth_;
+    ResponseParser parser_;
+    bool matchById_;
+    HealthCheck healthCheck_;
+
+    std::vector<std::unique_ptr<PooledConnection>> connections_;
+    std::deque<Waiter> waiters_;
+    std::deque<PendingCall> pendingCalls_;
+    size_t connecting_;             // 还未建立的连接数
+    uint64_t connectsStarted_;
+    bool sweeping_;
+    TimerId sweepTimer_;
+    std::shared_ptr<bool> alive_;   // 推迟执行的归还用它判断池是否还在
+};
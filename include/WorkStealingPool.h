@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "Thread.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "WorkStealingDeque.h"
+
+/**
+ * 工作窃取线程池，用来承接会阻塞IO线程的CPU密集型处理(JSON解析、压缩等)
+ * 每个工作线程有一个Chase-Lev双端队列：工作线程内提交的任务放进自己的队列，IO线程等外部线程提交的任务放进共享的提交队列，
+ * 空闲的工作线程依次从自己的队列、提交队列和其他工作线程的队列顶部取任务
+ *
+ * 带orderingKey提交的任务，同一key按提交顺序串行执行(不同key之间并行)；runAndPost把结果用queueInLoop送回loop，
+ * 因此同一连接的结果回调也按请求顺序在连接所属的loop线程中执行
+ **/
+class WorkStealingPool : noncopyable
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(const std::string &name = std::string("WorkStealingPool"));
+    ~WorkStealingPool();
+
+    // 设置工作线程数，应在start()之前调用，默认为CPU核数
+    void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+    void start();
+    // 等待已提交的任务全部执行完后退出工作线程
+    void stop();
+
+    void run(Task task);
+    // 同一orderingKey的任务按提交顺序串行执行
+    void run(uint64_t orderingKey, Task task);
+
+    // 在工作线程中执行work()，再把结果交给loop线程执行done(result)；work必须有返回值
+    template <typename Work, typename Done>
+    void runAndPost(EventLoop *loop, uint64_t orderingKey, Work work, Done done)
+    {
+        using Result = typename std::result_of<Work()>::type;
+        run(orderingKey, [loop, work, done]() mutable {
+            std::shared_ptr<Result> result(new Result(work()));
+            loop->queueInLoop([done, result]() mutable { done(*result); });
+        });
+    }
+
+    // 以连接为顺序单位，结果送回连接当前所属的loop；任务持有连接，直到结果回调执行完
+    template <typename Work, typename Done>
+    void runAndPost(const TcpConnectionPtr &conn, Work work, Done done)
+    {
+        using Result = typename std::result_of<Work()>::type;
+        uint64_t key = conn->id() != 0 ? conn->id() : reinterpret_cast<uintptr_t>(conn.get());
+        run(key, [conn, work, done]() mutable {
+            std::shared_ptr<Result> result(new Result(work()));
+            conn->getLoop()->queueInLoop([conn, done, result]() mutable { done(*result); });
+        });
+    }
+
+    const std::string &name() const { return name_; }
+    // 已提交还未开始执行的任务数
+    int64_t pendingTasks() const { return pending_.load(std::memory_order_relaxed); }
+    // 从其他工作线程的队列中窃取到的任务数
+    uint64_t stolenTasks() const { return stolen_.load(std::memory_order_relaxed); }
+
+private:
+    static const int kStrandStripes = 64;
+
+    struct Worker
+    {
+        WorkStealingDeque<Task> deque;
+        std::unique_ptr<Thread> thread;
+        uint32_t seed;      // 选择窃取对象的随机数种子
+    };
+
+    // 按key串行执行的任务链，key在map中表示该key已有任务在执行，deque中是排队等待的后续任务
+    struct StrandStripe
+    {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, std::deque<Task>> strands;
+    };
+
+    void workerFunc(int index);
+    Task *takeTask(int index);
+    void push(Task *task);
+    // 一个key的任务执行完后提交它的下一个任务
+    void runNextInStrand(uint64_t orderingKey);
+
+    const std::string name_;
+    int numThreads_;
+    std::atomic_bool running_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    std::mutex injectMutex_;
+    std::deque<Task *> injectQueue_;    // 非工作线程提交的任务
+
+    std::atomic<int64_t> pending_;      // 已提交未取走的任务数，空闲线程据此决定是否睡眠
+    std::atomic_int sleepers_;
+    std::mutex sleepMutex_;
+    std::condition_variable sleepCond_;
+
+    std::atomic<uint64_t> stolen_;
+    StrandStripe strandStripes_[kStrandStripes];
+};
@@ -1,16 +1,17 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include "Acceptor.h"
 #include "Logger.h"
 #include "InetAddress.h"
 
-// 创建一个非阻塞的sockfd
-static int createNonblocking()
+// 创建一个与监听地址同协议族的非阻塞sockfd
+static int createNonblocking(sa_family_t family)
 {
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, family == AF_UNIX ? 0 : IPPROTO_TCP);
     if (sockfd < 0)
     {
         LOG_FATAL("%s:%s:%d listen socket create err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
@@ -19,21 +20,56 @@ static int createNonblocking()
 }
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
+    : Acceptor(loop, createNonblocking(listenAddr.family()))
+{
+    if (listenAddr.isUnix())
+    {
+        if (!listenAddr.isAbstract())
+        {
+            // 上次运行残留的socket文件会让bind失败；抽象命名空间的地址随socket关闭自动消失
+            unixPath_ = listenAddr.toIp();
+            Socket::removeUnixSocketFile(unixPath_.c_str());
+        }
+    }
+    else
+    {
+        acceptSocket_.setReuseAddr(reuseport);
+        acceptSocket_.setReusePort(reuseport);
+    }
+    acceptSocket_.bindAddress(listenAddr);
+}
+
+Acceptor::Acceptor(EventLoop *loop, int listenFd)
     : loop_(loop)
-    , acceptSocket_(createNonblocking())
+    , acceptSocket_(listenFd)
     , acceptChannel_(loop, acceptSocket_.fd())
     , listening_(false)
+    , paused_(false)
+    , idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
+    , maxAcceptsPerEvent_(kDefaultMaxAcceptsPerEvent)
+    , accepted_(0)
+    , acceptEvents_(0)
+    , droppedForFdLimit_(0)
+    , acceptErrors_(0)
 {
-    acceptSocket_.setReuseAddr(reuseport);
-    acceptSocket_.setReusePort(reuseport);
-    acceptSocket_.bindAddress(listenAddr);
     acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
 }
 
 Acceptor::~Acceptor()
 {
-    acceptChannel_.disableAll();
-    acceptChannel_.remove();
+    if (acceptSocket_.fd() >= 0)
+    {
+        acceptChannel_.disableAll();
+        acceptChannel_.remove();
+    }
+    if (idleFd_ >= 0)
+    {
+        ::close(idleFd_);
+    }
+    if (!unixPath_.empty())
+    {
+        Socket::removeUnixSocketFile(unixPath_.c_str());
+    }
 }
 
 void Acceptor::listen()
@@ -43,27 +79,108 @@ void Acceptor::listen()
     acceptChannel_.enableReading();
 }
 
+void Acceptor::stopListening()
+{
+    listening_ = false;
+    paused_ = false;
+    acceptChannel_.disableAll();
+}
+
+void Acceptor::closeListening()
+{
+    if (acceptSocket_.fd() < 0)
+    {
+        return;
+    }
+    stopListening();
+    // 先从poller中注销，再关闭fd，避免fd号被复用后注销到别的socket上
+    acceptChannel_.remove();
+    acceptSocket_.close();
+    if (!unixPath_.empty())
+    {
+        Socket::removeUnixSocketFile(unixPath_.c_str());
+        unixPath_.clear();
+    }
+}
+
+void Acceptor::resume()
+{
+    if (paused_ && listening_)
+    {
+        paused_ = false;
+        acceptChannel_.enableReading();
+    }
+}
+
+// LT模式下一次可读事件可能对应多个已完成握手的连接，循环accept直到EAGAIN或达到上限
 void Acceptor::handleRead()
 {
-    InetAddress peerAddr;
-    int connfd = acceptSocket_.accept(&peerAddr);
-    if(connfd >= 0)
+    acceptEvents_.fetch_add(1, std::memory_order_relaxed);
+    for (int i = 0; i < maxAcceptsPerEvent_; ++i)
     {
-        if(NewConnectionCallback_)
+        // 新连接回调中可能停止了监听(如开始优雅退出)
+        if (!listening_)
         {
-            NewConnectionCallback_(connfd, peerAddr);
+            break;
         }
-        else
+        if (acceptGate_ && !acceptGate_())
         {
-            ::close(connfd);
+            paused_ = true;
+            acceptChannel_.disableReading();
+            break;
+        }
+        InetAddress peerAddr;
+        int connfd = acceptSocket_.accept(&peerAddr);
+        if (connfd >= 0)
+        {
+            accepted_.fetch_add(1, std::memory_order_relaxed);
+            if (NewConnectionCallback_)
+            {
+                NewConnectionCallback_(connfd, peerAddr);
+            }
+            else
+            {
+                ::close(connfd);
+            }
+            continue;
+        }
+
+        int savedErrno = errno;
+        if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+        {
+            break;
+        }
+        if (savedErrno == EMFILE || savedErrno == ENFILE)
+        {
+            LOG_ERROR("%s:%s:%d sockfd reached limit\n", __FILE__, __FUNCTION__, __LINE__);
+            dropConnectionWithIdleFd();
+            if (idleFd_ < 0)
+            {
+                break; // 预留fd也拿不回来了，等下一次可读事件再试
+            }
+            continue;
+        }
+        acceptErrors_.fetch_add(1, std::memory_order_relaxed);
+        LOG_ERROR("%s:%s:%d accept err:%d\n", __FILE__, __FUNCTION__, __LINE__, savedErrno);
+        // 对端在accept前就断开之类的错误只影响这一个连接，继续接受下一个
+        if (savedErrno != ECONNABORTED && savedErrno != EINTR && savedErrno != EPROTO && savedErrno != EPERM)
+        {
+            break;
         }
     }
-    else
+}
+
+void Acceptor::dropConnectionWithIdleFd()
+{
+    if (idleFd_ >= 0)
     {
-        LOG_ERROR("%s:%s:%d accept err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
-        if (errno == EMFILE)
+        ::close(idleFd_);
+        int connfd = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+        if (connfd >= 0)
         {
-            LOG_ERROR("%s:%s:%d sockfd reached limit\n", __FILE__, __FUNCTION__, __LINE__);
+            ::close(connfd);
+            droppedForFdLimit_.fetch_add(1, std::memory_order_relaxed);
         }
     }
-}
\ No newline at end of file
+    idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
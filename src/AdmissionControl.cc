@@ -0,0 +1,108 @@
+#include "AdmissionControl.h"
+
+AdmissionControl::AdmissionControl(const Limits &limits)
+    : limits_(limits)
+    , acceptBucket_(limits.acceptRate, limits.acceptBurst)
+{
+    for(std::atomic<uint64_t> &count : rejected_)
+    {
+        count = 0;
+    }
+}
+
+AdmissionControl::Verdict AdmissionControl::admit(size_t connections, size_t loopConnections, size_t outputBufferBytes,
+                                                   bool consumeToken)
+{
+    if(limits_.maxConnections > 0 && connections >= limits_.maxConnections)
+    {
+        return kOverConnections;
+    }
+    if(limits_.maxConnectionsPerLoop > 0 && loopConnections >= limits_.maxConnectionsPerLoop)
+    {
+        return kOverLoopConnections;
+    }
+    if(limits_.maxOutputBufferBytes > 0 && outputBufferBytes >= limits_.maxOutputBufferBytes)
+    {
+        return kOverMemory;
+    }
+    // 令牌放在最后扣，被其他条件拒绝的连接不占用速率
+    if(!acceptBucket_.unlimited())
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(consumeToken ? !acceptBucket_.tryConsume() : acceptBucket_.secondsUntil() > 0)
+        {
+            return kOverAcceptRate;
+        }
+    }
+    return kAdmit;
+}
+
+AdmissionControl::Verdict AdmissionControl::admitPeer(const InetAddress &peer)
+{
+    if(limits_.maxConnectionsPerIp == 0)
+    {
+        return kAdmit;
+    }
+    std::string key = peerKey(peer);
+    if(key.empty())
+    {
+        return kAdmit;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t &count = peers_[key];
+    if(count >= limits_.maxConnectionsPerIp)
+    {
+        return kOverPeerConnections;
+    }
+    ++count;
+    return kAdmit;
+}
+
+void AdmissionControl::release(const InetAddress &peer)
+{
+    if(limits_.maxConnectionsPerIp == 0)
+    {
+        return;
+    }
+    std::string key = peerKey(peer);
+    if(key.empty())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = peers_.find(key);
+    if(it != peers_.end() && --it->second == 0)
+    {
+        peers_.erase(it);
+    }
+}
+
+const char *AdmissionControl::verdictName(Verdict verdict)
+{
+    switch(verdict)
+    {
+        case kAdmit: return "admit";
+        case kOverConnections: return "connections";
+        case kOverLoopConnections: return "loop connections";
+        case kOverPeerConnections: return "peer connections";
+        case kOverAcceptRate: return "accept rate";
+        case kOverMemory: return "output buffers";
+        default: return "unknown";
+    }
+}
+
+std::string AdmissionControl::peerKey(const InetAddress &peer)
+{
+    const sockaddr *addr = peer.getSockAddr();
+    if(peer.family() == AF_INET)
+    {
+        const in_addr &ip = reinterpret_cast<const sockaddr_in *>(addr)->sin_addr;
+        return std::string(reinterpret_cast<const char *>(&ip), sizeof(ip));
+    }
+    if(peer.family() == AF_INET6)
+    {
+        const in6_addr &ip = reinterpret_cast<const sockaddr_in6 *>(addr)->sin6_addr;
+        return std::string(reinterpret_cast<const char *>(&ip), sizeof(ip));
+    }
+    return std::string();
+}
@@ -0,0 +1,197 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "AsyncLogging.h"
+
+AsyncLogging::AsyncLogging(const std::string &basename,
+                           off_t rollSize,
+                           int flushInterval,
+                           size_t maxQueuedBuffers,
+                           OverflowPolicy policy)
+    : flushInterval_(flushInterval)
+    , maxQueuedBuffers_(maxQueuedBuffers)
+    , policy_(policy)
+    , running_(false)
+    , thread_(std::bind(&AsyncLogging::threadFunc, this), "AsyncLogging")
+    , currentBuffer_(new LogBuffer)
+    , nextBuffer_(new LogBuffer)
+    , dropped_(0)
+    , output_(basename, rollSize, false, flushInterval * 1000)
+    , totalDropped_(0)
+{
+    buffers_.reserve(maxQueuedBuffers_);
+}
+
+AsyncLogging::~AsyncLogging()
+{
+    if (running_)
+    {
+        stop();
+    }
+}
+
+void AsyncLogging::start()
+{
+    running_ = true;
+    thread_.start();
+}
+
+void AsyncLogging::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_one();
+    notFull_.notify_all();
+    if (thread_.started())
+    {
+        thread_.join();
+    }
+}
+
+void AsyncLogging::append(const char *logline, size_t len)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (currentBuffer_->avail() > len)
+    {
+        currentBuffer_->append(logline, len);
+        return;
+    }
+
+    // 一整块空缓冲区都放不下的日志行直接丢弃计数，否则换上新缓冲区后memcpy会越界
+    if (len >= LogBuffer::kSize)
+    {
+        ++dropped_;
+        totalDropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // 当前缓冲区写满了，且排队的缓冲区已达上限，说明磁盘写入跟不上
+    if (buffers_.size() >= maxQueuedBuffers_)
+    {
+        if (policy_ == kBlock)
+        {
+            notFull_.wait(lock, [this]() { return buffers_.size() < maxQueuedBuffers_ || !running_; });
+        }
+        if (buffers_.size() >= maxQueuedBuffers_)
+        {
+            ++dropped_;
+            totalDropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // 等待期间后台线程可能已经换走了当前缓冲区
+        if (currentBuffer_->avail() > len)
+        {
+            currentBuffer_->append(logline, len);
+            return;
+        }
+    }
+
+    buffers_.push_back(std::move(currentBuffer_));
+    if (nextBuffer_)
+    {
+        currentBuffer_ = std::move(nextBuffer_);
+    }
+    else
+    {
+        currentBuffer_.reset(new LogBuffer); // 很少发生，前端写得太快，两块缓冲区都用完了
+    }
+    currentBuffer_->append(logline, len);
+    cond_.notify_one();
+}
+
+void AsyncLogging::flush()
+{
+    std::lock_guard<std::mutex> fileLock(fileMutex_);
+    BufferVector buffersToWrite;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (currentBuffer_->length() > 0)
+        {
+            buffers_.push_back(std::move(currentBuffer_));
+            currentBuffer_.reset(new LogBuffer);
+        }
+        buffersToWrite.swap(buffers_);
+    }
+    notFull_.notify_all();
+    writeBuffers(buffersToWrite);
+}
+
+void AsyncLogging::writeBuffers(const BufferVector &buffers)
+{
+    for (const BufferPtr &buffer : buffers)
+    {
+        output_.append(buffer->data(), buffer->length());
+    }
+    output_.flush();
+}
+
+void AsyncLogging::threadFunc()
+{
+    // 后台线程自己准备两块缓冲区，与前端交换，避免在临界区内分配内存
+    BufferPtr newBuffer1(new LogBuffer);
+    BufferPtr newBuffer2(new LogBuffer);
+    BufferVector buffersToWrite;
+    buffersToWrite.reserve(maxQueuedBuffers_ + 1);
+
+    while (running_)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (buffers_.empty() && running_)
+            {
+                cond_.wait_for(lock, std::chrono::seconds(flushInterval_));
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> fileLock(fileMutex_);
+            size_t dropped = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                buffers_.push_back(std::move(currentBuffer_));
+                currentBuffer_ = std::move(newBuffer1);
+                buffersToWrite.swap(buffers_);
+                if (!nextBuffer_)
+                {
+                    nextBuffer_ = std::move(newBuffer2);
+                }
+                dropped = dropped_;
+                dropped_ = 0;
+            }
+            notFull_.notify_all();
+
+            if (dropped > 0)
+            {
+                char buf[64];
+                int n = snprintf(buf, sizeof(buf), "Dropped %zu log lines, buffers full or line too long\n", dropped);
+                output_.append(buf, n);
+            }
+            writeBuffers(buffersToWrite);
+        }
+
+        // 回收两块缓冲区供下一轮交换，其余的释放掉
+        if (!newBuffer1)
+        {
+            newBuffer1 = std::move(buffersToWrite.back());
+            buffersToWrite.pop_back();
+            newBuffer1->reset();
+        }
+        if (!newBuffer2)
+        {
+            if (buffersToWrite.empty())
+            {
+                newBuffer2.reset(new LogBuffer);
+            }
+            else
+            {
+                newBuffer2 = std::move(buffersToWrite.back());
+                buffersToWrite.pop_back();
+                newBuffer2->reset();
+            }
+        }
+        buffersToWrite.clear();
+    }
+    flush();
+}
@@ -0,0 +1,479 @@
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <ctype.h>
+
+#include "BinaryLogging.h"
+
+namespace
+{
+const char kFileMagic[8] = {'M', 'U', 'D', 'U', 'O', 'B', 'L', '1'};
+
+struct FormatInfo
+{
+    int level;
+    int line;
+    std::string file;
+    std::string format;
+};
+
+// 所有线程共享的格式字典和环形缓冲区列表
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<FormatInfo> formats;                    // 下标即格式id
+    std::vector<BinaryLog::StagingBuffer *> buffers;    // 尚未被后台线程接管的新缓冲区
+    size_t threadBufferSize = 1024 * 1024;
+    std::atomic<size_t> dropped{0};
+};
+
+Registry &registry()
+{
+    static Registry *r = new Registry; // 不析构，线程退出和静态析构的先后顺序无法保证
+    return *r;
+}
+
+// 线程退出时把环形缓冲区交给后台线程释放
+struct StagingBufferRetirer
+{
+    ~StagingBufferRetirer()
+    {
+        if (BinaryLog::t_stagingBuffer)
+        {
+            BinaryLog::t_stagingBuffer->retired().store(true, std::memory_order_release);
+            BinaryLog::t_stagingBuffer = nullptr;
+        }
+    }
+};
+thread_local StagingBufferRetirer t_retirer;
+} // namespace
+
+namespace BinaryLog
+{
+__thread StagingBuffer *t_stagingBuffer = nullptr;
+
+StagingBuffer *createStagingBuffer()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    t_stagingBuffer = new StagingBuffer(r.threadBufferSize);
+    r.buffers.push_back(t_stagingBuffer);
+    (void)&t_retirer; // 使用thread_local对象，保证线程退出时调用其析构函数
+    return t_stagingBuffer;
+}
+
+void recordDropped()
+{
+    registry().dropped.fetch_add(1, std::memory_order_relaxed);
+}
+} // namespace BinaryLog
+
+using namespace BinaryLog;
+
+BinaryLogging::BinaryLogging(const std::string &basename,
+                             off_t rollSize,
+                             int pollIntervalMs)
+    : pollIntervalMs_(pollIntervalMs)
+    , running_(false)
+    , thread_(std::bind(&BinaryLogging::threadFunc, this), "BinaryLogging")
+    , output_(basename, rollSize, false)
+{
+}
+
+BinaryLogging::~BinaryLogging()
+{
+    if (running_)
+    {
+        stop();
+    }
+}
+
+void BinaryLogging::start()
+{
+    running_ = true;
+    thread_.start();
+}
+
+void BinaryLogging::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_one();
+    if (thread_.started())
+    {
+        thread_.join();
+    }
+}
+
+uint32_t BinaryLogging::registerFormat(int level, const char *file, int line, const char *format)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.formats.push_back(FormatInfo{level, line, file, format});
+    return static_cast<uint32_t>(r.formats.size() - 1);
+}
+
+void BinaryLogging::setThreadBufferSize(size_t size)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.threadBufferSize = size;
+}
+
+size_t BinaryLogging::droppedRecords()
+{
+    return registry().dropped.load(std::memory_order_relaxed);
+}
+
+void BinaryLogging::threadFunc()
+{
+    while (running_)
+    {
+        if (drain() == 0)
+        {
+            // 空闲时把LogFile缓冲区中的数据落盘，再等下一轮；生产者从不通知，避免写日志时的系统调用
+            output_.flush();
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (running_)
+            {
+                cond_.wait_for(lock, std::chrono::milliseconds(pollIntervalMs_));
+            }
+        }
+    }
+    drain();
+    output_.flush();
+}
+
+size_t BinaryLogging::drain()
+{
+    Registry &r = registry();
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        buffers_.insert(buffers_.end(), r.buffers.begin(), r.buffers.end());
+        r.buffers.clear();
+    }
+
+    // 先取各缓冲区的发布位置，再写字典：这些记录用到的格式一定已经注册
+    std::vector<size_t> producerPositions;
+    std::vector<bool> retired;
+    producerPositions.reserve(buffers_.size());
+    retired.reserve(buffers_.size());
+    for (StagingBuffer *buffer : buffers_)
+    {
+        // 先读retired再读发布位置，读到retired为true时该线程已不会再写入
+        retired.push_back(buffer->retired().load(std::memory_order_acquire));
+        producerPositions.push_back(buffer->producerPos().load(std::memory_order_acquire));
+    }
+    writeNewFormats();
+
+    size_t written = 0;
+    for (size_t i = 0; i < buffers_.size(); ++i)
+    {
+        StagingBuffer *buffer = buffers_[i];
+        const char *data = buffer->data();
+        size_t producer = producerPositions[i];
+        size_t consumer = buffer->consumerPos().load(std::memory_order_relaxed);
+        size_t spanStart = consumer;
+        while (consumer != producer)
+        {
+            uint32_t id;
+            memcpy(&id, data + consumer, sizeof(id));
+            if (id == kWrapMarker)
+            {
+                appendOutput(data + spanStart, consumer - spanStart);
+                written += consumer - spanStart;
+                consumer = spanStart = 0;
+                continue;
+            }
+            uint32_t size;
+            memcpy(&size, data + consumer + sizeof(id), sizeof(size));
+            consumer += size;
+        }
+        appendOutput(data + spanStart, consumer - spanStart);
+        written += consumer - spanStart;
+        buffer->consumerPos().store(consumer, std::memory_order_release);
+
+        if (retired[i])
+        {
+            delete buffer;
+            buffers_[i] = nullptr;
+        }
+    }
+    buffers_.erase(std::remove(buffers_.begin(), buffers_.end(), nullptr), buffers_.end());
+    return written;
+}
+
+void BinaryLogging::writeNewFormats()
+{
+    std::vector<std::string> newRecords;
+    {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (size_t id = formatRecords_.size(); id < r.formats.size(); ++id)
+        {
+            // 字典记录：tag size id level line fileLen formatLen file format
+            const FormatInfo &info = r.formats[id];
+            uint32_t fields[7] = {kDictionaryTag,
+                                  0,
+                                  static_cast<uint32_t>(id),
+                                  static_cast<uint32_t>(info.level),
+                                  static_cast<uint32_t>(info.line),
+                                  static_cast<uint32_t>(info.file.size()),
+                                  static_cast<uint32_t>(info.format.size())};
+            fields[1] = sizeof(fields) + fields[5] + fields[6];
+            std::string record(reinterpret_cast<const char *>(fields), sizeof(fields));
+            record += info.file;
+            record += info.format;
+            newRecords.push_back(std::move(record));
+        }
+    }
+    for (std::string &record : newRecords)
+    {
+        appendOutput(record.data(), record.size());
+        formatRecords_.push_back(std::move(record));
+    }
+}
+
+void BinaryLogging::appendOutput(const char *data, size_t len)
+{
+    if (output_.currentFilename() != outputFilename_)
+    {
+        // 新文件：文件头 + 已经写过的格式字典，保证每个文件都可以单独解码
+        outputFilename_ = output_.currentFilename();
+        output_.append(kFileMagic, sizeof(kFileMagic));
+        for (const std::string &record : formatRecords_)
+        {
+            output_.append(record.data(), record.size());
+        }
+    }
+    if (len > 0)
+    {
+        output_.append(data, len);
+    }
+}
+
+namespace
+{
+struct DecodedArg
+{
+    char type;
+    int64_t i;
+    double d;
+    std::string s;
+};
+
+template <typename T>
+void appendFormatted(std::string *out, const std::string &spec, T value)
+{
+    char buf[256];
+    int n = snprintf(buf, sizeof(buf), spec.c_str(), value);
+    if (n < 0)
+    {
+        return;
+    }
+    if (static_cast<size_t>(n) < sizeof(buf))
+    {
+        out->append(buf, n);
+    }
+    else
+    {
+        std::string large(n + 1, '\0');
+        snprintf(&large[0], large.size(), spec.c_str(), value);
+        out->append(large.data(), n);
+    }
+}
+
+// 按printf的规则逐个替换格式说明符；长度修饰符按参数实际记录的类型重写，参数不足时输出<missing>
+void formatMessage(const std::string &format, const std::vector<DecodedArg> &args, std::string *out)
+{
+    size_t next = 0;
+    for (size_t i = 0; i < format.size(); ++i)
+    {
+        if (format[i] != '%')
+        {
+            out->push_back(format[i]);
+            continue;
+        }
+        if (i + 1 < format.size() && format[i + 1] == '%')
+        {
+            out->push_back('%');
+            ++i;
+            continue;
+        }
+        size_t specStart = i;
+        size_t j = i + 1;
+        while (j < format.size() && strchr("-+ #0", format[j])) ++j;
+        while (j < format.size() && (isdigit(format[j]) || format[j] == '.')) ++j;
+        std::string spec = format.substr(i, j - i);
+        while (j < format.size() && strchr("hlLqjzt", format[j])) ++j;
+        if (j >= format.size())
+        {
+            out->append(format, i, std::string::npos);
+            break;
+        }
+        char conv = format[j];
+        i = j;
+
+        if (next >= args.size())
+        {
+            out->append("<missing>");
+            continue;
+        }
+        const DecodedArg &arg = args[next++];
+        switch (conv)
+        {
+        case 'd': case 'i':
+            appendFormatted(out, spec + "lld", static_cast<long long>(arg.type == kDouble ? arg.d : arg.i));
+            break;
+        case 'u': case 'o': case 'x': case 'X':
+            appendFormatted(out, spec + "ll" + conv, static_cast<unsigned long long>(arg.type == kDouble ? arg.d : arg.i));
+            break;
+        case 'c':
+            appendFormatted(out, spec + "c", static_cast<int>(arg.i));
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            appendFormatted(out, spec + conv, arg.type == kDouble ? arg.d : static_cast<double>(arg.i));
+            break;
+        case 's':
+            appendFormatted(out, spec + "s", arg.type == kString ? arg.s.c_str() : "<not a string>");
+            break;
+        case 'p':
+            appendFormatted(out, spec + "p", reinterpret_cast<void *>(static_cast<uintptr_t>(arg.i)));
+            break;
+        default:
+            out->append(format, specStart, j - specStart + 1);
+            break;
+        }
+    }
+}
+
+bool decodeArgs(const char *p, const char *end, std::vector<DecodedArg> *args)
+{
+    args->clear();
+    while (p < end)
+    {
+        DecodedArg arg;
+        arg.type = *p++;
+        arg.i = 0;
+        arg.d = 0;
+        switch (arg.type)
+        {
+        case kInt64: case kUInt64: case kPointer:
+            if (end - p < 8) return false;
+            memcpy(&arg.i, p, 8);
+            p += 8;
+            break;
+        case kDouble:
+            if (end - p < 8) return false;
+            memcpy(&arg.d, p, 8);
+            p += 8;
+            break;
+        case kString:
+        {
+            uint32_t len;
+            if (end - p < 4) return false;
+            memcpy(&len, p, 4);
+            p += 4;
+            if (static_cast<size_t>(end - p) < len) return false;
+            arg.s.assign(p, len);
+            p += len;
+            break;
+        }
+        default:
+            return false;
+        }
+        args->push_back(std::move(arg));
+    }
+    return true;
+}
+} // namespace
+
+long BinaryLogging::decode(const std::string &filename, FILE *out)
+{
+    FILE *fp = ::fopen(filename.c_str(), "rb");
+    if (fp == nullptr)
+    {
+        return -1;
+    }
+    std::string content;
+    char chunk[64 * 1024];
+    size_t n;
+    while ((n = ::fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    {
+        content.append(chunk, n);
+    }
+    ::fclose(fp);
+
+    if (content.size() < sizeof(kFileMagic) || memcmp(content.data(), kFileMagic, sizeof(kFileMagic)) != 0)
+    {
+        return -1;
+    }
+
+    std::map<uint32_t, FormatInfo> formats;
+    std::vector<DecodedArg> args;
+    std::string line;
+    long count = 0;
+    const char *p = content.data() + sizeof(kFileMagic);
+    const char *end = content.data() + content.size();
+    while (end - p >= 8)
+    {
+        uint32_t tag, size;
+        memcpy(&tag, p, 4);
+        memcpy(&size, p + 4, 4);
+        if (size < 8 || static_cast<size_t>(end - p) < size)
+        {
+            return -1;
+        }
+        if (tag == kDictionaryTag)
+        {
+            uint32_t fields[7];
+            if (size < sizeof(fields))
+            {
+                return -1;
+            }
+            memcpy(fields, p, sizeof(fields));
+            if (sizeof(fields) + fields[5] + fields[6] != size)
+            {
+                return -1;
+            }
+            FormatInfo &info = formats[fields[2]];
+            info.level = static_cast<int>(fields[3]);
+            info.line = static_cast<int>(fields[4]);
+            info.file.assign(p + sizeof(fields), fields[5]);
+            info.format.assign(p + sizeof(fields) + fields[5], fields[6]);
+        }
+        else
+        {
+            RecordHeader header;
+            if (size < sizeof(header))
+            {
+                return -1;
+            }
+            memcpy(&header, p, sizeof(header));
+            auto it = formats.find(header.formatId);
+            if (it == formats.end() || !decodeArgs(p + sizeof(header), p + size, &args))
+            {
+                return -1;
+            }
+
+            static const char *const kLevelNames[] = {"[DEBUG]", "[INFO]", "[ERROR]", "[FATAL]"};
+            int level = it->second.level;
+            line = (level >= 0 && level <= FATAL) ? kLevelNames[level] : "";
+            char timebuf[32];
+            Timestamp(header.timestamp).toFormattedString(timebuf, sizeof(timebuf));
+            line += timebuf;
+            line += " : ";
+            formatMessage(it->second.format, args, &line);
+            if (line.empty() || line.back() != '\n')
+            {
+                line.push_back('\n');
+            }
+            ::fwrite(line.data(), 1, line.size(), out);
+            ++count;
+        }
+        p += size;
+    }
+    return count;
+}
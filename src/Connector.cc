@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "Connector.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "Timestamp.h"
+
+namespace
+{
+int getSocketError(int sockfd)
+{
+    int optval;
+    socklen_t optlen = sizeof(optval);
+    if(::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        return errno;
+    }
+    return optval;
+}
+
+// 本地临时端口恰好等于目标端口时，连接本机未监听的端口会连上自己
+bool isSelfConnect(int sockfd)
+{
+    InetAddress local(InetAddress::localAddressOf(sockfd));
+    if(local.isUnix())
+    {
+        return false;
+    }
+    InetAddress peer(InetAddress::peerAddressOf(sockfd));
+    return local.length() == peer.length() && ::memcmp(local.getSockAddr(), peer.getSockAddr(), local.length()) == 0;
+}
+} // namespace
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , connect_(false)
+    , state_(kDisconnected)
+    , connectTimeout_(0.0)
+    , initRetryDelayMs_(kDefaultInitRetryDelayMs)
+    , retryDelayMs_(kDefaultInitRetryDelayMs)
+    , maxRetryDelayMs_(kDefaultMaxRetryDelayMs)
+    , attempts_(0)
+    , maxAttempts_(0)
+    , failures_(0)
+    , timeoutTimerActive_(false)
+    , retryTimerActive_(false)
+    , jitter_(static_cast<unsigned>(reinterpret_cast<uintptr_t>(this) ^ Timestamp::now().microSecondsSinceEpoch()))
+{
+    LOG_DEBUG("Connector ctor[%p]\n", this);
+}
+
+Connector::~Connector()
+{
+    LOG_DEBUG("Connector dtor[%p]\n", this);
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::restart()
+{
+    setState(kDisconnected);
+    retryDelayMs_ = initRetryDelayMs_;
+    failures_ = 0;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    loop_->queueInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop()
+{
+    retryTimerActive_ = false;
+    if(connect_ && state_ == kDisconnected)
+    {
+        connect();
+    }
+    else
+    {
+        LOG_DEBUG("Connector::startInLoop do not connect\n");
+    }
+}
+
+void Connector::stopInLoop()
+{
+    cancelTimers();
+    if(state_ == kConnecting)
+    {
+        setState(kDisconnected);
+        int sockfd = removeAndResetChannel();
+        retry(sockfd);  // connect_已为false，只会关闭fd
+    }
+}
+
+void Connector::connect()
+{
+    sa_family_t family = serverAddr_.family();
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, family == AF_UNIX ? 0 : IPPROTO_TCP);
+    if(sockfd < 0)
+    {
+        // fd耗尽等情况，稍后重试
+        LOG_ERROR("%s:%s:%d socket create err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+        retry(-1);
+        return;
+    }
+    ++attempts_;
+    int ret = ::connect(sockfd, serverAddr_.getSockAddr(), serverAddr_.length());
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch(savedErrno)
+    {
+        case 0:
+        case EINPROGRESS:
+        case EINTR:
+        case EISCONN:
+            connecting(sockfd);
+            break;
+
+        // 暂时性的错误，稍后重试
+        case EAGAIN:
+        case EADDRINUSE:
+        case EADDRNOTAVAIL:
+        case ECONNREFUSED:
+        case ENETUNREACH:
+        case EHOSTUNREACH:
+        case ETIMEDOUT:
+        case ENOENT:        // Unix域地址还没有人监听
+            retry(sockfd);
+            break;
+
+        default:
+            LOG_ERROR("Connector::connect to %s err:%d\n", serverAddr_.toIpPort().c_str(), savedErrno);
+            ::close(sockfd);
+            giveUp();
+            break;
+    }
+}
+
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    // 连接完成(成功或失败)时socket变为可写
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    channel_->enableWriting();
+
+    if(connectTimeout_ > 0)
+    {
+        std::weak_ptr<Connector> weakSelf(shared_from_this());
+        timeoutTimerActive_ = true;
+        timeoutTimer_ = loop_->runAfter(connectTimeout_, [weakSelf]() {
+            ConnectorPtr self = weakSelf.lock();
+            if(self)
+            {
+                self->timeoutTimerActive_ = false;
+                self->handleTimeout();
+            }
+        });
+    }
+}
+
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 可能正处于channel_->handleEvent中，不能在这里销毁，交给本轮事件处理完后执行的回调释放
+    std::shared_ptr<Channel> channel(channel_.release());
+    loop_->queueInLoop([channel]() {});
+    return sockfd;
+}
+
+void Connector::handleWrite()
+{
+    if(state_ != kConnecting)
+    {
+        return;
+    }
+    int sockfd = removeAndResetChannel();
+    int err = getSocketError(sockfd);
+    if(err)
+    {
+        LOG_INFO("Connector::handleWrite connect to %s SO_ERROR=%d %s\n", serverAddr_.toIpPort().c_str(), err, strerror(err));
+        retry(sockfd);
+    }
+    else if(isSelfConnect(sockfd))
+    {
+        LOG_INFO("Connector::handleWrite self connect to %s\n", serverAddr_.toIpPort().c_str());
+        retry(sockfd);
+    }
+    else
+    {
+        cancelTimers();
+        setState(kConnected);
+        failures_ = 0;
+        if(connect_ && newConnectionCallback_)
+        {
+            newConnectionCallback_(sockfd);
+        }
+        else
+        {
+            ::close(sockfd);
+        }
+    }
+}
+
+void Connector::handleError()
+{
+    if(state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        LOG_INFO("Connector::handleError connect to %s SO_ERROR=%d %s\n", serverAddr_.toIpPort().c_str(), err, strerror(err));
+        retry(sockfd);
+    }
+}
+
+void Connector::handleTimeout()
+{
+    if(state_ == kConnecting)
+    {
+        LOG_INFO("Connector::handleTimeout connect to %s timed out after %.3fs\n", serverAddr_.toIpPort().c_str(), connectTimeout_);
+        int sockfd = removeAndResetChannel();
+        retry(sockfd);
+    }
+}
+
+void Connector::retry(int sockfd)
+{
+    if(sockfd >= 0)
+    {
+        ::close(sockfd);
+    }
+    setState(kDisconnected);
+    if(timeoutTimerActive_)
+    {
+        loop_->cancel(timeoutTimer_);
+        timeoutTimerActive_ = false;
+    }
+    if(!connect_)
+    {
+        return;
+    }
+    ++failures_;
+    if(maxAttempts_ > 0 && failures_ >= maxAttempts_)
+    {
+        LOG_INFO("Connector::retry give up connecting to %s after %d attempts\n", serverAddr_.toIpPort().c_str(), failures_);
+        giveUp();
+        return;
+    }
+
+    // 实际等待时间在[delay/2, delay]之间随机
+    int delayMs = retryDelayMs_ / 2 + static_cast<int>(jitter_() % (retryDelayMs_ / 2 + 1));
+    LOG_INFO("Connector::retry connecting to %s in %d milliseconds\n", serverAddr_.toIpPort().c_str(), delayMs);
+    std::weak_ptr<Connector> weakSelf(shared_from_this());
+    retryTimerActive_ = true;
+    retryTimer_ = loop_->runAfter(delayMs / 1000.0, [weakSelf]() {
+        ConnectorPtr self = weakSelf.lock();
+        if(self)
+        {
+            self->startInLoop();
+        }
+    });
+    retryDelayMs_ = std::min(retryDelayMs_ * 2, maxRetryDelayMs_);
+}
+
+void Connector::giveUp()
+{
+    connect_ = false;
+    failures_ = 0;
+    retryDelayMs_ = initRetryDelayMs_;
+    if(connectFailedCallback_)
+    {
+        connectFailedCallback_();
+    }
+}
+
+void Connector::cancelTimers()
+{
+    if(timeoutTimerActive_)
+    {
+        loop_->cancel(timeoutTimer_);
+        timeoutTimerActive_ = false;
+    }
+    if(retryTimerActive_)
+    {
+        loop_->cancel(retryTimer_);
+        retryTimerActive_ = false;
+    }
+}
@@ -2,6 +2,8 @@
 
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
+#include "Logger.h"
 
 Poller *Poller::newDefaultPoller(EventLoop *loop)
 {
@@ -9,8 +11,17 @@ Poller *Poller::newDefaultPoller(EventLoop *loop)
     {
         return nullptr; // 生成poll的实例
     }
+    else if (::getenv("MUDUO_USE_IO_URING"))
+    {
+        if (IoUringPoller::isSupported())
+        {
+            return new IoUringPoller(loop); // 生成io_uring的实例
+        }
+        LOG_ERROR("%s:%s:%d io_uring is not supported, fall back to epoll\n", __FILE__, __FUNCTION__, __LINE__);
+        return new EPollPoller(loop);
+    }
     else
     {
         return new EPollPoller(loop); // 生成epoll的实例
     }
-}
\ No newline at end of file
+}
@@ -29,7 +29,7 @@ EPollPoller::~EPollPoller()
 
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 {
-    LOG_INFO("func=%s => fd total count:%lu\n", __FUNCTION__, channels_.size());
+    LOG_DEBUG("func=%s => fd total count:%lu\n", __FUNCTION__, numChannels_);
 
     int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
     int saveErrno = errno;
@@ -37,7 +37,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 
     if (numEvents > 0)
     {
-        LOG_INFO("%d events happend\n", numEvents);
+        LOG_DEBUG("%d events happend\n", numEvents);
         fillActiveChannels(numEvents, activeChannels);
         if(numEvents == events_.size())
         {
@@ -62,26 +62,23 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 void EPollPoller::updateChannel(Channel *channel)
 {
     const int index = channel->index();
-    LOG_INFO("func=%s => fd=%d events=%d index=%d\n", __FUNCTION__, channel->fd(), channel->events(), index);
+    LOG_DEBUG("func=%s => fd=%d events=%d index=%d\n", __FUNCTION__, channel->fd(), channel->events(), index);
 
     if(index == kNew || index == kDeleted)
     {
-        int fd = channel->fd();
         if(index == kNew)
         {
-            channels_[fd] = channel;
+            addChannel(channel);
         }
         else
         {
-            assert(channels_.find(fd) != channels_.end());
-            assert(channels_[fd] == channel);
+            assert(findChannel(channel->fd()) == channel);
         }
         channel->set_index(kAdded);
         update(EPOLL_CTL_ADD, channel);
     }
     else
     {
-        int fd = channel->fd();
         if(channel->isNoneEvent())
         {
             update(EPOLL_CTL_DEL, channel);
@@ -96,10 +93,9 @@ void EPollPoller::updateChannel(Channel *channel)
 
 void EPollPoller::removeChannel(Channel *channel)
 {
-    int fd = channel->fd();
-    channels_.erase(fd);
+    eraseChannel(channel);
 
-    LOG_INFO("func=%s => fd=%d\n", __FUNCTION__, fd);
+    LOG_DEBUG("func=%s => fd=%d\n", __FUNCTION__, channel->fd());
 
     int index = channel->index();
     if(index == kAdded)
@@ -113,7 +109,14 @@ void EPollPoller::fillActiveChannels(int numEvents, ChannelList *activeChannels)
 {
     for(int i = 0; i < numEvents; ++i)
     {
-        Channel *channel = static_cast<Channel *>(events_[i].data.ptr);
+        // data中保存的是fd和注册时的代号，代号不一致说明fd已被其它Channel复用，丢弃该事件
+        int fd = static_cast<int>(events_[i].data.u64 >> 32);
+        uint32_t generation = static_cast<uint32_t>(events_[i].data.u64);
+        Channel *channel = findChannel(fd);
+        if(channel == nullptr || channelGeneration(fd) != generation)
+        {
+            continue;
+        }
         channel->set_revents(events_[i].events);
         activeChannels->push_back(channel);
     }
@@ -127,8 +130,8 @@ void EPollPoller::update(int operation, Channel *channel)
     int fd = channel->fd();
 
     event.events = channel->events();
-    event.data.fd = fd;
-    event.data.ptr = channel;
+    setRegisteredEvents(fd, operation == EPOLL_CTL_DEL ? 0 : channel->events());
+    event.data.u64 = (static_cast<uint64_t>(static_cast<uint32_t>(fd)) << 32) | channelGeneration(fd);
 
     if(::epoll_ctl(epollfd_, operation, fd, &event) < 0)
     {
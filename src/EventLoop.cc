@@ -5,6 +5,8 @@
 #include <memory>
 #include <assert.h>
 #include <poll.h>
+#include <algorithm>
+#include <future>
 
 #include "EventLoop.h"
 #include "Logger.h"
@@ -16,6 +18,11 @@ __thread EventLoop* t_loopInThisThread = 0;
 
 const int kPollTimeMs = 10000;      // 10秒超时
 
+const size_t kLowPriorityMaxFunctors = 64;      // 默认每轮最多执行64个低优先级回调
+const int64_t kLowPriorityMaxMicroSeconds = 1000; // 默认每轮低优先级回调最多占用1毫秒
+
+const double kLoadTimeConstantUs = 1000 * 1000;   // 负载移动平均的时间常数，约反映最近1秒
+
 int createEventfd()
 {
     int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
@@ -31,10 +38,19 @@ EventLoop::EventLoop()
     , quit_(false)
     , callingPendingFunctors_(false)
     , threadId_(CurrentThread::tid())
+    , elidedChannelUpdates_(0)
     , poller_(Poller::newDefaultPoller(this))
     , timerQueue_(new TimerQueue(this))
     , wakeupFd_(createEventfd())
     , wakeupChannel_(new Channel(this, wakeupFd_))
+    , lowPriorityMaxFunctors_(kLowPriorityMaxFunctors)
+    , lowPriorityMaxMicroSeconds_(kLowPriorityMaxMicroSeconds)
+    , connectionCount_(0)
+    , queuedFunctors_(0)
+    , busyMicroSeconds_(0)
+    , load_(0.0)
+    , lastIterationEnd_(Timestamp::now().microSecondsSinceEpoch())
+    , cpu_(-1)
 {
     LOG_DEBUG("%s:%s:%d EventLoop created %p in thread %d\n", __FILE__, __FUNCTION__, __LINE__, this, threadId_);
     if (t_loopInThisThread)
@@ -68,8 +84,12 @@ void EventLoop::loop()
     while(!quit_)
     {
         activeChannels_.clear();
+        // 本轮循环中所有的关注事件修改在这里一次性提交，同一轮内先开后关的修改不会产生系统调用
+        applyChannelUpdates();
+        // 还有积压的低优先级回调时不能阻塞在poll上，处理完IO事件后要继续执行它们
+        int timeoutMs = lowPriorityBacklog_.empty() ? kPollTimeMs : 0;
         // 调用完poll()后activeChannels_会包含活动的文件描述符
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        pollReturnTime_ = poller_->poll(timeoutMs, &activeChannels_);
         for(Channel *channel : activeChannels_)
         {
             // handleEvent 处理的是IO事件（如网络、定时器、wakeup等）
@@ -77,11 +97,30 @@ void EventLoop::loop()
         }
         // 处理的是异步投递的回调任务，可能来自其它线程或本线程的异步操作
         doPendingFunctors();
+        updateLoadStats();
     }
     LOG_INFO("EventLoop %p stop looping.\n", this);
     looping_ = false;
 }
 
+void EventLoop::updateLoadStats()
+{
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    int64_t busy = now - pollReturnTime_.microSecondsSinceEpoch();
+    int64_t elapsed = now - lastIterationEnd_;
+    lastIterationEnd_ = now;
+    if(busy < 0 || elapsed <= 0)
+    {
+        return;
+    }
+    busyMicroSeconds_.fetch_add(busy, std::memory_order_relaxed);
+    // 按本轮经过的时间加权：长时间阻塞在poll中的一轮会把负载拉低，连续的短轮次逐步累积
+    double ratio = std::min(1.0, static_cast<double>(busy) / elapsed);
+    double alpha = elapsed / (elapsed + kLoadTimeConstantUs);
+    double load = load_.load(std::memory_order_relaxed);
+    load_.store(load + alpha * (ratio - load), std::memory_order_relaxed);
+}
+
 void EventLoop::quit()
 {
     quit_ = true;
@@ -104,12 +143,37 @@ void EventLoop::runInLoop(Functor cb)
     }
 }
 
-void EventLoop::queueInLoop(Functor cb)
+void EventLoop::runInLoopAndWait(const Functor &cb)
+{
+    if(isInLoopThread())
+    {
+        cb();
+    }
+    else
+    {
+        std::promise<void> done;
+        queueInLoop([&cb, &done]() {
+            cb();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+}
+
+void EventLoop::queueInLoop(Functor cb, Priority priority)
 {
     {
         std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
+        if (priority == kLowPriority)
+        {
+            lowPriorityFunctors_.emplace_back(std::move(cb));
+        }
+        else
+        {
+            pendingFunctors_.emplace_back(std::move(cb));
+        }
     }
+    queuedFunctors_.fetch_add(1, std::memory_order_relaxed);
 
     if(!isInLoopThread() || callingPendingFunctors_)
     {
@@ -162,14 +226,47 @@ void EventLoop::wakeup()
 
 void EventLoop::updateChannel(Channel *channel)
 {
-    poller_->updateChannel(channel);
+    if(channel->updatePending())
+    {
+        ++elidedChannelUpdates_; // 与本轮之前的修改合并
+        return;
+    }
+    channel->set_updatePending(true);
+    pendingUpdateChannels_.push_back(channel);
 }
 
 void EventLoop::removeChannel(Channel *channel)
 {
+    // channel移除后可能马上被析构，不能再留在待更新列表中
+    if(channel->updatePending())
+    {
+        channel->set_updatePending(false);
+        std::replace(pendingUpdateChannels_.begin(), pendingUpdateChannels_.end(), channel, static_cast<Channel *>(nullptr));
+    }
     poller_->removeChannel(channel);
 }
 
+void EventLoop::applyChannelUpdates()
+{
+    for(Channel *channel : pendingUpdateChannels_)
+    {
+        if(channel == nullptr)
+        {
+            continue;
+        }
+        channel->set_updatePending(false);
+        if(channel->events() == poller_->registeredEvents(channel))
+        {
+            ++elidedChannelUpdates_;
+        }
+        else
+        {
+            poller_->updateChannel(channel);
+        }
+    }
+    pendingUpdateChannels_.clear();
+}
+
 bool EventLoop::hasChannel(Channel *channel)
 {
     return poller_->hasChannel(channel);
@@ -178,18 +275,44 @@ bool EventLoop::hasChannel(Channel *channel)
 void EventLoop::doPendingFunctors()
 {
     std::vector<Functor> functors;
+    std::vector<Functor> lowPriorityFunctors;
     callingPendingFunctors_ = true;
 
     {
         // 该锁立即锁定，在结束上层作用域时自动析构解锁，此处建议使用lock_guard
         std::unique_lock<std::mutex> lock(mutex_);
         functors.swap(pendingFunctors_); // 交换的方式减少了锁的临界区范围 提升效率 同时避免了死锁 如果执行functor()在临界区内 且functor()中调用queueInLoop()就会产生死锁
+        lowPriorityFunctors.swap(lowPriorityFunctors_);
     }
+    queuedFunctors_.fetch_sub(functors.size(), std::memory_order_relaxed);
 
     for(const Functor &functor : functors)
     {
         functor();
     }
 
+    // 低优先级回调追加到积压队列尾部，按预算执行，剩余的留到下一轮，保证IO处理的延迟有上界
+    for(Functor &functor : lowPriorityFunctors)
+    {
+        lowPriorityBacklog_.push_back(std::move(functor));
+    }
+    if(!lowPriorityBacklog_.empty())
+    {
+        size_t count = 0;
+        int64_t deadline = Timestamp::now().microSecondsSinceEpoch() + lowPriorityMaxMicroSeconds_;
+        while(!lowPriorityBacklog_.empty() && count < lowPriorityMaxFunctors_)
+        {
+            Functor functor(std::move(lowPriorityBacklog_.front()));
+            lowPriorityBacklog_.pop_front();
+            functor();
+            ++count;
+            if(Timestamp::now().microSecondsSinceEpoch() >= deadline)
+            {
+                break;
+            }
+        }
+        queuedFunctors_.fetch_sub(count, std::memory_order_relaxed);
+    }
+
     callingPendingFunctors_ = false;
 }
\ No newline at end of file
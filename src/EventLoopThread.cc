@@ -1,14 +1,27 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
 #include "EventLoopThread.h"
 #include "EventLoop.h"
+#include "Logger.h"
+
+#ifndef MPOL_LOCAL
+#define MPOL_LOCAL 4    // 见<numaif.h>，内核3.8起支持，这里不依赖libnuma
+#endif
 
 EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
-                                const std::string &name)
+                                const std::string &name,
+                                int cpu)
     : loop_(nullptr)
     , exiting_(false)
     , thread_(std::bind(&EventLoopThread::threadFunc, this), name)
     , mutex_()
     , cond_()
     , callback_(cb)
+    , cpu_(cpu)
 {
 }
 
@@ -38,8 +51,18 @@ EventLoop *EventLoopThread::startLoop()
 
 void EventLoopThread::threadFunc()
 {
+    // 先绑核再创建EventLoop，这样poller、定时器队列等按首次访问分配的内存都落在本地节点上
+    if(cpu_ >= 0)
+    {
+        bindToCpu();
+    }
+
     // 在此处为新线程创建EventLoop
     EventLoop loop;
+    if(cpu_ >= 0)
+    {
+        loop.setCpu(cpu_);
+    }
 
     // 执行新线程的初始化回调
     if(callback_)
@@ -55,4 +78,25 @@ void EventLoopThread::threadFunc()
     loop.loop();
     std::unique_lock<std::mutex> lock(mutex_);
     loop_ = nullptr;
+}
+
+void EventLoopThread::bindToCpu()
+{
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu_, &cpuset);
+    int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(cpuset), &cpuset);
+    if(err != 0)
+    {
+        LOG_ERROR("%s:%s:%d bind thread %s to cpu %d err:%d\n", __FILE__, __FUNCTION__, __LINE__, thread_.name().c_str(), cpu_, err);
+        cpu_ = -1;
+        return;
+    }
+#ifdef SYS_set_mempolicy
+    // 覆盖从进程继承的内存策略(如numactl --interleave)，本线程之后的分配都优先使用当前CPU所在的节点
+    if(::syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) < 0 && errno != ENOSYS)
+    {
+        LOG_ERROR("%s:%s:%d set_mempolicy(MPOL_LOCAL) err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+#endif
 }
\ No newline at end of file
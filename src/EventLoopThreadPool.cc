@@ -26,7 +26,8 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
     {
         char buf[name_.size() + 32];
         snprintf(buf, sizeof(buf), "%s%d", name_.c_str(), i);
-        EventLoopThread *t = new EventLoopThread(cb, buf);
+        int cpu = cpus_.empty() ? -1 : cpus_[i % cpus_.size()];
+        EventLoopThread *t = new EventLoopThread(cb, buf, cpu);
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         loops_.push_back(t->startLoop());
     }
@@ -56,6 +57,15 @@ EventLoop *EventLoopThreadPool::getNextLoop()
     return loop;
 }
 
+EventLoop *EventLoopThreadPool::getNextLoop(const InetAddress &peerAddr)
+{
+    if(loops_.empty() || !policy_)
+    {
+        return getNextLoop();
+    }
+    return policy_->select(loops_, peerAddr);
+}
+
 std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
 {
     if(loops_.empty())
@@ -1,34 +1,150 @@
+#include <errno.h>
+#include <stddef.h>
+#include <algorithm>
 #include <string.h>
 #include <strings.h>
 
 #include "InetAddress.h"
+#include "Logger.h"
 
 InetAddress::InetAddress(uint16_t port, std::string ip)
 {
     ::memset(&addr_, 0, sizeof(addr_));
-    addr_.sin_family = AF_INET;
-    addr_.sin_port = ::htons(port);
-    addr_.sin_addr.s_addr = ::inet_addr(ip.c_str());
+    if(ip.find(':') != std::string::npos)
+    {
+        addr_.in6.sin6_family = AF_INET6;
+        addr_.in6.sin6_port = ::htons(port);
+        if(::inet_pton(AF_INET6, ip.c_str(), &addr_.in6.sin6_addr) != 1)
+        {
+            LOG_ERROR("%s:%s:%d invalid IPv6 address %s\n", __FILE__, __FUNCTION__, __LINE__, ip.c_str());
+        }
+        len_ = sizeof(addr_.in6);
+    }
+    else
+    {
+        addr_.in.sin_family = AF_INET;
+        addr_.in.sin_port = ::htons(port);
+        addr_.in.sin_addr.s_addr = ::inet_addr(ip.c_str());
+        len_ = sizeof(addr_.in);
+    }
+}
+
+InetAddress::InetAddress(const sockaddr *addr, socklen_t len)
+{
+    setSockAddr(addr, len);
+}
+
+void InetAddress::setSockAddr(const sockaddr *addr, socklen_t len)
+{
+    if(len > sizeof(addr_))
+    {
+        len = sizeof(addr_);
+    }
+    ::memset(&addr_, 0, sizeof(addr_));
+    ::memcpy(&addr_, addr, len);
+    len_ = len;
+}
+
+InetAddress InetAddress::fromUnixPath(const std::string &path)
+{
+    sockaddr_un un;
+    ::memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    size_t n = std::min(path.size(), sizeof(un.sun_path) - 1);
+    if(n < path.size())
+    {
+        LOG_ERROR("%s:%s:%d unix socket path too long: %s\n", __FILE__, __FUNCTION__, __LINE__, path.c_str());
+    }
+    ::memcpy(un.sun_path, path.data(), n);
+    socklen_t len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + n);
+    if(n > 0 && path[0] == '@')
+    {
+        un.sun_path[0] = '\0';  // 抽象命名空间，名字不以'\0'结尾，长度不含结尾
+    }
+    else
+    {
+        len += 1;
+    }
+    return InetAddress(reinterpret_cast<const sockaddr *>(&un), len);
+}
+
+InetAddress InetAddress::localAddressOf(int sockfd)
+{
+    sockaddr_storage addr;
+    ::memset(&addr, 0, sizeof(addr));
+    socklen_t addrlen = sizeof(addr);
+    if(::getsockname(sockfd, (sockaddr *)&addr, &addrlen) < 0)
+    {
+        LOG_ERROR("%s:%s:%d getsockname err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return InetAddress((sockaddr *)&addr, addrlen);
+}
+
+InetAddress InetAddress::peerAddressOf(int sockfd)
+{
+    sockaddr_storage addr;
+    ::memset(&addr, 0, sizeof(addr));
+    socklen_t addrlen = sizeof(addr);
+    if(::getpeername(sockfd, (sockaddr *)&addr, &addrlen) < 0)
+    {
+        LOG_ERROR("%s:%s:%d getpeername err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return InetAddress((sockaddr *)&addr, addrlen);
 }
 
 std::string InetAddress::toIp() const
 {
-    char buf[64] = {0};
-    ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof(buf));
-    return buf;
+    char buf[INET6_ADDRSTRLEN] = {0};
+    switch(family())
+    {
+        case AF_INET:
+            ::inet_ntop(AF_INET, &addr_.in.sin_addr, buf, sizeof(buf));
+            return buf;
+        case AF_INET6:
+            ::inet_ntop(AF_INET6, &addr_.in6.sin6_addr, buf, sizeof(buf));
+            return buf;
+        case AF_UNIX:
+        {
+            size_t offset = offsetof(sockaddr_un, sun_path);
+            if(len_ <= offset)
+            {
+                return std::string();   // 未绑定地址的一端
+            }
+            if(isAbstract())
+            {
+                return "@" + std::string(addr_.un.sun_path + 1, len_ - offset - 1);
+            }
+            return std::string(addr_.un.sun_path, ::strnlen(addr_.un.sun_path, len_ - offset));
+        }
+        default:
+            return std::string();
+    }
 }
 
 std::string InetAddress::toIpPort() const
 {
-    char buf[64] = {0};
-    ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof(buf));
-    size_t end = ::strlen(buf);
-    uint16_t port = ::ntohs(addr_.sin_port);
-    sprintf(buf+end, ":%u", port);
-    return buf;
+    switch(family())
+    {
+        case AF_INET:
+            return toIp() + ":" + std::to_string(toPort());
+        case AF_INET6:
+            return "[" + toIp() + "]:" + std::to_string(toPort());
+        case AF_UNIX:
+            return "unix:" + toIp();
+        default:
+            return std::string();
+    }
 }
 
 uint16_t InetAddress::toPort() const
 {
-    return ::ntohs(addr_.sin_port);
+    switch(family())
+    {
+        case AF_INET:
+            return ::ntohs(addr_.in.sin_port);
+        case AF_INET6:
+            return ::ntohs(addr_.in6.sin6_port);
+        default:
+            return 0;
+    }
 }
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "IoUringPoller.h"
+#include "Logger.h"
+#include "Channel.h"
+
+const int kNew = -1;
+const int kAdded = 1;
+
+// 取消请求的user_data，完成事件直接忽略
+const uint64_t kCancelUserData = 0;
+
+static int ioUringSetup(unsigned entries, io_uring_params *params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, size_t argsz)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argsz));
+}
+
+// user_data = fd(高32位) | generation(低32位)，generation从1开始，所以不会与kCancelUserData冲突
+static uint64_t encodeUserData(int fd, uint32_t generation)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(fd)) << 32) | generation;
+}
+
+bool IoUringPoller::isSupported()
+{
+    static const bool supported = []() {
+        io_uring_params params;
+        ::memset(&params, 0, sizeof(params));
+        int fd = ioUringSetup(2, &params);
+        if (fd < 0)
+        {
+            return false;
+        }
+        ::close(fd);
+        return (params.features & IORING_FEAT_EXT_ARG) && (params.features & IORING_FEAT_NODROP);
+    }();
+    return supported;
+}
+
+IoUringPoller::IoUringPoller(EventLoop *loop)
+    : Poller(loop)
+    , ringfd_(-1)
+    , pendingSubmit_(0)
+    , nextGeneration_(0)
+{
+    io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    ringfd_ = ioUringSetup(kRingEntries, &params);
+    if (ringfd_ < 0)
+    {
+        LOG_FATAL("%s:%s:%d io_uring_setup error:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        LOG_FATAL("%s:%s:%d mmap sq ring error:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    if (singleMmap)
+    {
+        cqRing_ = sqRing_;
+    }
+    else
+    {
+        cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED)
+        {
+            LOG_FATAL("%s:%s:%d mmap cq ring error:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+        }
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED)
+    {
+        LOG_FATAL("%s:%s:%d mmap sqes error:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+
+    char *sq = static_cast<char *>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqRingMask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqEntries_ = params.sq_entries;
+
+    char *cq = static_cast<char *>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqRingMask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    ::munmap(sqes_, sqesSize_);
+    if (cqRing_ != sqRing_)
+    {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    ::munmap(sqRing_, sqRingSize_);
+    ::close(ringfd_);
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    // 上一轮触发过的poll请求已经结束，若Channel仍关注事件则重新提交，与EPOLL的LT语义一致
+    for (int fd : firedFds_)
+    {
+        Channel *channel = findChannel(fd);
+        if (channel != nullptr && !pollStates_[fd].armed && !channel->isNoneEvent())
+        {
+            armPoll(channel, &pollStates_[fd]);
+        }
+    }
+    firedFds_.clear();
+
+    // 完成队列里已经有事件时只提交不等待
+    bool hasCompletions = !reapedCqes_.empty() || *cqHead_ != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    unsigned waitNr = (hasCompletions || timeoutMs == 0) ? 0 : 1;
+    int ret = 0;
+    if (pendingSubmit_ > 0 || waitNr > 0)
+    {
+        ret = enter(pendingSubmit_, waitNr, timeoutMs);
+    }
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+
+    if (ret < 0 && saveErrno != EINTR && saveErrno != ETIME)
+    {
+        errno = saveErrno;
+        LOG_ERROR("%s:%s:%d error: %d", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    fillActiveChannels(activeChannels);
+    return now;
+}
+
+void IoUringPoller::updateChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    if (channel->index() == kNew)
+    {
+        addChannel(channel);
+        channel->set_index(kAdded);
+    }
+
+    if (static_cast<size_t>(fd) >= pollStates_.size())
+    {
+        PollState empty = {0, 0, false};
+        pollStates_.resize(channels_.size(), empty);
+    }
+    PollState &state = pollStates_[fd];
+    if (state.armed && state.events == channel->events())
+    {
+        return;
+    }
+    if (state.armed)
+    {
+        cancelPoll(fd, state);
+        state.armed = false;
+    }
+    // 内核中没有poll请求时登记为不关注任何事件，之后重新关注同样的事件不会被EventLoop当作无变化省略
+    setRegisteredEvents(fd, 0);
+    if (!channel->isNoneEvent())
+    {
+        armPoll(channel, &state);
+    }
+}
+
+void IoUringPoller::removeChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    eraseChannel(channel);
+
+    if (channel->index() == kAdded && pollStates_[fd].armed)
+    {
+        // 内核中的poll请求持有文件引用，立即提交取消请求，避免fd关闭后连接迟迟不释放
+        cancelPoll(fd, pollStates_[fd]);
+        enter(pendingSubmit_, 0, 0);
+        pollStates_[fd].armed = false;
+    }
+    channel->set_index(kNew);
+}
+
+void IoUringPoller::armPoll(Channel *channel, PollState *state)
+{
+    if (++nextGeneration_ == 0)
+    {
+        nextGeneration_ = 1;
+    }
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = channel->fd();
+    sqe->poll32_events = static_cast<uint32_t>(channel->events()); // EPOLLIN等与POLLIN等取值相同
+    sqe->user_data = encodeUserData(channel->fd(), nextGeneration_);
+
+    state->generation = nextGeneration_;
+    state->events = channel->events();
+    state->armed = true;
+    setRegisteredEvents(channel->fd(), channel->events());
+}
+
+void IoUringPoller::cancelPoll(int fd, const PollState &state)
+{
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = encodeUserData(fd, state.generation);
+    sqe->user_data = kCancelUserData;
+}
+
+io_uring_sqe *IoUringPoller::getSqe()
+{
+    unsigned tail = *sqTail_;
+    // 提交队列满了先把已填写的SQE交给内核，直到腾出位置；内核可能只接收一部分，
+    // 或因完成队列溢出返回EBUSY，此时先把完成事件取出暂存，否则会覆盖还没提交的SQE
+    while (tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_)
+    {
+        if (enter(pendingSubmit_, 0, 0) < 0 && errno == EBUSY)
+        {
+            reapCompletions();
+        }
+    }
+    unsigned index = tail & *sqRingMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    ::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    ++pendingSubmit_;
+    return sqe;
+}
+
+void IoUringPoller::reapCompletions()
+{
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        reapedCqes_.push_back(cqes_[head & *cqRingMask_]);
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+int IoUringPoller::enter(unsigned toSubmit, unsigned waitNr, int timeoutMs)
+{
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    ::memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (waitNr > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeoutMs >= 0)
+        {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+    }
+    int ret = ioUringEnter(ringfd_, toSubmit, waitNr, flags, waitNr > 0 ? &arg : nullptr, waitNr > 0 ? sizeof(arg) : 0);
+    if (ret >= 0)
+    {
+        pendingSubmit_ -= std::min(pendingSubmit_, static_cast<unsigned>(ret));
+    }
+    else if (errno != EINTR && errno != ETIME && errno != EBUSY)
+    {
+        LOG_FATAL("%s:%s:%d io_uring_enter error:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return ret;
+}
+
+void IoUringPoller::fillActiveChannels(ChannelList *activeChannels)
+{
+    // 先处理提交时为腾出完成队列而暂存的完成事件，保持先后顺序
+    for (const io_uring_cqe &cqe : reapedCqes_)
+    {
+        handleCompletion(cqe, activeChannels);
+    }
+    reapedCqes_.clear();
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        handleCompletion(cqes_[head & *cqRingMask_], activeChannels);
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+void IoUringPoller::handleCompletion(const io_uring_cqe &cqe, ChannelList *activeChannels)
+{
+    if (cqe.user_data == kCancelUserData)
+    {
+        return;
+    }
+    int fd = static_cast<int>(cqe.user_data >> 32);
+    uint32_t generation = static_cast<uint32_t>(cqe.user_data);
+    Channel *channel = findChannel(fd);
+    // 已被取消或重新提交过的poll请求的完成事件，直接丢弃
+    if (channel == nullptr || !pollStates_[fd].armed || pollStates_[fd].generation != generation)
+    {
+        return;
+    }
+    // one-shot的poll请求触发后就结束了，重新提交前内核里没有关注任何事件
+    pollStates_[fd].armed = false;
+    setRegisteredEvents(fd, 0);
+    firedFds_.push_back(fd);
+
+    channel->set_revents(cqe.res >= 0 ? cqe.res : POLLERR);
+    activeChannels->push_back(channel);
+}
@@ -0,0 +1,168 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "ListenSocketHandoff.h"
+#include "Acceptor.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+ListenSocketHandoff::ListenSocketHandoff(EventLoop *loop, const InetAddress &controlAddr)
+    : loop_(loop)
+    , controlAddr_(controlAddr)
+    , handedOff_(false)
+    , alive_(std::make_shared<bool>(true))
+{
+}
+
+ListenSocketHandoff::~ListenSocketHandoff() = default;
+
+void ListenSocketHandoff::start()
+{
+    acceptor_.reset(new Acceptor(loop_, controlAddr_, false));
+    acceptor_->setNewConnectionCallback(std::bind(&ListenSocketHandoff::handleNewConnection, this, std::placeholders::_1));
+    acceptor_->listen();
+    LOG_INFO("ListenSocketHandoff - waiting for successor on %s\n", controlAddr_.toIpPort().c_str());
+}
+
+void ListenSocketHandoff::handleNewConnection(int connfd)
+{
+    if(handedOff_)
+    {
+        ::close(connfd);
+        return;
+    }
+    handedOff_ = true;
+    acceptor_->stopListening();
+    // 正处于控制socket的事件回调中，关闭它要等本轮事件处理完
+    std::weak_ptr<bool> alive(alive_);
+    loop_->queueInLoop([this, alive, connfd]() {
+        if(alive.expired())
+        {
+            ::close(connfd);
+            return;
+        }
+        handoff(connfd);
+    });
+}
+
+void ListenSocketHandoff::handoff(int connfd)
+{
+    // 先释放控制地址，新进程收到fd后就可以监听它
+    acceptor_.reset();
+
+    std::vector<int> fds = provider_ ? provider_() : std::vector<int>();
+    if(fds.size() > kMaxFds)
+    {
+        fds.resize(kMaxFds);
+    }
+    uint32_t count = static_cast<uint32_t>(fds.size());
+    iovec iov;
+    iov.iov_base = &count;
+    iov.iov_len = sizeof(count);
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxFds));
+    msghdr msg;
+    ::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if(!fds.empty())
+    {
+        msg.msg_control = control.data();
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        ::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+    // 新建立的Unix域连接上只发这一小段，不会阻塞
+    ssize_t n = ::sendmsg(connfd, &msg, MSG_NOSIGNAL);
+    int savedErrno = errno;
+    ::close(connfd);
+    if(n != static_cast<ssize_t>(sizeof(count)))
+    {
+        // 新进程没有拿到fd，本进程继续提供服务，重新在控制地址上等待下一个新进程
+        LOG_ERROR("%s:%s:%d sendmsg err:%d, keep serving\n", __FILE__, __FUNCTION__, __LINE__, n < 0 ? savedErrno : 0);
+        handedOff_ = false;
+        start();
+        return;
+    }
+    LOG_INFO("ListenSocketHandoff - handed %u listening socket(s) to successor\n", count);
+
+    if(handoffCallback_)
+    {
+        handoffCallback_();
+    }
+}
+
+std::vector<int> ListenSocketHandoff::receive(const InetAddress &controlAddr, double timeoutSeconds)
+{
+    std::vector<int> fds;
+    int sockfd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(sockfd < 0)
+    {
+        LOG_ERROR("%s:%s:%d socket err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+        return fds;
+    }
+    timeval timeout;
+    timeout.tv_sec = static_cast<time_t>(timeoutSeconds);
+    timeout.tv_usec = static_cast<suseconds_t>((timeoutSeconds - timeout.tv_sec) * 1000000);
+    ::setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if(::connect(sockfd, controlAddr.getSockAddr(), controlAddr.length()) < 0)
+    {
+        // 没有旧进程，正常的首次启动
+        ::close(sockfd);
+        return fds;
+    }
+
+    uint32_t count = 0;
+    iovec iov;
+    iov.iov_base = &count;
+    iov.iov_len = sizeof(count);
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxFds));
+    msghdr msg;
+    ::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    ssize_t n = ::recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC);
+    int savedErrno = errno;
+    for(cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const unsigned char *data = CMSG_DATA(cmsg);
+            for(size_t i = 0; i < received; ++i)
+            {
+                int fd;
+                ::memcpy(&fd, data + i * sizeof(int), sizeof(int));
+                fds.push_back(fd);
+            }
+        }
+    }
+    ::close(sockfd);
+    if(n < 0)
+    {
+        LOG_ERROR("%s:%s:%d recvmsg from %s err:%d\n", __FILE__, __FUNCTION__, __LINE__, controlAddr.toIpPort().c_str(), savedErrno);
+    }
+    else if(n != static_cast<ssize_t>(sizeof(count)) || (msg.msg_flags & MSG_CTRUNC) || fds.size() != count)
+    {
+        // 头部不完整、控制消息被截断或fd数与头部不符，说明没有完整地收到全部监听socket，只用一部分会漏掉端口
+        LOG_ERROR("%s:%s:%d incomplete handoff from %s: %ld header bytes, %u expected, %lu received%s\n",
+                  __FILE__, __FUNCTION__, __LINE__, controlAddr.toIpPort().c_str(), static_cast<long>(n), count,
+                  static_cast<unsigned long>(fds.size()), (msg.msg_flags & MSG_CTRUNC) ? ", control truncated" : "");
+        for(int fd : fds)
+        {
+            ::close(fd);
+        }
+        fds.clear();
+        return fds;
+    }
+    LOG_INFO("ListenSocketHandoff - received %lu listening socket(s) from %s\n",
+             static_cast<unsigned long>(fds.size()), controlAddr.toIpPort().c_str());
+    return fds;
+}
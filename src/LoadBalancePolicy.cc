@@ -0,0 +1,76 @@
+#include "LoadBalancePolicy.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+
+EventLoop *RoundRobinPolicy::select(const std::vector<EventLoop *> &loops, const InetAddress &)
+{
+    EventLoop *loop = loops[next_ % loops.size()];
+    ++next_;
+    return loop;
+}
+
+EventLoop *LeastConnectionsPolicy::select(const std::vector<EventLoop *> &loops, const InetAddress &)
+{
+    size_t n = loops.size();
+    size_t start = next_++ % n;
+    EventLoop *best = loops[start];
+    int bestCount = best->connectionCount();
+    for (size_t i = 1; i < n && bestCount > 0; ++i)
+    {
+        EventLoop *loop = loops[(start + i) % n];
+        int count = loop->connectionCount();
+        if (count < bestCount)
+        {
+            best = loop;
+            bestCount = count;
+        }
+    }
+    return best;
+}
+
+EventLoop *LeastPendingWorkPolicy::select(const std::vector<EventLoop *> &loops, const InetAddress &)
+{
+    size_t n = loops.size();
+    size_t start = next_++ % n;
+    EventLoop *best = nullptr;
+    double bestScore = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        EventLoop *loop = loops[(start + i) % n];
+        double score = static_cast<double>(loop->queuedFunctors()) + busyWeight_ * loop->load();
+        if (best == nullptr || score < bestScore)
+        {
+            best = loop;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+EventLoop *PeerHashPolicy::select(const std::vector<EventLoop *> &loops, const InetAddress &peerAddr)
+{
+    // FNV-1a，只用IP不用端口，同一客户端的多个连接落在同一个loop
+    const unsigned char *bytes;
+    size_t len;
+    if (peerAddr.family() == AF_INET)
+    {
+        bytes = reinterpret_cast<const unsigned char *>(&reinterpret_cast<const sockaddr_in *>(peerAddr.getSockAddr())->sin_addr);
+        len = sizeof(in_addr);
+    }
+    else if (peerAddr.family() == AF_INET6)
+    {
+        bytes = reinterpret_cast<const unsigned char *>(&reinterpret_cast<const sockaddr_in6 *>(peerAddr.getSockAddr())->sin6_addr);
+        len = sizeof(in6_addr);
+    }
+    else
+    {
+        // Unix域的对端通常没有地址，全部落到同一个loop上没有意义，退化为轮询
+        return fallback_.select(loops, peerAddr);
+    }
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return loops[hash % loops.size()];
+}
@@ -0,0 +1,240 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "LogFile.h"
+
+namespace
+{
+// CLOCK_MONOTONIC_COARSE走vDSO，每写一行都取一次也很便宜
+int64_t monotonicMs()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+} // namespace
+
+LogFile::LogFile(const std::string &basename,
+                 off_t rollSize,
+                 bool threadSafe,
+                 int flushIntervalMs,
+                 int rollPeriodSeconds,
+                 off_t preallocateSize)
+    : basename_(basename)
+    , rollSize_(rollSize)
+    , flushIntervalMs_(flushIntervalMs)
+    , rollPeriodSeconds_(rollPeriodSeconds)
+    , preallocateSize_(preallocateSize < 0 ? rollSize : preallocateSize)
+    , mutex_(threadSafe ? new std::mutex : nullptr)
+    , fd_(-1)
+    , buffer_(new char[kBufferSize])
+    , bufferLen_(0)
+    , writtenBytes_(0)
+    , startOfPeriod_(0)
+    , lastRoll_(0)
+    , lastFlushMs_(monotonicMs())
+    , stopping_(false)
+{
+    rollFile();
+    if (mutex_ && flushIntervalMs_ > 0)
+    {
+        flushThread_.reset(new Thread(std::bind(&LogFile::flushThreadFunc, this), "LogFileFlush"));
+        flushThread_->start();
+    }
+}
+
+LogFile::~LogFile()
+{
+    if (flushThread_)
+    {
+        {
+            std::lock_guard<std::mutex> lock(*mutex_);
+            stopping_ = true;
+        }
+        flushCond_.notify_one();
+        flushThread_->join();
+    }
+    flushUnlocked();
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+void LogFile::append(const char *logline, size_t len)
+{
+    if (mutex_)
+    {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        appendUnlocked(logline, len);
+    }
+    else
+    {
+        appendUnlocked(logline, len);
+    }
+}
+
+void LogFile::flush()
+{
+    if (mutex_)
+    {
+        std::lock_guard<std::mutex> lock(*mutex_);
+        flushUnlocked();
+    }
+    else
+    {
+        flushUnlocked();
+    }
+}
+
+void LogFile::flushThreadFunc()
+{
+    std::unique_lock<std::mutex> lock(*mutex_);
+    while (!stopping_)
+    {
+        // 一直有日志写入时append已按间隔落盘并推后lastFlushMs_，这里只补上停止写入后留在缓冲区中的部分
+        int64_t waitMs = lastFlushMs_ + flushIntervalMs_ - monotonicMs();
+        if (waitMs > 0)
+        {
+            flushCond_.wait_for(lock, std::chrono::milliseconds(waitMs));
+        }
+        else
+        {
+            flushUnlocked();
+        }
+    }
+}
+
+void LogFile::appendUnlocked(const char *logline, size_t len)
+{
+    if (bufferLen_ + len > kBufferSize)
+    {
+        flushUnlocked();
+    }
+    if (len > kBufferSize)
+    {
+        writeToFile(logline, len); // 比缓冲区还大的数据(如AsyncLogging的整块缓冲区)直接写
+    }
+    else
+    {
+        ::memcpy(buffer_.get() + bufferLen_, logline, len);
+        bufferLen_ += len;
+    }
+    writtenBytes_ += len;
+
+    // 先检查落盘间隔：文件超长但同一秒内无法滚动时，每次append都会走到下面的rollFile()，不能因此跳过落盘
+    int64_t nowMs = monotonicMs();
+    if (nowMs - lastFlushMs_ >= flushIntervalMs_)
+    {
+        flushUnlocked();
+        time_t now = ::time(nullptr);
+        if (now / rollPeriodSeconds_ * rollPeriodSeconds_ != startOfPeriod_)
+        {
+            rollFile();
+            return;
+        }
+    }
+
+    if (writtenBytes_ > rollSize_)
+    {
+        rollFile();
+    }
+}
+
+void LogFile::flushUnlocked()
+{
+    if (bufferLen_ > 0)
+    {
+        writeToFile(buffer_.get(), bufferLen_);
+        bufferLen_ = 0;
+    }
+    lastFlushMs_ = monotonicMs();
+}
+
+void LogFile::writeToFile(const char *data, size_t len)
+{
+    if (fd_ < 0)
+    {
+        return;
+    }
+    while (len > 0)
+    {
+        ssize_t n = ::write(fd_, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "LogFile: write %s error: %d\n", filename_.c_str(), errno);
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+bool LogFile::rollFile()
+{
+    time_t now = ::time(nullptr);
+    if (now <= lastRoll_)
+    {
+        return false; // 文件名精确到秒，同一秒内继续写当前文件
+    }
+
+    flushUnlocked();
+    std::string filename = getLogFileName(now);
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "LogFile: open %s error: %d\n", filename.c_str(), errno);
+        return false;
+    }
+    // 一次性预留磁盘块，避免边写边分配带来的碎片和元数据更新；不支持的文件系统忽略即可
+    if (preallocateSize_ > 0 && ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, preallocateSize_) < 0
+        && errno != EOPNOTSUPP && errno != ENOSYS)
+    {
+        fprintf(stderr, "LogFile: fallocate %s error: %d\n", filename.c_str(), errno);
+    }
+
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+    fd_ = fd;
+    filename_ = filename;
+    writtenBytes_ = 0;
+    lastRoll_ = now;
+    startOfPeriod_ = now / rollPeriodSeconds_ * rollPeriodSeconds_;
+    return true;
+}
+
+std::string LogFile::getLogFileName(time_t now) const
+{
+    char timebuf[32];
+    struct tm tm;
+    ::localtime_r(&now, &tm);
+    ::strftime(timebuf, sizeof(timebuf), ".%Y%m%d-%H%M%S.", &tm);
+
+    char hostname[256];
+    if (::gethostname(hostname, sizeof(hostname)) == 0)
+    {
+        hostname[sizeof(hostname) - 1] = '\0';
+    }
+    else
+    {
+        ::strcpy(hostname, "unknownhost");
+    }
+
+    char pidbuf[32];
+    snprintf(pidbuf, sizeof(pidbuf), ".%d.log", ::getpid());
+
+    std::string filename(basename_);
+    filename += timebuf;
+    filename += hostname;
+    filename += pidbuf;
+    return filename;
+}
@@ -6,6 +6,8 @@
 #include "Logger.h"
 #include "Timestamp.h"
 
+std::atomic_int Logger::logLevel_(MUDUO_MIN_LOG_LEVEL);
+
 Logger::Logger()
 {
     openLogFiles();
@@ -48,15 +50,10 @@ Logger &Logger::instance()
     return logger;
 }
 
-void Logger::setLogLevel(int level)
-{
-    logLevel_ = level;
-}
-
-void Logger::log(std::string msg)
+void Logger::log(int level, const char *msg)
 {
-    std::string pre = "";
-    switch(logLevel_)
+    const char *pre = "";
+    switch(level)
     {
     case INFO:
         pre = "[INFO]";
@@ -73,13 +70,44 @@ void Logger::log(std::string msg)
     default:
         break;
     }
-    std::string logLine = pre + Timestamp::now().toString() + " : " + msg + "\n";
-    auto it = logFiles_.find(logLevel_);
-    if (it != logFiles_.end() && it->second && it->second->is_open())
+    // 整行在栈上格式化，级别随行首前缀一起交给输出端
+    char logLine[1200];
+    char timebuf[32];
+    Timestamp::now().toFormattedString(timebuf, sizeof(timebuf));
+    int len = snprintf(logLine, sizeof(logLine), "%s%s : %s\n", pre, timebuf, msg);
+    if (len < 0)
     {
-        *(it->second) << logLine;
-        it->second->flush();
+        return;
+    }
+    if (static_cast<size_t>(len) >= sizeof(logLine))
+    {
+        len = sizeof(logLine) - 1;
+        logLine[len - 1] = '\n';
+    }
+
+    if (output_)
+    {
+        output_(logLine, len);
+    }
+    else
+    {
+        defaultOutput(level, logLine, len);
+    }
+    if (level == FATAL && flush_)
+    {
+        flush_();
     }
     // 也可以选择是否继续输出到控制台
     // std::cout << logLine;
-}
\ No newline at end of file
+}
+
+void Logger::defaultOutput(int level, const char *msg, size_t len)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = logFiles_.find(level);
+    if (it != logFiles_.end() && it->second && it->second->is_open())
+    {
+        it->second->write(msg, len);
+        it->second->flush();
+    }
+}
@@ -1,13 +1,50 @@
+#include <algorithm>
+
 #include "Poller.h"
 #include "Channel.h"
 
 Poller::Poller(EventLoop *loop)
-    : ownerLoop_(loop)
+    : numChannels_(0)
+    , ownerLoop_(loop)
 {
 }
 
 bool Poller::hasChannel(Channel *channel) const
 {
-    auto it = channels_.find(channel->fd());
-    return it != channels_.end() && it->second == channel;
+    return findChannel(channel->fd()) == channel;
+}
+
+int Poller::registeredEvents(Channel *channel) const
+{
+    return hasChannel(channel) ? channels_[channel->fd()].events : 0;
+}
+
+uint32_t Poller::addChannel(Channel *channel)
+{
+    size_t fd = static_cast<size_t>(channel->fd());
+    if (fd >= channels_.size())
+    {
+        // 按2倍扩容，避免fd逐个增长时反复搬移
+        ChannelSlot empty = {nullptr, 0, 0};
+        channels_.resize(std::max(fd + 1, channels_.size() * 2), empty);
+    }
+    ChannelSlot &slot = channels_[fd];
+    if (slot.channel == nullptr)
+    {
+        ++numChannels_;
+    }
+    slot.channel = channel;
+    slot.events = 0;
+    return ++slot.generation;
+}
+
+void Poller::eraseChannel(Channel *channel)
+{
+    size_t fd = static_cast<size_t>(channel->fd());
+    if (fd < channels_.size() && channels_[fd].channel == channel)
+    {
+        channels_[fd].channel = nullptr;
+        channels_[fd].events = 0;
+        --numChannels_;
+    }
 }
\ No newline at end of file
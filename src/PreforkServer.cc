@@ -0,0 +1,379 @@
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <new>
+
+#include "PreforkServer.h"
+#include "TcpServer.h"
+#include "Logger.h"
+
+namespace
+{
+const int64_t kSupervisorTickUs = 20 * 1000;
+const double kPublishInterval = 0.1;        // worker发布统计的间隔(秒)
+const int64_t kMinLifetimeUs = 1000 * 1000; // 活不到这么久就退出的worker按指数退避重启
+const double kMaxBackoff = 5.0;
+
+// supervisor和worker各有一份(fork之后互不影响)，只在信号处理函数和轮询中访问
+volatile sig_atomic_t g_stopRequested = 0;
+
+void onStopSignal(int)
+{
+    g_stopRequested = 1;
+}
+
+int64_t nowMicroSeconds()
+{
+    return Timestamp::now().microSecondsSinceEpoch();
+}
+} // namespace
+
+PreforkServer::PreforkServer(const InetAddress &listenAddr,
+                             const std::string &nameArg,
+                             int numWorkers,
+                             Option option)
+    : listenAddr_(listenAddr)
+    , name_(nameArg)
+    , numWorkers_(std::max(numWorkers, 1))
+    , option_(option)
+    , drainSeconds_(5.0)
+    , hangTimeout_(0.0)
+    , reportInterval_(0.0)
+    , stats_(nullptr)
+    , statsBytes_(sizeof(WorkerStats) * numWorkers_)
+    , localIndex_(-1)
+{
+    void *page = ::mmap(nullptr, statsBytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(page == MAP_FAILED)
+    {
+        LOG_FATAL("%s:%s:%d mmap stats page err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    stats_ = static_cast<WorkerStats *>(page);
+    for(int i = 0; i < numWorkers_; ++i)
+    {
+        new (&stats_[i]) WorkerStats();
+    }
+}
+
+PreforkServer::~PreforkServer()
+{
+    ::munmap(stats_, statsBytes_);
+    if(!unixPath_.empty())
+    {
+        Socket::removeUnixSocketFile(unixPath_.c_str());
+    }
+}
+
+void PreforkServer::createListenSockets()
+{
+    // Unix域socket不能多个socket绑定同一地址
+    int count = (option_ == kReusePortPerWorker && !listenAddr_.isUnix()) ? numWorkers_ : 1;
+    if(listenAddr_.isUnix() && !listenAddr_.isAbstract())
+    {
+        unixPath_ = listenAddr_.toIp();
+        Socket::removeUnixSocketFile(unixPath_.c_str());
+    }
+    for(int i = 0; i < count; ++i)
+    {
+        int sockfd = ::socket(listenAddr_.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                              listenAddr_.isUnix() ? 0 : IPPROTO_TCP);
+        if(sockfd < 0)
+        {
+            LOG_FATAL("%s:%s:%d listen socket create err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+        }
+        std::unique_ptr<Socket> socket(new Socket(sockfd));
+        if(!listenAddr_.isUnix())
+        {
+            socket->setReuseAddr(true);
+            socket->setReusePort(count > 1);
+            if(count > 1 && !cpus_.empty())
+            {
+                socket->setIncomingCpu(cpus_[i % cpus_.size()]);
+            }
+        }
+        socket->bindAddress(listenAddr_);
+        socket->listen();
+        listenSockets_.push_back(std::move(socket));
+    }
+}
+
+void PreforkServer::run()
+{
+    if(listenSockets_.empty())
+    {
+        createListenSockets();
+    }
+    struct sigaction sa;
+    ::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onStopSignal;
+    ::sigemptyset(&sa.sa_mask);
+    ::sigaction(SIGTERM, &sa, nullptr);
+    ::sigaction(SIGINT, &sa, nullptr);
+
+    g_stopRequested = 0;
+    workers_.assign(numWorkers_, Worker());
+    for(int i = 0; i < numWorkers_; ++i)
+    {
+        spawn(i);
+    }
+    LOG_INFO("PreforkServer::run [%s] - %d worker(s) on %s, %lu listen socket(s)\n", name_.c_str(), numWorkers_,
+             listenAddr_.toIpPort().c_str(), static_cast<unsigned long>(listenSockets_.size()));
+
+    int64_t nextReport = nowMicroSeconds() + static_cast<int64_t>(reportInterval_ * Timestamp::kMicroSecondsPerSecond);
+    while(!g_stopRequested)
+    {
+        int status;
+        pid_t pid;
+        while((pid = ::waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            reap(pid, status);
+        }
+        int64_t now = nowMicroSeconds();
+        for(int i = 0; i < numWorkers_; ++i)
+        {
+            if(workers_[i].pid == 0 && workers_[i].restartAt > 0 && workers_[i].restartAt <= now)
+            {
+                spawn(i);
+            }
+        }
+        if(hangTimeout_ > 0)
+        {
+            checkHungWorkers(now);
+        }
+        if(reportCallback_ && reportInterval_ > 0 && now >= nextReport)
+        {
+            reportCallback_(totals());
+            nextReport = now + static_cast<int64_t>(reportInterval_ * Timestamp::kMicroSecondsPerSecond);
+        }
+        ::usleep(kSupervisorTickUs);
+    }
+    shutdownWorkers();
+}
+
+void PreforkServer::stop()
+{
+    g_stopRequested = 1;
+}
+
+void PreforkServer::spawn(int index)
+{
+    Worker &worker = workers_[index];
+    WorkerStats &stats = stats_[index];
+    int64_t now = nowMicroSeconds();
+    // 在fork之前清零，读者不会看到上一代worker的计数混进新一代
+    stats.heartbeat = now;
+    stats.connections = 0;
+    stats.rejectedConnections = 0;
+    stats.busyMicroSeconds = 0;
+    for(std::atomic<uint64_t> &counter : stats.counters)
+    {
+        counter = 0;
+    }
+    if(worker.startTime != 0)
+    {
+        ++stats.restarts;
+    }
+
+    pid_t supervisor = ::getpid();
+    pid_t pid = ::fork();
+    if(pid < 0)
+    {
+        LOG_ERROR("%s:%s:%d fork worker %d err:%d\n", __FILE__, __FUNCTION__, __LINE__, index, errno);
+        worker.restartAt = now + kMinLifetimeUs;
+        return;
+    }
+    if(pid == 0)
+    {
+        // supervisor退出时worker收到SIGTERM；prctl之前supervisor就已退出的话直接结束
+        ::prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if(::getppid() != supervisor)
+        {
+            ::_exit(1);
+        }
+        runWorker(index);
+    }
+    worker.pid = pid;
+    worker.startTime = now;
+    worker.restartAt = 0;
+    stats.pid = pid;
+    LOG_INFO("PreforkServer::spawn [%s] - worker %d started, pid %d\n", name_.c_str(), index, pid);
+}
+
+void PreforkServer::runWorker(int index)
+{
+    localIndex_ = index;
+    g_stopRequested = 0;
+    if(!cpus_.empty())
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpus_[index % cpus_.size()], &cpuset);
+        if(::sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0)
+        {
+            LOG_ERROR("%s:%s:%d sched_setaffinity err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+        }
+    }
+    // 只保留自己的监听socket，其他worker的留在supervisor中
+    size_t mine = listenSockets_.size() == 1 ? 0 : static_cast<size_t>(index);
+    for(size_t i = 0; i < listenSockets_.size(); ++i)
+    {
+        if(i != mine)
+        {
+            ::close(listenSockets_[i]->fd());
+        }
+    }
+
+    {
+        EventLoop loop;
+        TcpServer server(&loop, std::vector<int>(1, listenSockets_[mine]->fd()), name_ + "-" + std::to_string(index));
+        if(workerSetup_)
+        {
+            workerSetup_(server, index);
+        }
+        server.start();
+
+        WorkerStats &stats = stats_[index];
+        bool draining = false;
+        loop.runEvery(kPublishInterval, [&]() {
+            stats.heartbeat = nowMicroSeconds();
+            stats.connections = server.connectionCount();
+            stats.rejectedConnections = server.rejectedConnections();
+            stats.busyMicroSeconds = loop.busyMicroSeconds();
+            if(g_stopRequested && !draining)
+            {
+                draining = true;
+                server.drain(drainSeconds_, [&loop](bool) { loop.quit(); });
+            }
+        });
+        loop.loop();
+    }
+    // 不运行supervisor那份对象的析构函数，也不冲刷从supervisor继承的stdio缓冲区
+    ::_exit(0);
+}
+
+void PreforkServer::reap(pid_t pid, int status)
+{
+    for(int i = 0; i < numWorkers_; ++i)
+    {
+        Worker &worker = workers_[i];
+        if(worker.pid != pid)
+        {
+            continue;
+        }
+        worker.pid = 0;
+        stats_[i].pid = 0;
+        if(WIFSIGNALED(status))
+        {
+            LOG_ERROR("PreforkServer::reap [%s] - worker %d (pid %d) killed by signal %d\n",
+                      name_.c_str(), i, pid, WTERMSIG(status));
+        }
+        else
+        {
+            LOG_ERROR("PreforkServer::reap [%s] - worker %d (pid %d) exited with status %d\n",
+                      name_.c_str(), i, pid, WEXITSTATUS(status));
+        }
+        // 启动后很快就退出(如配置错误、启动时崩溃)时按指数退避，避免崩溃循环占满CPU
+        int64_t now = nowMicroSeconds();
+        if(now - worker.startTime < kMinLifetimeUs)
+        {
+            worker.backoff = std::min(std::max(worker.backoff * 2, 0.1), kMaxBackoff);
+        }
+        else
+        {
+            worker.backoff = 0.0;
+        }
+        worker.restartAt = now + static_cast<int64_t>(worker.backoff * Timestamp::kMicroSecondsPerSecond);
+        return;
+    }
+}
+
+void PreforkServer::checkHungWorkers(int64_t now)
+{
+    int64_t timeout = static_cast<int64_t>(hangTimeout_ * Timestamp::kMicroSecondsPerSecond);
+    for(int i = 0; i < numWorkers_; ++i)
+    {
+        const Worker &worker = workers_[i];
+        if(worker.pid > 0 && now - worker.startTime > timeout && now - stats_[i].heartbeat > timeout)
+        {
+            LOG_ERROR("PreforkServer::checkHungWorkers [%s] - worker %d (pid %d) stopped publishing, killing it\n",
+                      name_.c_str(), i, worker.pid);
+            ::kill(worker.pid, SIGKILL);
+        }
+    }
+}
+
+void PreforkServer::shutdownWorkers()
+{
+    LOG_INFO("PreforkServer::run [%s] - stopping workers\n", name_.c_str());
+    for(const Worker &worker : workers_)
+    {
+        if(worker.pid > 0)
+        {
+            ::kill(worker.pid, SIGTERM);
+        }
+    }
+    // worker先优雅退出，超时后再强杀
+    int64_t deadline = nowMicroSeconds() + static_cast<int64_t>((drainSeconds_ + 1.0) * Timestamp::kMicroSecondsPerSecond);
+    for(;;)
+    {
+        int live = 0;
+        for(int i = 0; i < numWorkers_; ++i)
+        {
+            Worker &worker = workers_[i];
+            if(worker.pid > 0 && ::waitpid(worker.pid, nullptr, WNOHANG) == worker.pid)
+            {
+                worker.pid = 0;
+                stats_[i].pid = 0;
+            }
+            live += worker.pid > 0;
+        }
+        if(live == 0)
+        {
+            break;
+        }
+        if(nowMicroSeconds() > deadline)
+        {
+            for(int i = 0; i < numWorkers_; ++i)
+            {
+                Worker &worker = workers_[i];
+                if(worker.pid > 0)
+                {
+                    LOG_ERROR("PreforkServer::run [%s] - worker %d (pid %d) did not exit in time, killing it\n",
+                              name_.c_str(), i, worker.pid);
+                    ::kill(worker.pid, SIGKILL);
+                    ::waitpid(worker.pid, nullptr, 0);
+                    worker.pid = 0;
+                    stats_[i].pid = 0;
+                }
+            }
+            break;
+        }
+        ::usleep(kSupervisorTickUs);
+    }
+}
+
+PreforkServer::Totals PreforkServer::totals() const
+{
+    Totals totals;
+    for(int i = 0; i < numWorkers_; ++i)
+    {
+        const WorkerStats &stats = stats_[i];
+        totals.liveWorkers += stats.pid.load(std::memory_order_relaxed) > 0;
+        totals.restarts += stats.restarts.load(std::memory_order_relaxed);
+        totals.connections += stats.connections.load(std::memory_order_relaxed);
+        totals.rejectedConnections += stats.rejectedConnections.load(std::memory_order_relaxed);
+        totals.busyMicroSeconds += stats.busyMicroSeconds.load(std::memory_order_relaxed);
+        for(int c = 0; c < kMaxCounters; ++c)
+        {
+            totals.counters[c] += stats.counters[c].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
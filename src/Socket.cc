@@ -1,9 +1,11 @@
+#include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <string.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 #include "Socket.h"
 #include "Logger.h"
@@ -11,14 +13,26 @@
 
 Socket::~Socket()
 {
-    ::close(sockfd_);
+    if (sockfd_ >= 0)
+    {
+        ::close(sockfd_);
+    }
+}
+
+void Socket::close()
+{
+    if (sockfd_ >= 0)
+    {
+        ::close(sockfd_);
+        sockfd_ = -1;
+    }
 }
 
 void Socket::bindAddress(const InetAddress &localaddr)
 {
-    if( 0 != ::bind(sockfd_, (sockaddr *)localaddr.getSockAddr(), sizeof(sockaddr_in)))
+    if( 0 != ::bind(sockfd_, localaddr.getSockAddr(), localaddr.length()))
     {
-        LOG_FATAL("%s:%s:%d bind sockfd:%d fail\n", __FILE__, __FUNCTION__, __LINE__, sockfd_);
+        LOG_FATAL("%s:%s:%d bind sockfd:%d to %s fail, errno:%d\n", __FILE__, __FUNCTION__, __LINE__, sockfd_, localaddr.toIpPort().c_str(), errno);
     }
 }
 
@@ -32,13 +46,13 @@ void Socket::listen()
 
 int Socket::accept(InetAddress *peeraddr)
 {
-    sockaddr_in addr;
+    sockaddr_storage addr;
     socklen_t len = sizeof(addr);
     ::memset(&addr, 0, len);
     int connfd = ::accept4(sockfd_, (sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if(connfd >= 0)
     {
-        peeraddr->setSockAddr(addr);
+        peeraddr->setSockAddr((sockaddr *)&addr, len);
     }
     return connfd;
 }
@@ -69,6 +83,22 @@ void Socket::setReusePort(bool on)
     ::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
 }
 
+void Socket::setIncomingCpu(int cpu)
+{
+    ::setsockopt(sockfd_, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+}
+
+bool Socket::setMaxPacingRate(uint64_t bytesPerSecond)
+{
+    // 较老的内核只接受32位的值
+    if(bytesPerSecond < UINT32_MAX)
+    {
+        uint32_t rate = static_cast<uint32_t>(bytesPerSecond);
+        return ::setsockopt(sockfd_, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) == 0;
+    }
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_MAX_PACING_RATE, &bytesPerSecond, sizeof(bytesPerSecond)) == 0;
+}
+
 void Socket::setKeepAlive(bool on)
 {
     int optval = on ? 1 : 0;
@@ -83,4 +113,20 @@ void Socket::setKeepAlive(int idle, int interval, int count)
     ::setsockopt(sockfd_, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
     ::setsockopt(sockfd_, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
     ::setsockopt(sockfd_, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
-}
\ No newline at end of file
+}
+
+bool Socket::removeUnixSocketFile(const char *path)
+{
+    struct stat st;
+    if(::lstat(path, &st) < 0)
+    {
+        return errno == ENOENT;
+    }
+    // 只删除socket文件，写错的路径不能把普通文件删掉
+    if(!S_ISSOCK(st.st_mode))
+    {
+        LOG_ERROR("%s:%s:%d %s exists and is not a socket, not removing it\n", __FILE__, __FUNCTION__, __LINE__, path);
+        return false;
+    }
+    return ::unlink(path) == 0 || errno == ENOENT;
+}
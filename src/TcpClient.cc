@@ -0,0 +1,133 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+namespace
+{
+// TcpClient析构后连接仍可能存活，关闭时不能再回调TcpClient
+void detachedRemoveConnection(EventLoop *loop, const TcpConnectionPtr &conn)
+{
+    loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
+} // namespace
+
+TcpClient::TcpClient(EventLoop *loop,
+                     const InetAddress &serverAddr,
+                     const std::string &nameArg)
+    : loop_(loop)
+    , connector_(new Connector(loop, serverAddr))
+    , name_(nameArg)
+    , connectionCallback_([](const TcpConnectionPtr &conn) {
+        LOG_INFO("%s -> %s is %s\n", conn->localAddress().toIpPort().c_str(),
+                 conn->peerAddress().toIpPort().c_str(), conn->connected() ? "UP" : "DOWN");
+    })
+    , messageCallback_([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); })
+    , retry_(false)
+    , connect_(false)
+    , nextConnId_(1)
+{
+    connector_->setNewConnectionCallback(std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+    LOG_INFO("TcpClient::TcpClient[%s] - connector %p\n", name_.c_str(), connector_.get());
+}
+
+TcpClient::~TcpClient()
+{
+    LOG_INFO("TcpClient::~TcpClient[%s] - connector %p\n", name_.c_str(), connector_.get());
+    TcpConnectionPtr conn;
+    bool unique = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unique = connection_.use_count() == 1;
+        conn = connection_;
+    }
+    if(conn)
+    {
+        // 连接交给自己的关闭流程收尾，不再回调本对象
+        EventLoop *loop = loop_;
+        loop_->runInLoop([conn, loop]() {
+            conn->setCloseCallback(std::bind(&detachedRemoveConnection, loop, std::placeholders::_1));
+        });
+        if(unique)
+        {
+            // 没有别人持有连接，等对端关闭的话连接会在Channel注销前析构；
+            // forceClose投递的回调持有连接，关闭流程再由loop持有它执行connectDestroyed
+            conn->forceClose();
+        }
+        else
+        {
+            // 别人还持有连接，何时析构不由本对象决定，先在loop中注销Channel；对端已先关闭时关闭流程已投递过connectDestroyed
+            loop_->queueInLoop([conn]() {
+                if(!conn->disconnected())
+                {
+                    conn->connectDestroyed();
+                }
+            });
+        }
+    }
+    else
+    {
+        connector_->stop();
+    }
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO("TcpClient::connect[%s] - connecting to %s\n", name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    TcpConnectionPtr conn = connection();
+    if(conn)
+    {
+        conn->shutdown();
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    InetAddress peerAddr(InetAddress::peerAddressOf(sockfd));
+    char buf[64];
+    snprintf(buf, sizeof(buf), ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
+    ++nextConnId_;
+    std::string connName = name_ + buf;
+
+    TcpConnectionPtr conn(new TcpConnection(loop_, connName, sockfd, InetAddress::localAddressOf(sockfd), peerAddr));
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(std::bind(&TcpClient::removeConnection, this, std::placeholders::_1));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_.reset();
+    }
+    loop_->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if(retry_ && connect_)
+    {
+        LOG_INFO("TcpClient::connect[%s] - reconnecting to %s\n", name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+        connector_->restart();
+    }
+}
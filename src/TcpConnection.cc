@@ -7,6 +7,7 @@
 #include <netinet/tcp.h>
 #include <sys/sendfile.h>
 #include <fcntl.h> // for open
+#include <algorithm>
 #include <unistd.h> // for close
 
 #include "TcpConnection.h"
@@ -30,44 +31,146 @@ TcpConnection::TcpConnection(EventLoop *loop,
                              const InetAddress &localAddr,
                              const InetAddress &peerAddr)
     :loop_(CheckLoopNotNull(loop))
+    , id_(0)
     , name_(nameArg)
     , state_(kConnected)
     , reading_(true)
+    , migrating_(false)
+    , closePending_(false)
+    , busyMicroSeconds_(0)
     , socket_(new Socket(sockfd))
-    , channel_(new Channel(loop, sockfd))
+    , channel_(newChannel(loop, sockfd))
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
     , highWaterMark_(64 * 1024 *1024)
+    , outputBufferCap_(0)
+    , overflowPolicy_(kForceClose)
+    , overflowCloseDelay_(0.0)
+    , droppedMessages_(0)
+    , pacingTimerActive_(false)
 {
-    channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
-    channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
+    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name().c_str(), sockfd);
+    socket_->setKeepAlive(true);
+}
+
+TcpConnection::TcpConnection(EventLoop *loop,
+                             uint64_t id,
+                             std::shared_ptr<const std::string> namePrefix,
+                             int sockfd,
+                             const InetAddress &localAddr,
+                             const InetAddress &peerAddr)
+    :loop_(CheckLoopNotNull(loop))
+    , id_(id)
+    , namePrefix_(std::move(namePrefix))
+    , state_(kConnected)
+    , reading_(true)
+    , migrating_(false)
+    , closePending_(false)
+    , busyMicroSeconds_(0)
+    , socket_(new Socket(sockfd))
+    , channel_(newChannel(loop, sockfd))
+    , localAddr_(localAddr)
+    , peerAddr_(peerAddr)
+    , highWaterMark_(64 * 1024 *1024)
+    , outputBufferCap_(0)
+    , overflowPolicy_(kForceClose)
+    , overflowCloseDelay_(0.0)
+    , droppedMessages_(0)
+    , pacingTimerActive_(false)
+{
+
+    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name().c_str(), sockfd);
     socket_->setKeepAlive(true);
 }
 
 TcpConnection::~TcpConnection()
 {
-    LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d\n", name_.c_str(), channel_->fd(), (int)state_);
+    LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d\n", name().c_str(), channel_->fd(), (int)state_);
+}
+
+Channel *TcpConnection::newChannel(EventLoop *loop, int sockfd)
+{
+    Channel *channel = new Channel(loop, sockfd);
+    channel->setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
+    channel->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
+    channel->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
+    channel->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+    return channel;
+}
+
+bool TcpConnection::inOwnerLoop() const
+{
+    return !migrating_ && getLoop()->isInLoopThread();
+}
+
+int TcpConnection::fd() const
+{
+    return socket_->fd();
+}
+
+const std::string &TcpConnection::name() const
+{
+    if(namePrefix_)
+    {
+        // 大多数连接的名字只在打日志时才用到
+        std::call_once(nameOnce_, [this]() {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "#%lu", static_cast<unsigned long>(id_));
+            name_ = *namePrefix_ + buf;
+        });
+    }
+    return name_;
 }
 
 void TcpConnection::send(const std::string &buf)
 {
     if(state_ == kConnected)
     {
-        if(loop_->isInLoopThread())
+        if(inOwnerLoop())
         {
             sendInLoop(buf.c_str(), buf.size());
         }
         else
         {
-            loop_->runInLoop(std::bind(&TcpConnection::sendInLoop, this, buf.c_str(), buf.size()));
+            // 其他线程的发送按调用顺序排进同一个队列，迁移前后投递到不同loop的发送也不会乱序
+            // buf可能在队列被处理前就被释放，必须拷贝一份
+            EventLoop *loop = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(pendingSendsMutex_);
+                if(pendingSends_.empty())
+                {
+                    loop = getLoop();
+                }
+                pendingSends_.push_back(buf);
+            }
+            // 队列原本不空时已有处理它的回调在排队
+            if(loop)
+            {
+                loop->queueInLoop(std::bind(&TcpConnection::flushPendingSends, shared_from_this()));
+            }
         }
     }
 }
 
+void TcpConnection::flushPendingSends()
+{
+    // 投递后连接开始迁移的，留给attachToLoop在新loop中发出
+    if(!inOwnerLoop())
+    {
+        return;
+    }
+    std::vector<std::string> sends;
+    {
+        std::lock_guard<std::mutex> lock(pendingSendsMutex_);
+        sends.swap(pendingSends_);
+    }
+    for(const std::string &message : sends)
+    {
+        sendInLoop(message.data(), message.size());
+    }
+}
+
 void TcpConnection::sendInLoop(const void *data, size_t len)
 {
     ssize_t nwrote = 0;
@@ -78,9 +181,17 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     {
         LOG_ERROR("%s:%s:%d : disconnected, give up writing.\n", __FILE__, __FUNCTION__, __LINE__);
     }
+    if(state_ == kDisconnecting && closePending_)
+    {
+        // 等待强制关闭期间只把缓冲区中已有的数据发完，send()时还是kConnected、之后才执行的发送也丢弃
+        LOG_DEBUG("TcpConnection::sendInLoop [%s] - force close pending, drop %lu bytes\n",
+                  name().c_str(), static_cast<unsigned long>(len));
+        return;
+    }
     // 如果当前没有注册写事件并且outputBuffer_为空，则可写
     // 如果之前已经注册了写事件，说明之前有数据没写完，等epoll通知时再写
-    if(!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    // 限速时不直接写，数据先进outputBuffer_再按令牌写出
+    if(!paced() && !channel_->isWriting() && outputBuffer_.readableBytes() == 0)
     {
         nwrote = ::write(channel_->fd(), data, len);
         if(nwrote >= 0)
@@ -90,7 +201,7 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
             if(remaining == 0 && writeCompleteCallback_)
             {
                 // 等回调在下一轮事件循环时安全执行，如果用runInLoop立即执行了可能会导致递归调用或栈溢出
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                getLoop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
             }
         }
         else
@@ -114,31 +225,270 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
     {
         // oldLen + remaining为本次写入缓冲区的数据总量
         size_t oldLen = outputBuffer_.readableBytes();
+        if(outputBufferCap_ > 0 && oldLen + remaining > outputBufferCap_
+           && (overflowPolicy_ == kForceClose || nwrote == 0))
+        {
+            handleOutputOverflow(oldLen, len);
+            return;
+        }
         if(oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
         {
-            loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+            getLoop()->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
         }
         // 将所有数据追加到缓冲区，append实现了扩容
         outputBuffer_.append((char *)data + nwrote, remaining);
-        if(!channel_->isWriting())
+        if(paced())
+        {
+            // 正在等令牌或等内核可写时，由定时器或handleWrite接着写
+            if(!pacingTimerActive_ && !channel_->isWriting())
+            {
+                flushPaced();
+            }
+        }
+        else if(!channel_->isWriting())
         {
             channel_->enableWriting();
         }
     }
 }
 
+void TcpConnection::setSendRateLimit(double bytesPerSecond, double burstBytes, bool kernelPacing)
+{
+    if(kernelPacing)
+    {
+        // 取消限速时写入全1，内核即不再限制
+        uint64_t rate = bytesPerSecond > 0 ? static_cast<uint64_t>(bytesPerSecond) : ~static_cast<uint64_t>(0);
+        if(socket_->setMaxPacingRate(rate))
+        {
+            sendBucket_.reset(0, 0);
+            bytesPerSecond = 0;
+        }
+        else
+        {
+            LOG_ERROR("TcpConnection::setSendRateLimit [%s] - SO_MAX_PACING_RATE failed, errno:%d, pacing in user space\n",
+                      name().c_str(), errno);
+        }
+    }
+    if(bytesPerSecond > 0)
+    {
+        sendBucket_.reset(bytesPerSecond, burstBytes > 0 ? burstBytes : std::max(bytesPerSecond * 0.02, 4096.0));
+    }
+    else
+    {
+        sendBucket_.reset(0, 0);
+    }
+    if(!paced() && outputBuffer_.readableBytes() > 0 && !channel_->isWriting())
+    {
+        channel_->enableWriting();
+    }
+}
+
+void TcpConnection::setSharedSendBucket(const std::shared_ptr<TokenBucket> &bucket)
+{
+    sharedSendBucket_ = bucket;
+    if(!paced() && outputBuffer_.readableBytes() > 0 && !channel_->isWriting())
+    {
+        channel_->enableWriting();
+    }
+}
+
+void TcpConnection::flushPaced()
+{
+    size_t readable = outputBuffer_.readableBytes();
+    if(readable == 0)
+    {
+        return;
+    }
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    double tokens = sendBucket_.available(now);
+    if(sharedSendBucket_)
+    {
+        tokens = std::min(tokens, sharedSendBucket_->available(now));
+    }
+    size_t allowance = tokens >= 1 ? std::min(readable, static_cast<size_t>(tokens)) : 0;
+    if(allowance > 0)
+    {
+        ssize_t n = ::write(channel_->fd(), outputBuffer_.peek(), allowance);
+        if(n < 0)
+        {
+            if(errno != EWOULDBLOCK && errno != EAGAIN)
+            {
+                // 连接出错，由读事件发现并关闭
+                LOG_ERROR("TcpConnection::flushPaced [%s] - write err:%d\n", name().c_str(), errno);
+                return;
+            }
+            n = 0;
+        }
+        outputBuffer_.retrieve(n);
+        sendBucket_.consume(n, now);
+        if(sharedSendBucket_)
+        {
+            sharedSendBucket_->consume(n, now);
+        }
+        if(outputBuffer_.readableBytes() == 0)
+        {
+            if(channel_->isWriting())
+            {
+                channel_->disableWriting();
+            }
+            if(writeCompleteCallback_)
+            {
+                getLoop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+            }
+            if(state_ == kDisconnecting)
+            {
+                shutdownInLoop();
+            }
+            return;
+        }
+        if(static_cast<size_t>(n) < allowance)
+        {
+            // 内核发送缓冲区满了，等可写事件
+            if(!channel_->isWriting())
+            {
+                channel_->enableWriting();
+            }
+            return;
+        }
+    }
+
+    // 令牌用完，不关注可写事件(否则LT模式下会一直被唤醒)，等攒够一批令牌再写，避免每次只写几个字节
+    if(channel_->isWriting())
+    {
+        channel_->disableWriting();
+    }
+    if(!pacingTimerActive_)
+    {
+        double remaining = static_cast<double>(outputBuffer_.readableBytes());
+        double delay = sendBucket_.secondsUntil(std::min(remaining, sendBucket_.burst() / 2), now);
+        if(sharedSendBucket_)
+        {
+            delay = std::max(delay, sharedSendBucket_->secondsUntil(std::min(remaining, sharedSendBucket_->burst() / 2), now));
+        }
+        pacingTimerActive_ = true;
+        std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+        getLoop()->runAfter(std::max(delay, 0.001), [weakConn]() {
+            TcpConnectionPtr conn = weakConn.lock();
+            if(conn)
+            {
+                conn->onPacingTimer();
+            }
+        });
+    }
+}
+
+void TcpConnection::onPacingTimer()
+{
+    // 定时器留在原loop上，连接可能已迁走
+    if(!inOwnerLoop())
+    {
+        getLoop()->queueInLoop(std::bind(&TcpConnection::onPacingTimer, shared_from_this()));
+        return;
+    }
+    pacingTimerActive_ = false;
+    if(paced() && (state_ == kConnected || state_ == kDisconnecting))
+    {
+        flushPaced();
+    }
+}
+
 void TcpConnection::shutdown()
 {
     if(state_ == kConnected)
     {
-        setState(kDisconnected);
-        loop_->runInLoop(std::bind(&TcpConnection::shutdownInLoop, this));
+        // 置为kDisconnecting而不是kDisconnected：还有数据没发完时由handleWrite发完后再关闭写端
+        setState(kDisconnecting);
+        getLoop()->runInLoop(std::bind(&TcpConnection::shutdownInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceClose()
+{
+    if(state_ == kConnected || state_ == kDisconnecting)
+    {
+        closePending_ = true;
+        setState(kDisconnecting);
+        getLoop()->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseWithDelay(double seconds)
+{
+    if(state_ == kConnected || state_ == kDisconnecting)
+    {
+        closePending_ = true;
+        setState(kDisconnecting);
+        std::weak_ptr<TcpConnection> weakConn(shared_from_this());
+        // 不延长连接的生命期，期间连接已关闭的话什么也不做
+        getLoop()->runAfter(seconds, [weakConn]() {
+            TcpConnectionPtr conn = weakConn.lock();
+            if(conn)
+            {
+                conn->forceClose();
+            }
+        });
+    }
+}
+
+void TcpConnection::setOutputBufferCap(size_t capBytes, OverflowPolicy policy, double closeDelaySeconds)
+{
+    outputBufferCap_ = capBytes;
+    overflowPolicy_ = policy;
+    overflowCloseDelay_ = closeDelaySeconds;
+}
+
+void TcpConnection::handleOutputOverflow(size_t pendingBytes, size_t messageBytes)
+{
+    if(overflowPolicy_ == kForceClose && state_ != kConnected)
+    {
+        return;     // 已经在关闭中，之前投递的发送直接丢弃
+    }
+    if(outputOverflowCallback_)
+    {
+        getLoop()->queueInLoop(std::bind(outputOverflowCallback_, shared_from_this(), pendingBytes, messageBytes));
+    }
+    if(overflowPolicy_ == kDropMessage)
+    {
+        ++droppedMessages_;
+        return;
+    }
+    LOG_INFO("TcpConnection::handleOutputOverflow [%s] - %lu bytes pending, closing\n",
+             name().c_str(), static_cast<unsigned long>(pendingBytes));
+    if(overflowCloseDelay_ > 0)
+    {
+        forceCloseWithDelay(overflowCloseDelay_);
+    }
+    else
+    {
+        forceClose();
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if(!inOwnerLoop())
+    {
+        getLoop()->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+        return;
+    }
+    if(state_ == kConnected || state_ == kDisconnecting)
+    {
+        // 与对端关闭走同一条路径，通知业务层并从TcpServer/TcpClient中移除
+        handleClose();
     }
 }
 
 void TcpConnection::shutdownInLoop()
 {
-    if(!channel_->isWriting())
+    if(!inOwnerLoop())
+    {
+        getLoop()->queueInLoop(std::bind(&TcpConnection::shutdownInLoop, shared_from_this()));
+        return;
+    }
+    // 迁移途中其他线程先send再shutdown时，数据还在队列中，先放进outputBuffer_
+    flushPendingSends();
+    // 限速时数据可能在等令牌，此时没有关注可写事件，但仍要等它写完
+    if(!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
     {
         socket_->shutdownWrite();
     }
@@ -146,6 +496,7 @@ void TcpConnection::shutdownInLoop()
 
 void TcpConnection::connectEstablished()
 {
+    getLoop()->addConnectionCount(1);
     setState(kConnected);
     channel_->tie(shared_from_this());
     channel_->enableReading();
@@ -160,18 +511,56 @@ void TcpConnection::connectDestroyed()
         channel_->disableAll();
         connectionCallback_(shared_from_this());
     }
+    // kDisconnecting时也要置为kDisconnected，之后执行的forceCloseInLoop等不会再走handleClose回调已销毁的所有者
+    setState(kDisconnected);
     channel_->remove();
+    getLoop()->addConnectionCount(-1);
+}
+
+void TcpConnection::detachFromLoop(EventLoop *target)
+{
+    EventLoop *source = getLoop();
+    // 必须在doPendingFunctors中调用：本轮的activeChannels_已处理完，不会再有旧Channel的事件回调
+    // 旧Channel对象留到attachToLoop中替换，迁移途中不会访问它
+    channel_->disableAll();
+    channel_->remove();
+    source->addConnectionCount(-1);
+    migrating_ = true;
+    loop_.store(target, std::memory_order_release);
+}
+
+void TcpConnection::attachToLoop()
+{
+    EventLoop *target = getLoop();
+    // 新Channel在target的poller上注册，epoll是水平触发，迁移期间到达的数据在注册后会立即上报
+    channel_.reset(newChannel(target, socket_->fd()));
+    channel_->tie(shared_from_this());
+    if(reading_)
+    {
+        channel_->enableReading();
+    }
+    if(outputBuffer_.readableBytes() > 0)
+    {
+        channel_->enableWriting();
+    }
+    target->addConnectionCount(1);
+    migrating_ = false;
+    // 迁移期间其他线程的发送都在队列中，按调用顺序追加在原loop留下的outputBuffer_之后
+    flushPendingSends();
 }
 
 // 读是相对服务器而言的 当对端客户端有数据到达 服务器端检测到EPOLLIN 就会触发该fd上的回调 handleRead读取走对端发来的数据
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
     int savedErrno = 0;
+    int64_t start = Timestamp::now().microSecondsSinceEpoch();
     ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
     if (n > 0) // 有数据到达
     {
         // 已建立连接的用户有可读事件发生了 调用用户传入的回调操作onMessage shared_from_this就是获取了TcpConnection的智能指针
         messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        // 供自动负载均衡挑选最耗CPU的连接
+        busyMicroSeconds_ += Timestamp::now().microSecondsSinceEpoch() - start;
     }
     else if (n == 0) // 客户端断开
     {
@@ -187,7 +576,11 @@ void TcpConnection::handleRead(Timestamp receiveTime)
 
 void TcpConnection::handleWrite()
 {
-    if (channel_->isWriting())
+    if (channel_->isWriting() && paced())
+    {
+        flushPaced();
+    }
+    else if (channel_->isWriting())
     {
         int savedErrno = 0;
         // 将outputBuffer_中的数据写入到sockfd发送出去
@@ -201,7 +594,7 @@ void TcpConnection::handleWrite()
                 if (writeCompleteCallback_)
                 {
                     // TcpConnection对象在其所在的subloop中 向pendingFunctors_中加入回调
-                    loop_->queueInLoop(
+                    getLoop()->queueInLoop(
                         std::bind(writeCompleteCallback_, shared_from_this()));
                 }
                 if (state_ == kDisconnecting)
@@ -245,16 +638,16 @@ void TcpConnection::handleError()
     {
         err = optval;
     }
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d\n", name_.c_str(), err);
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d\n", name().c_str(), err);
 }
 
 // 新增的零拷贝发送函数
 void TcpConnection::sendFile(int fileDescriptor, off_t offset, size_t count) {
     if (connected()) {
-        if (loop_->isInLoopThread()) { // 判断当前线程是否是loop循环的线程
+        if (inOwnerLoop()) { // 判断当前线程是否是loop循环的线程
             sendFileInLoop(fileDescriptor, offset, count);
         }else{ // 如果不是，则唤醒运行这个TcpConnection的线程执行Loop循环
-            loop_->runInLoop(
+            getLoop()->queueInLoop(
                 std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), fileDescriptor, offset, count));
         }
     } else {
@@ -264,6 +657,11 @@ void TcpConnection::sendFile(int fileDescriptor, off_t offset, size_t count) {
 
 // 在事件循环中执行sendfile
 void TcpConnection::sendFileInLoop(int fileDescriptor, off_t offset, size_t count) {
+    if (!inOwnerLoop()) { // 连接已迁移到其他loop
+        getLoop()->queueInLoop(
+            std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), fileDescriptor, offset, count));
+        return;
+    }
     ssize_t bytesSent = 0; // 发送了多少字节数
     size_t remaining = count; // 还有多少数据要发送
     bool faultError = false; // 错误的标志位
@@ -280,7 +678,7 @@ void TcpConnection::sendFileInLoop(int fileDescriptor, off_t offset, size_t coun
             remaining -= bytesSent;
             if (remaining == 0 && writeCompleteCallback_) {
                 // remaining为0意味着数据正好全部发送完，就不需要给其设置写事件的监听。
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                getLoop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
             }
         } else { // bytesSent < 0
             if (errno != EWOULDBLOCK) { // 如果是非阻塞没有数据返回错误这个是正常显现等同于EAGAIN，否则就异常情况
@@ -294,7 +692,7 @@ void TcpConnection::sendFileInLoop(int fileDescriptor, off_t offset, size_t coun
     // 处理剩余数据
     if (!faultError && remaining > 0) {
         // 继续发送剩余数据
-        loop_->queueInLoop(
+        getLoop()->queueInLoop(
             std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), fileDescriptor, offset, remaining));
     }
 }
\ No newline at end of file
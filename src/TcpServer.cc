@@ -1,10 +1,15 @@
+#include <algorithm>
 #include <functional>
 #include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "TcpServer.h"
 #include "Logger.h"
 #include "TcpConnection.h"
 
+constexpr double TcpServer::kAdmissionCheckInterval;
+
 // 安全机制，确保baseloop不为空
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
@@ -15,33 +20,127 @@ static EventLoop *CheckLoopNotNull(EventLoop *loop)
     return loop;
 }
 
+// 接管的监听socket绑定的地址
+static InetAddress listenAddressOf(const std::vector<int> &listenFds)
+{
+    if (listenFds.empty())
+    {
+        LOG_FATAL("%s:%s:%d no inherited listen socket!\n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return InetAddress::localAddressOf(listenFds.front());
+}
+
 TcpServer::TcpServer(EventLoop *loop, 
                     const InetAddress &listenAddr, 
                     const std::string &nameArg, 
                     Option option)
+    : TcpServer(loop, listenAddr, nameArg, option, std::vector<int>())
+{
+}
+
+TcpServer::TcpServer(EventLoop *loop,
+                    const std::vector<int> &inheritedListenFds,
+                    const std::string &nameArg,
+                    Option option)
+    : TcpServer(loop, listenAddressOf(inheritedListenFds), nameArg, option, inheritedListenFds)
+{
+}
+
+TcpServer::TcpServer(EventLoop *loop,
+                    const InetAddress &listenAddr,
+                    const std::string &nameArg,
+                    Option option,
+                    const std::vector<int> &inheritedListenFds)
     : loop_(CheckLoopNotNull(loop))
+    , listenAddr_(listenAddr)
     , ipPort_(listenAddr.toIpPort())
     , name_(nameArg)
-    , acceptor_(new Acceptor(loop, listenAddr, option == kReusePort))
+    , connNamePrefix_(std::make_shared<const std::string>(nameArg + "-" + ipPort_))
+    , option_(option)
+    , acceptor_(inheritedListenFds.empty() ? new Acceptor(loop, listenAddr, option != kNoReusePort) : nullptr)
+    , inheritedListenFds_(inheritedListenFds)
     , threadPool_(new EventLoopThreadPool(loop, name_))
     , connectionCallback_()
     , messageCallback_()
-    , nextConnId_(1)
+    , highWaterMark_(0)
+    , outputBufferCap_(0)
+    , overflowPolicy_(TcpConnection::kForceClose)
+    , overflowCloseDelay_(0.0)
+    , overflowDroppedMessages_(0)
+    , overflowClosedConnections_(0)
     , started_(0)
+    , nextConnId_(1)
+    , rebalanceInterval_(0.0)
+    , rebalanceMinImbalance_(0.0)
+    , rebalanceStarted_(false)
+    , migratedConnections_(0)
+    , draining_(false)
+    , liveConnections_(0)
+    , drainForced_(false)
+    , drainTimerActive_(false)
+    , connectionSendRate_(0.0)
+    , serverSendRate_(0.0)
+    , kernelPacing_(false)
+    , admissionTimerActive_(false)
+    , acceptPauses_(0)
+    , shedConnections_(0)
 {
     // 当有新用户连接时，Acceptor类中绑定的acceptChannel_会有读事件发生，执行handleRead()调用TcpServer::newConnection回调
-    acceptor_->setNewConnectionCallback(
-        std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2));
+    if(acceptor_)
+    {
+        acceptor_->setNewConnectionCallback(
+            std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2));
+    }
 }
 
 TcpServer::~TcpServer()
 {
-    for(auto &item : connections_)
+    if(drainTimerActive_ || handoff_ || admissionTimerActive_)
     {
-        TcpConnectionPtr conn(item.second);
-        item.second.reset();
+        loop_->runInLoopAndWait([this]() {
+            if(drainTimerActive_)
+            {
+                loop_->cancel(drainTimer_);
+                drainTimerActive_ = false;
+            }
+            if(admissionTimerActive_)
+            {
+                loop_->cancel(admissionTimer_);
+                admissionTimerActive_ = false;
+            }
+            handoff_.reset();
+        });
+    }
+    if(rebalanceStarted_)
+    {
+        TimerId timer = rebalanceTimer_;
+        EventLoop *loop = loop_;
+        loop_->runInLoopAndWait([loop, timer]() { loop->cancel(timer); });
+    }
 
-        conn->getLoop()->runInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    // 各subloop的Acceptor在自己的线程中析构，等待完成后才能继续，否则可能还在回调本对象
+    for(auto &item : loopAcceptors_)
+    {
+        Acceptor *acceptor = item.second.get();
+        item.first->runInLoopAndWait([acceptor]() { delete acceptor; });
+        item.second.release();
+    }
+
+    // 每个loop在自己的线程中销毁自己的连接，之后这些连接不会再回调本对象
+    for(auto &item : registries_)
+    {
+        ConnectionRegistry *registry = item.second.get();
+        item.first->runInLoopAndWait([registry]() {
+            for(TcpConnectionPtr &conn : registry->connections)
+            {
+                if(conn)
+                {
+                    TcpConnectionPtr guard(conn);
+                    conn.reset();
+                    guard->connectDestroyed();
+                }
+            }
+        });
     }
 }
 
@@ -59,33 +158,248 @@ void TcpServer::start()
     if(started_.fetch_add(1) == 0)
     {
         threadPool_->start(threadInitCallback_);    // 启动底层loop线程池
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        for(EventLoop *ioLoop : threadPool_->getAllLoops())
+        {
+            registries_[ioLoop].reset(new ConnectionRegistry);
+            if(serverSendRate_ > 0)
+            {
+                double rate = serverSendRate_ / threadPool_->getAllLoops().size();
+                registries_[ioLoop]->sendBucket = std::make_shared<TokenBucket>(rate, std::max(rate * 0.02, 4096.0));
+            }
+        }
+        bool pauseOnOverload = admission_ && admission_->limits().action == AdmissionControl::kPauseAccepting;
+
+        // Unix域socket不能多个socket绑定同一地址，仍由main loop上的一个Acceptor接受连接
+        if(option_ == kReusePortPerLoop && !listenAddr_.isUnix() && threadPool_->getAllLoops().front() != loop_)
+        {
+            // 每个subloop绑定自己的监听socket并在本线程中监听，main loop不再接受连接
+            acceptor_.reset();
+            std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+            // 接管的socket依次分给各loop，一个也不能丢下，否则内核分给它的连接没人接受；
+            // 它们设置了SO_REUSEPORT时，多出来的loop再绑定新的socket加入同一组
+            size_t count = loops.size();
+            if(!inheritedListenFds_.empty())
+            {
+                int reuseport = 0;
+                socklen_t len = sizeof(reuseport);
+                ::getsockopt(inheritedListenFds_.front(), SOL_SOCKET, SO_REUSEPORT, &reuseport, &len);
+                count = reuseport ? std::max(loops.size(), inheritedListenFds_.size()) : inheritedListenFds_.size();
+            }
+            for(size_t i = 0; i < count; ++i)
+            {
+                EventLoop *ioLoop = loops[i % loops.size()];
+                std::unique_ptr<Acceptor> acceptor(i < inheritedListenFds_.size()
+                                                   ? new Acceptor(ioLoop, inheritedListenFds_[i])
+                                                   : new Acceptor(ioLoop, listenAddr_, true));
+                if(ioLoop->cpu() >= 0)
+                {
+                    acceptor->setIncomingCpu(ioLoop->cpu());
+                }
+                acceptor->setNewConnectionCallback(
+                    std::bind(&TcpServer::newConnectionInLoop, this, ioLoop, std::placeholders::_1, std::placeholders::_2));
+                if(pauseOnOverload)
+                {
+                    acceptor->setAcceptGate(std::bind(&TcpServer::acceptGate, this, ioLoop));
+                }
+                ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor.get()));
+                loopAcceptors_.emplace_back(ioLoop, std::move(acceptor));
+            }
+        }
+        else if(!acceptor_)
+        {
+            // 接管的监听socket都由main loop接受连接
+            for(int fd : inheritedListenFds_)
+            {
+                std::unique_ptr<Acceptor> acceptor(new Acceptor(loop_, fd));
+                acceptor->setNewConnectionCallback(
+                    std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2));
+                if(pauseOnOverload)
+                {
+                    acceptor->setAcceptGate(std::bind(&TcpServer::acceptGate, this, nullptr));
+                }
+                loop_->runInLoop(std::bind(&Acceptor::listen, acceptor.get()));
+                loopAcceptors_.emplace_back(loop_, std::move(acceptor));
+            }
+        }
+        else
+        {
+            if(pauseOnOverload)
+            {
+                acceptor_->setAcceptGate(std::bind(&TcpServer::acceptGate, this, nullptr));
+            }
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        }
+        inheritedListenFds_.clear();
+
+        if(rebalanceInterval_ > 0 && threadPool_->getAllLoops().size() > 1)
+        {
+            rebalanceStarted_ = true;
+            rebalanceTimer_ = loop_->runEvery(rebalanceInterval_, std::bind(&TcpServer::rebalance, this));
+        }
+        // 暂停的Acceptor要定时恢复，输出缓冲区要定时采样
+        if(admission_ && (pauseOnOverload || admission_->limits().maxOutputBufferBytes > 0
+                          || admission_->limits().shedOutputBufferBytes > 0))
+        {
+            admissionTimerActive_ = true;
+            admissionTimer_ = loop_->runEvery(kAdmissionCheckInterval, std::bind(&TcpServer::checkAdmission, this));
+        }
+    }
+}
+
+void TcpServer::enableAutoRebalance(double intervalSeconds, double minImbalance)
+{
+    rebalanceInterval_ = intervalSeconds;
+    rebalanceMinImbalance_ = minImbalance;
+}
+
+void TcpServer::migrateConnection(const TcpConnectionPtr &conn, EventLoop *target)
+{
+    if(registries_.find(target) == registries_.end())
+    {
+        LOG_ERROR("TcpServer::migrateConnection [%s] - loop %p does not belong to this server\n", name_.c_str(), target);
+        return;
+    }
+    // 即使已在所属loop线程中也要排队，等本轮事件处理完再从poller上注销
+    EventLoop *source = conn->getLoop();
+    source->queueInLoop(std::bind(&TcpServer::migrateInLoop, this, conn, source, target));
+}
+
+void TcpServer::migrateInLoop(const TcpConnectionPtr &conn, EventLoop *source, EventLoop *target)
+{
+    if(conn->getLoop() != source)
+    {
+        // 排队期间已被迁走，到新的loop上重新发起
+        migrateConnection(conn, target);
+        return;
+    }
+    if(conn->migrating())
+    {
+        // 上一次迁移的attachToLoop还没在本loop执行，旧Channel仍属于原loop的poller，等它执行完再迁
+        source->queueInLoop(std::bind(&TcpServer::migrateInLoop, this, conn, source, target));
+        return;
+    }
+    if(!conn->connected() || source == target)
+    {
+        return;
+    }
+    LOG_INFO("TcpServer::migrateConnection [%s] - connection %s from loop %p to %p\n",
+             name_.c_str(), conn->name().c_str(), source, target);
+    registryFor(source)->remove(conn);
+    registryFor(source)->admitted.fetch_sub(1, std::memory_order_relaxed);
+    registryFor(target)->admitted.fetch_add(1, std::memory_order_relaxed);
+    conn->detachFromLoop(target);
+    target->queueInLoop([this, conn, target]() {
+        registryFor(target)->add(conn);
+        // 共用的令牌桶只能在所属loop中使用，换成target的
+        conn->setSharedSendBucket(registryFor(target)->sendBucket);
+        conn->attachToLoop();
+    });
+    migratedConnections_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TcpServer::rebalance()
+{
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    Timestamp now = Timestamp::now();
+    double elapsed = static_cast<double>(now.microSecondsSinceEpoch() - lastRebalance_.microSecondsSinceEpoch());
+    bool firstRound = lastLoopBusy_.empty();
+    lastLoopBusy_.resize(loops.size(), 0);
+    lastRebalance_ = now;
+
+    size_t hottest = 0, coldest = 0;
+    std::vector<double> ratios(loops.size());
+    for(size_t i = 0; i < loops.size(); ++i)
+    {
+        int64_t busy = loops[i]->busyMicroSeconds();
+        ratios[i] = (busy - lastLoopBusy_[i]) / elapsed;
+        lastLoopBusy_[i] = busy;
+        if(ratios[i] > ratios[hottest])
+        {
+            hottest = i;
+        }
+        if(ratios[i] < ratios[coldest])
+        {
+            coldest = i;
+        }
+    }
+
+    double imbalance = ratios[hottest] - ratios[coldest];
+    for(size_t i = 0; i < loops.size(); ++i)
+    {
+        // 每一轮都给所有loop的连接采样，被选中迁出时用的是最近一个周期的数据
+        ConnectionRegistry *registry = registryFor(loops[i]);
+        if(!firstRound && i == hottest && imbalance > rebalanceMinImbalance_)
+        {
+            double budget = imbalance / 2 * Timestamp::kMicroSecondsPerSecond;
+            loops[i]->queueInLoop(std::bind(&TcpServer::moveBusiestConnections, this, loops[hottest], loops[coldest], budget));
+        }
+        else
+        {
+            loops[i]->queueInLoop([registry]() { registry->sample(nullptr); });
+        }
+    }
+}
+
+void TcpServer::moveBusiestConnections(EventLoop *from, EventLoop *to, double budget)
+{
+    std::vector<std::pair<double, TcpConnectionPtr>> rates;
+    registryFor(from)->sample(&rates);
+    std::sort(rates.begin(), rates.end(),
+              [](const std::pair<double, TcpConnectionPtr> &a, const std::pair<double, TcpConnectionPtr> &b) {
+                  return a.first > b.first;
+              });
+
+    double moved = 0;
+    for(const auto &item : rates)
+    {
+        if(item.first <= 0)
+        {
+            break;
+        }
+        // 超出预算的连接跳过：迁走后from反而比to闲，下一轮又会迁回来
+        if(moved + item.first <= budget)
+        {
+            moved += item.first;
+            migrateConnection(item.second, to);
+        }
     }
 }
 
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
-    // 轮询算法 选择一个subLoop来管理connfd对应的channel
-    EventLoop * ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
-    snprintf(buf, sizeof(buf), "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s\n",
-            name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
+    // 按负载均衡策略(默认轮询) 选择一个subLoop来管理connfd对应的channel
+    // main loop只负责转交fd，连接对象在ioLoop线程中创建(内存也就分配在使用它的线程所在的节点上)
+    EventLoop * ioLoop = threadPool_->getNextLoop(peerAddr);
+    if(!admitConnection(sockfd, peerAddr, &ioLoop, true))
+    {
+        return;
+    }
+    ioLoop->runInLoop(std::bind(&TcpServer::establishConnection, this, ioLoop, sockfd, peerAddr));
+}
 
-    // 声明一个local获取sockfd绑定的ip和port
-    sockaddr_in local;
-    ::memset(&local, 0, sizeof(local));
-    socklen_t addrlen = sizeof(local);
-    if(::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+void TcpServer::newConnectionInLoop(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
+{
+    if(admitConnection(sockfd, peerAddr, &ioLoop, false))
     {
-        LOG_ERROR("%s:%s:%d sockets::getLocalAddr err:%d.\n", __FILE__, __FUNCTION__, __LINE__, errno);
+        establishConnection(ioLoop, sockfd, peerAddr);
     }
+}
 
-    InetAddress localAddr(local);
-    TcpConnectionPtr conn(new TcpConnection(ioLoop, connName, sockfd, localAddr, peerAddr));
-    connections_[connName] = conn;
+// 在ioLoop线程中执行
+void TcpServer::establishConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
+{
+    // 获取sockfd绑定的本端地址
+    InetAddress localAddr(InetAddress::localAddressOf(sockfd));
+    if(ioLoop->cpu() >= 0 && !localAddr.isUnix())
+    {
+        // 让之后到达这条连接的数据尽量在处理它的loop所在CPU上完成协议栈处理(配合RPS/RFS或网卡队列绑核)
+        int cpu = ioLoop->cpu();
+        ::setsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+    }
+    TcpConnectionPtr conn(new TcpConnection(ioLoop, nextConnId_.fetch_add(1), connNamePrefix_, sockfd, localAddr, peerAddr));
+    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s\n",
+            name_.c_str(), conn->name().c_str(), peerAddr.toIpPort().c_str());
+    registryFor(ioLoop)->add(conn);
     // 下面的回调都是用户设置给TcpServer => TcpConnection的，至于Channel绑定的则是TcpConnection设置的四个，handleRead,handleWrite... 这下面的回调用于handlexxx函数中
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
@@ -93,20 +407,416 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 
     // 设置了如何关闭连接的回调
     conn->setCloseCallback(std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
+    if(highWaterMarkCallback_)
+    {
+        conn->setHighWaterMarkCallback(highWaterMarkCallback_, highWaterMark_);
+    }
+    if(outputBufferCap_ > 0)
+    {
+        conn->setOutputBufferCap(outputBufferCap_, overflowPolicy_, overflowCloseDelay_);
+        conn->setOutputOverflowCallback(std::bind(&TcpServer::onOutputOverflow, this, std::placeholders::_1,
+                                                  std::placeholders::_2, std::placeholders::_3));
+    }
+    if(connectionSendRate_ > 0)
+    {
+        conn->setSendRateLimit(connectionSendRate_, 0, kernelPacing_);
+    }
+    if(registryFor(ioLoop)->sendBucket)
+    {
+        conn->setSharedSendBucket(registryFor(ioLoop)->sendBucket);
+    }
 
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    // 分配时已经计入了ioLoop的连接数，connectEstablished会再计一次
+    ioLoop->addConnectionCount(-1);
+    conn->connectEstablished();
 }
 
-void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+void TcpServer::setOutputBufferCap(size_t capBytes, TcpConnection::OverflowPolicy policy, double closeDelaySeconds)
 {
-    loop_->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    outputBufferCap_ = capBytes;
+    overflowPolicy_ = policy;
+    overflowCloseDelay_ = closeDelaySeconds;
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+void TcpServer::onOutputOverflow(const TcpConnectionPtr &conn, size_t pendingBytes, size_t messageBytes)
 {
-    LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s\n",
+    if(overflowPolicy_ == TcpConnection::kDropMessage)
+    {
+        overflowDroppedMessages_.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        overflowClosedConnections_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if(outputOverflowCallback_)
+    {
+        outputOverflowCallback_(conn, pendingBytes, messageBytes);
+    }
+}
+
+void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+{
+    LOG_INFO("TcpServer::removeConnection [%s] - connection %s\n",
              name_.c_str(), conn->name().c_str());
-    connections_.erase(conn->name());
     EventLoop *ioLoop = conn->getLoop();
+    registryFor(ioLoop)->remove(conn);
+    registryFor(ioLoop)->admitted.fetch_sub(1, std::memory_order_relaxed);
+    liveConnections_.fetch_sub(1, std::memory_order_relaxed);
+    if(admission_)
+    {
+        admission_->release(conn->peerAddress());
+    }
+    // 不能在handleClose的调用栈中销毁Channel，放到本轮事件处理完之后
     ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
-}
\ No newline at end of file
+}
+
+void TcpServer::drain(double deadlineSeconds, const DrainedCallback &cb)
+{
+    loop_->runInLoop(std::bind(&TcpServer::drainInLoop, this, deadlineSeconds, cb));
+}
+
+void TcpServer::drainInLoop(double deadlineSeconds, const DrainedCallback &cb)
+{
+    if(draining_)
+    {
+        return;
+    }
+    draining_ = true;
+    drainedCallback_ = cb;
+    LOG_INFO("TcpServer::drain [%s] - stop accepting, %lu connection(s) left, deadline %.1fs\n",
+             name_.c_str(), static_cast<unsigned long>(connectionCount()), deadlineSeconds);
+    // 监听socket已交给新进程时只停止accept，fd保持打开，已在内核队列中的连接由新进程接受；
+    // 否则关闭本进程的监听fd，新连接不再进入本进程的accept队列(prefork下其他进程仍在监听)
+    bool handedOff = handoff_ && handoff_->handedOff();
+    void (Acceptor::*stop)() = handedOff ? &Acceptor::stopListening : &Acceptor::closeListening;
+    if(!handedOff)
+    {
+        // 不再接受转交，新进程连不上控制地址时按首次启动自己监听
+        handoff_.reset();
+    }
+    if(acceptor_)
+    {
+        (acceptor_.get()->*stop)();
+    }
+    for(auto &item : loopAcceptors_)
+    {
+        item.first->runInLoop(std::bind(stop, item.second.get()));
+    }
+    drainDeadline_ = addTime(Timestamp::now(), deadlineSeconds);
+    drainTimerActive_ = true;
+    drainTimer_ = loop_->runEvery(0.01, std::bind(&TcpServer::checkDrained, this));
+}
+
+void TcpServer::checkDrained()
+{
+    if(connectionCount() == 0)
+    {
+        loop_->cancel(drainTimer_);
+        drainTimerActive_ = false;
+        LOG_INFO("TcpServer::drain [%s] - all connections closed%s\n", name_.c_str(), drainForced_ ? " (forced)" : "");
+        if(drainedCallback_)
+        {
+            DrainedCallback cb;
+            cb.swap(drainedCallback_);
+            cb(drainForced_);
+        }
+        return;
+    }
+    if(!drainForced_ && drainDeadline_ < Timestamp::now())
+    {
+        drainForced_ = true;
+        LOG_INFO("TcpServer::drain [%s] - deadline reached, closing %lu connection(s)\n",
+                 name_.c_str(), static_cast<unsigned long>(connectionCount()));
+        forEachConnection([](const TcpConnectionPtr &conn) { conn->forceClose(); });
+    }
+}
+
+void TcpServer::forEachConnection(const std::function<void(const TcpConnectionPtr &)> &action)
+{
+    for(auto &item : registries_)
+    {
+        ConnectionRegistry *registry = item.second.get();
+        item.first->runInLoop([registry, action]() {
+            std::vector<TcpConnectionPtr> conns;
+            for(const TcpConnectionPtr &conn : registry->connections)
+            {
+                if(conn)
+                {
+                    conns.push_back(conn);
+                }
+            }
+            for(const TcpConnectionPtr &conn : conns)
+            {
+                action(conn);
+            }
+        });
+    }
+}
+
+void TcpServer::enableHandoff(const InetAddress &controlAddr, double drainSeconds, const DrainedCallback &cb)
+{
+    loop_->runInLoop([this, controlAddr, drainSeconds, cb]() {
+        handoff_.reset(new ListenSocketHandoff(loop_, controlAddr));
+        handoff_->setListenFdsProvider(std::bind(&TcpServer::handOffListenFds, this));
+        handoff_->setHandoffCallback([this, drainSeconds, cb]() { drainInLoop(drainSeconds, cb); });
+        handoff_->start();
+    });
+}
+
+std::vector<int> TcpServer::listenFds() const
+{
+    std::vector<int> fds;
+    if(acceptor_ && acceptor_->fd() >= 0)
+    {
+        fds.push_back(acceptor_->fd());
+    }
+    for(const auto &item : loopAcceptors_)
+    {
+        if(item.second->fd() >= 0)
+        {
+            fds.push_back(item.second->fd());
+        }
+    }
+    return fds;
+}
+
+std::vector<int> TcpServer::handOffListenFds()
+{
+    if(acceptor_)
+    {
+        acceptor_->keepUnixPathOnClose();
+    }
+    for(auto &item : loopAcceptors_)
+    {
+        item.second->keepUnixPathOnClose();
+    }
+    return listenFds();
+}
+
+void TcpServer::setSendRateLimit(double connectionBytesPerSecond, double serverBytesPerSecond, bool kernelPacing)
+{
+    connectionSendRate_ = connectionBytesPerSecond;
+    serverSendRate_ = serverBytesPerSecond;
+    kernelPacing_ = kernelPacing;
+}
+
+void TcpServer::setAdmissionLimits(const AdmissionControl::Limits &limits)
+{
+    admission_.reset(new AdmissionControl(limits));
+}
+
+// 多个loop的Acceptor同时接受连接时，检查和计数之间没有加锁，总数可能超出上限几个
+bool TcpServer::admitConnection(int sockfd, const InetAddress &peerAddr, EventLoop **ioLoop, bool movable)
+{
+    if(admission_)
+    {
+        const AdmissionControl::Limits &limits = admission_->limits();
+        if(movable && limits.maxConnectionsPerLoop > 0 && registryFor(*ioLoop)->admitted >= limits.maxConnectionsPerLoop)
+        {
+            *ioLoop = leastLoadedLoop();
+        }
+        AdmissionControl::Verdict verdict = admission_->admit(connectionCount(), registryFor(*ioLoop)->admitted, outputBufferBytes());
+        if(verdict == AdmissionControl::kAdmit)
+        {
+            verdict = admission_->admitPeer(peerAddr);
+        }
+        if(verdict != AdmissionControl::kAdmit)
+        {
+            admission_->recordRejected(verdict);
+            LOG_DEBUG("TcpServer::admitConnection [%s] - reject %s, over %s limit\n",
+                      name_.c_str(), peerAddr.toIpPort().c_str(), AdmissionControl::verdictName(verdict));
+            // 以RST关闭：对端立即得到ECONNRESET，本端也不会留下TIME_WAIT
+            linger lg;
+            lg.l_onoff = 1;
+            lg.l_linger = 0;
+            ::setsockopt(sockfd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+            ::close(sockfd);
+            return false;
+        }
+    }
+    liveConnections_.fetch_add(1, std::memory_order_relaxed);
+    registryFor(*ioLoop)->admitted.fetch_add(1, std::memory_order_relaxed);
+    // 连接在ioLoop中建立之前就计入，establishConnection中交给connectEstablished前再减掉
+    (*ioLoop)->addConnectionCount(1);
+    return true;
+}
+
+bool TcpServer::acceptGate(EventLoop *acceptLoop)
+{
+    size_t loopConnections = registryFor(acceptLoop ? acceptLoop : leastLoadedLoop())->admitted;
+    if(admission_->admit(connectionCount(), loopConnections, outputBufferBytes(), false) == AdmissionControl::kAdmit)
+    {
+        return true;
+    }
+    acceptPauses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+EventLoop *TcpServer::leastLoadedLoop()
+{
+    EventLoop *least = nullptr;
+    size_t leastCount = 0;
+    for(auto &item : registries_)
+    {
+        size_t count = item.second->admitted;
+        if(least == nullptr || count < leastCount)
+        {
+            least = item.first;
+            leastCount = count;
+        }
+    }
+    return least;
+}
+
+void TcpServer::checkAdmission()
+{
+    const AdmissionControl::Limits &limits = admission_->limits();
+    if(limits.maxOutputBufferBytes > 0 || limits.shedOutputBufferBytes > 0)
+    {
+        // 用上一轮的采样决定这一轮是否削减，各loop在自己的线程中统计和关闭连接
+        size_t total = outputBufferBytes();
+        double keepRatio = 1.0;
+        if(limits.shedOutputBufferBytes > 0 && total > limits.shedOutputBufferBytes)
+        {
+            size_t target = limits.maxOutputBufferBytes > 0 ? limits.maxOutputBufferBytes : limits.shedOutputBufferBytes;
+            keepRatio = static_cast<double>(target) / total;
+            LOG_INFO("TcpServer::checkAdmission [%s] - output buffers hold %lu bytes, shedding down to %lu\n",
+                     name_.c_str(), static_cast<unsigned long>(total), static_cast<unsigned long>(target));
+        }
+        for(auto &item : registries_)
+        {
+            item.first->queueInLoop(std::bind(&TcpServer::sampleOutputBuffers, this, item.second.get(), keepRatio));
+        }
+    }
+    if(limits.action == AdmissionControl::kPauseAccepting && !draining_)
+    {
+        if(acceptor_)
+        {
+            acceptor_->resume();
+        }
+        for(auto &item : loopAcceptors_)
+        {
+            item.first->runInLoop(std::bind(&Acceptor::resume, item.second.get()));
+        }
+    }
+}
+
+void TcpServer::sampleOutputBuffers(ConnectionRegistry *registry, double keepRatio)
+{
+    size_t bytes = 0;
+    std::vector<std::pair<size_t, TcpConnectionPtr>> candidates;
+    for(const TcpConnectionPtr &conn : registry->connections)
+    {
+        if(!conn)
+        {
+            continue;
+        }
+        size_t pending = conn->outputBufferBytes();
+        bytes += pending;
+        // 已在关闭中的连接(包括上一轮削减的)不再计入候选
+        if(keepRatio < 1.0 && pending > 0 && conn->connected())
+        {
+            candidates.emplace_back(pending, conn);
+        }
+    }
+    if(!candidates.empty())
+    {
+        // 积压最多的连接通常就是读得最慢的，先关闭它们，关闭的连接数最少
+        size_t target = static_cast<size_t>(bytes * keepRatio);
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const std::pair<size_t, TcpConnectionPtr> &a, const std::pair<size_t, TcpConnectionPtr> &b) {
+                      return a.first > b.first;
+                  });
+        for(const auto &item : candidates)
+        {
+            if(bytes <= target)
+            {
+                break;
+            }
+            LOG_INFO("TcpServer::sampleOutputBuffers [%s] - shed connection %s with %lu bytes pending\n",
+                     name_.c_str(), item.second->name().c_str(), static_cast<unsigned long>(item.first));
+            item.second->forceClose();
+            bytes -= item.first;
+            shedConnections_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    registry->outputBytes = bytes;
+}
+
+size_t TcpServer::outputBufferBytes() const
+{
+    size_t total = 0;
+    for(const auto &item : registries_)
+    {
+        total += item.second->outputBytes.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t TcpServer::rejectedConnections() const
+{
+    uint64_t total = 0;
+    for(int reason = AdmissionControl::kAdmit + 1; reason < AdmissionControl::kNumVerdicts; ++reason)
+    {
+        total += rejectedConnections(static_cast<AdmissionControl::Verdict>(reason));
+    }
+    return total;
+}
+
+uint64_t TcpServer::rejectedConnections(AdmissionControl::Verdict reason) const
+{
+    return admission_ ? admission_->rejected(reason) : 0;
+}
+
+TcpServer::ConnectionRegistry *TcpServer::registryFor(EventLoop *loop)
+{
+    return registries_.at(loop).get();
+}
+
+void TcpServer::ConnectionRegistry::add(const TcpConnectionPtr &conn)
+{
+    size_t fd = static_cast<size_t>(conn->fd());
+    if(fd >= connections.size())
+    {
+        connections.resize(std::max(fd + 1, connections.size() * 2));
+    }
+    connections[fd] = conn;
+    ++size;
+    if(fd >= busySamples.size())
+    {
+        busySamples.resize(connections.size());
+    }
+    busySamples[fd] = conn->busyMicroSeconds();
+}
+
+void TcpServer::ConnectionRegistry::remove(const TcpConnectionPtr &conn)
+{
+    size_t fd = static_cast<size_t>(conn->fd());
+    if(fd < connections.size() && connections[fd] == conn)
+    {
+        connections[fd].reset();
+        --size;
+    }
+}
+
+
+void TcpServer::ConnectionRegistry::sample(std::vector<std::pair<double, TcpConnectionPtr>> *rates)
+{
+    int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    double elapsedSeconds = static_cast<double>(now - lastSampleTime) / Timestamp::kMicroSecondsPerSecond;
+    bool firstSample = lastSampleTime == 0;
+    lastSampleTime = now;
+    for(size_t fd = 0; fd < connections.size(); ++fd)
+    {
+        if(!connections[fd])
+        {
+            continue;
+        }
+        int64_t busy = connections[fd]->busyMicroSeconds();
+        if(rates && !firstSample)
+        {
+            rates->emplace_back((busy - busySamples[fd]) / elapsedSeconds, connections[fd]);
+        }
+        busySamples[fd] = busy;
+    }
+}
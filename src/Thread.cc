@@ -1,6 +1,7 @@
 #include "Thread.h"
 #include "CurrentThread.h"
 
+#include <pthread.h>
 #include <semaphore.h>
 
 std::atomic_int Thread::numCreated_(0);
@@ -31,6 +32,8 @@ void Thread::start()                                                        // 
     // 开启线程
     thread_ = std::shared_ptr<std::thread>(new std::thread([&]() {
         tid_ = CurrentThread::tid();                                        // 获取线程的tid值
+        // 线程名在top -H、perf、gdb中可见，内核限制最长15个字符
+        ::pthread_setname_np(::pthread_self(), name_.substr(0, 15).c_str());
         sem_post(&sem);
         func_();                                                            // 开启一个新线程 专门执行该线程函数
     }));
@@ -1,4 +1,6 @@
 #include <sys/time.h>
+#include <string.h>
+#include <time.h>
 #include "Timestamp.h"
 
 Timestamp::Timestamp() : microSecondsSinceEpoch_(0)
@@ -19,17 +21,59 @@ Timestamp Timestamp::now()
 
 std::string Timestamp::toString() const
 {
-    char buf[128];
-    int64_t seconds = microSecondsSinceEpoch_ / kMicroSecondsPerSecond;
-    tm *time_t = localtime(&seconds);
-    int64_t microseconds = microSecondsSinceEpoch_ % kMicroSecondsPerSecond;
-    snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d.%06ld",
-        time_t->tm_year + 1900,
-        time_t->tm_mon + 1,
-        time_t->tm_mday,
-        time_t->tm_hour,
-        time_t->tm_min,
-        time_t->tm_sec,
-        microseconds);
+    char buf[32];
+    toFormattedString(buf, sizeof(buf));
     return buf;
 }
+
+namespace
+{
+// 每个线程缓存最近一次格式化的秒数及其 "YYYY/MM/DD HH:MM:SS" 前缀
+__thread int64_t t_cachedSecond = -1;
+__thread char t_cachedPrefix[32];
+__thread int t_cachedPrefixLen = 0;
+} // namespace
+
+size_t Timestamp::toFormattedString(char *buf, size_t len, bool showMicroseconds) const
+{
+    int64_t seconds = microSecondsSinceEpoch_ / kMicroSecondsPerSecond;
+    if (seconds != t_cachedSecond)
+    {
+        // localtime_r可重入，且每个线程每秒只调用一次
+        time_t t = static_cast<time_t>(seconds);
+        struct tm tm;
+        localtime_r(&t, &tm);
+        t_cachedPrefixLen = snprintf(t_cachedPrefix, sizeof(t_cachedPrefix), "%4d/%02d/%02d %02d:%02d:%02d",
+                                     tm.tm_year + 1900,
+                                     tm.tm_mon + 1,
+                                     tm.tm_mday,
+                                     tm.tm_hour,
+                                     tm.tm_min,
+                                     tm.tm_sec);
+        t_cachedSecond = seconds;
+    }
+
+    size_t total = t_cachedPrefixLen + (showMicroseconds ? 7 : 0);
+    if (len <= total)
+    {
+        if (len > 0)
+        {
+            buf[0] = '\0';
+        }
+        return 0;
+    }
+    memcpy(buf, t_cachedPrefix, t_cachedPrefixLen);
+    if (showMicroseconds)
+    {
+        int microseconds = static_cast<int>(microSecondsSinceEpoch_ % kMicroSecondsPerSecond);
+        char *p = buf + total;
+        for (int i = 0; i < 6; ++i)
+        {
+            *--p = static_cast<char>('0' + microseconds % 10);
+            microseconds /= 10;
+        }
+        *--p = '.';
+    }
+    buf[total] = '\0';
+    return total;
+}
@@ -34,11 +34,11 @@ struct timespec howMuchTimeFromNow(Timestamp when)
     return ts;
 }
 
-void readTimerfd(int timerfd, Timestamp now)
+void readTimerfd(int timerfd)
 {
     uint64_t howmany;
     ssize_t n = ::read(timerfd, &howmany, sizeof(howmany));
-    LOG_INFO("TimerQueue:%s : %lu at %s\n", __FUNCTION__, howmany, now.toString().c_str());
+    LOG_DEBUG("TimerQueue:%s : %lu\n", __FUNCTION__, howmany);
     if(n != sizeof(howmany))
     {
         LOG_ERROR("%s:%s reads %ld bytes instead of 8\n", __FILE__, __FUNCTION__, n);
@@ -142,7 +142,7 @@ void TimerQueue::handleRead()
         LOG_FATAL("TimerQueue::handleRead() : the thread is not in loop");
     }
     Timestamp now(Timestamp::now());
-    readTimerfd(timerfd_, now);
+    readTimerfd(timerfd_);
 
     std::vector<Entry> expired = getExpired(now);
 
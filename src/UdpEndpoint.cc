@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#include "UdpEndpoint.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+// 较老的glibc头文件中没有这两个选项(Linux 4.18/5.0起支持)
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+namespace
+{
+const size_t kGroBufferSize = 65536;
+const size_t kMaxGsoSegments = 64;          // 内核限制UDP_MAX_SEGMENTS
+const size_t kMaxGsoBytes = 65507 - 8;      // 合并后仍要放进一个UDP报文
+} // namespace
+
+UdpEndpoint::UdpEndpoint(EventLoop *loop, int sockfd, const Options &options, const DatagramCallback &cb)
+    : loop_(loop)
+    , sockfd_(sockfd)
+    , options_(options)
+    , channel_(loop, sockfd)
+    , datagramCallback_(cb)
+    , inReceiveBatch_(false)
+    , bufferSize_(0)
+    , receivedDatagrams_(0)
+    , receiveCalls_(0)
+    , sentDatagrams_(0)
+    , sendCalls_(0)
+    , droppedSends_(0)
+    , truncatedDatagrams_(0)
+{
+    if(options_.batchSize < 1)
+    {
+        options_.batchSize = 1;
+    }
+    if(options_.gro)
+    {
+        int on = 1;
+        if(::setsockopt(sockfd_, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) < 0)
+        {
+            LOG_ERROR("%s:%s:%d UDP_GRO not supported, errno:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+            options_.gro = false;
+        }
+    }
+    channel_.setReadCallback(std::bind(&UdpEndpoint::handleRead, this, std::placeholders::_1));
+}
+
+UdpEndpoint::~UdpEndpoint()
+{
+    channel_.disableAll();
+    channel_.remove();
+    ::close(sockfd_);
+}
+
+void UdpEndpoint::start()
+{
+    // 在loop线程中分配，内存落在使用它的线程所在的节点上
+    size_t batch = static_cast<size_t>(options_.batchSize);
+    bufferSize_ = options_.gro ? kGroBufferSize : options_.maxDatagramSize;
+    recvBuffer_.resize(batch * bufferSize_);
+    recvMsgs_.resize(batch);
+    recvIovecs_.resize(batch);
+    recvAddrs_.resize(batch);
+    recvControl_.resize(options_.gro ? batch * CMSG_SPACE(sizeof(int)) : 0);
+    for(size_t i = 0; i < batch; ++i)
+    {
+        recvIovecs_[i].iov_base = &recvBuffer_[i * bufferSize_];
+        recvIovecs_[i].iov_len = bufferSize_;
+        ::memset(&recvMsgs_[i], 0, sizeof(mmsghdr));
+        recvMsgs_[i].msg_hdr.msg_iov = &recvIovecs_[i];
+        recvMsgs_[i].msg_hdr.msg_iovlen = 1;
+        recvMsgs_[i].msg_hdr.msg_name = &recvAddrs_[i];
+    }
+
+    sendMsgs_.resize(batch);
+    sendIovecs_.resize(batch);
+    sendControl_.resize(batch * CMSG_SPACE(sizeof(uint16_t)));
+    sendMsgDatagrams_.resize(batch);
+    out_.reserve(batch);
+
+    channel_.enableReading();
+}
+
+void UdpEndpoint::handleRead(Timestamp receiveTime)
+{
+    inReceiveBatch_ = true;
+    const unsigned int batch = static_cast<unsigned int>(options_.batchSize);
+    for(int round = 0; round < kMaxReceiveRounds; ++round)
+    {
+        // 内核会改写地址和控制信息的长度，每次调用前恢复
+        for(unsigned int i = 0; i < batch; ++i)
+        {
+            msghdr &hdr = recvMsgs_[i].msg_hdr;
+            hdr.msg_namelen = sizeof(sockaddr_storage);
+            if(options_.gro)
+            {
+                hdr.msg_control = &recvControl_[i * CMSG_SPACE(sizeof(int))];
+                hdr.msg_controllen = CMSG_SPACE(sizeof(int));
+            }
+        }
+        int n = ::recvmmsg(sockfd_, recvMsgs_.data(), batch, MSG_DONTWAIT, nullptr);
+        receiveCalls_.fetch_add(1, std::memory_order_relaxed);
+        if(n < 0)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERROR("%s:%s:%d recvmmsg err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+            }
+            break;
+        }
+        for(int i = 0; i < n; ++i)
+        {
+            deliver(recvMsgs_[i], recvAddrs_[i], &recvBuffer_[i * bufferSize_], receiveTime);
+        }
+        if(static_cast<unsigned int>(n) < batch)
+        {
+            break;  // 已经读空
+        }
+    }
+    inReceiveBatch_ = false;
+    flush();
+}
+
+void UdpEndpoint::deliver(const mmsghdr &msg, const sockaddr_storage &addr, const char *data, Timestamp receiveTime)
+{
+    if(msg.msg_hdr.msg_flags & MSG_TRUNC)
+    {
+        truncatedDatagrams_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    InetAddress peer(reinterpret_cast<const sockaddr *>(&addr), msg.msg_hdr.msg_namelen);
+    size_t len = msg.msg_len;
+    size_t segmentSize = len;
+    if(options_.gro)
+    {
+        // GRO合并的报文由若干个segmentSize大小的分段组成，最后一段可以更短
+        for(cmsghdr *cmsg = CMSG_FIRSTHDR(&msg.msg_hdr); cmsg != nullptr;
+            cmsg = CMSG_NXTHDR(const_cast<msghdr *>(&msg.msg_hdr), cmsg))
+        {
+            if(cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+            {
+                int gsoSize;
+                ::memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(gsoSize));
+                if(gsoSize > 0)
+                {
+                    segmentSize = static_cast<size_t>(gsoSize);
+                }
+            }
+        }
+    }
+    size_t offset = 0;
+    do
+    {
+        size_t segment = std::min(segmentSize, len - offset);
+        receivedDatagrams_.fetch_add(1, std::memory_order_relaxed);
+        if(datagramCallback_)
+        {
+            datagramCallback_(this, peer, data + offset, segment, receiveTime);
+        }
+        offset += segment;
+    } while(offset < len);
+}
+
+void UdpEndpoint::send(const InetAddress &peer, const void *data, size_t len)
+{
+    size_t offset = outData_.size();
+    outData_.insert(outData_.end(), static_cast<const char *>(data), static_cast<const char *>(data) + len);
+    out_.push_back(Outgoing{peer, offset, len});
+    if(!inReceiveBatch_ || out_.size() >= static_cast<size_t>(options_.batchSize))
+    {
+        flush();
+    }
+}
+
+void UdpEndpoint::flush()
+{
+    if(sendMsgs_.empty())
+    {
+        return;     // 还没有start()
+    }
+    size_t next = 0;
+    while(next < out_.size())
+    {
+        size_t count = 0;
+        while(next < out_.size() && count < sendMsgs_.size())
+        {
+            size_t merged = buildMessage(next, count);
+            sendMsgDatagrams_[count] = merged;
+            next += merged;
+            ++count;
+        }
+        sendBatch(count);
+    }
+    out_.clear();
+    outData_.clear();
+}
+
+size_t UdpEndpoint::buildMessage(size_t begin, size_t msgIndex)
+{
+    const Outgoing &first = out_[begin];
+    size_t end = begin + 1;
+    size_t bytes = first.len;
+    if(options_.gso && first.len > 0)
+    {
+        // 只有前面的分段都与第一段等长时才能合并，最后一段可以更短
+        while(end < out_.size() && end - begin < kMaxGsoSegments && out_[end - 1].len == first.len)
+        {
+            const Outgoing &o = out_[end];
+            if(o.len == 0 || o.len > first.len || bytes + o.len > kMaxGsoBytes
+               || o.peer.length() != first.peer.length()
+               || ::memcmp(o.peer.getSockAddr(), first.peer.getSockAddr(), first.peer.length()) != 0)
+            {
+                break;
+            }
+            bytes += o.len;
+            ++end;
+        }
+    }
+
+    iovec &iov = sendIovecs_[msgIndex];
+    iov.iov_base = outData_.data() + first.offset;  // 合并的回复在outData_中是连续的
+    iov.iov_len = bytes;
+    mmsghdr &msg = sendMsgs_[msgIndex];
+    ::memset(&msg, 0, sizeof(msg));
+    msg.msg_hdr.msg_name = const_cast<sockaddr *>(first.peer.getSockAddr());
+    msg.msg_hdr.msg_namelen = first.peer.length();
+    msg.msg_hdr.msg_iov = &iov;
+    msg.msg_hdr.msg_iovlen = 1;
+    if(end - begin > 1)
+    {
+        char *control = &sendControl_[msgIndex * CMSG_SPACE(sizeof(uint16_t))];
+        msg.msg_hdr.msg_control = control;
+        msg.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+        cmsg->cmsg_level = IPPROTO_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t segmentSize = static_cast<uint16_t>(first.len);
+        ::memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+    }
+    return end - begin;
+}
+
+void UdpEndpoint::sendBatch(size_t count)
+{
+    size_t sent = 0;
+    while(sent < count)
+    {
+        int n = ::sendmmsg(sockfd_, &sendMsgs_[sent], static_cast<unsigned int>(count - sent), MSG_DONTWAIT);
+        sendCalls_.fetch_add(1, std::memory_order_relaxed);
+        if(n > 0)
+        {
+            for(size_t i = sent; i < sent + n; ++i)
+            {
+                sentDatagrams_.fetch_add(sendMsgDatagrams_[i], std::memory_order_relaxed);
+            }
+            sent += n;
+            continue;
+        }
+        int savedErrno = errno;
+        if(savedErrno == EINTR)
+        {
+            continue;
+        }
+        if(savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+        {
+            // UDP不保证送达，发送缓冲区满时丢弃剩下的回复，不为它们关注可写事件
+            for(size_t i = sent; i < count; ++i)
+            {
+                droppedSends_.fetch_add(sendMsgDatagrams_[i], std::memory_order_relaxed);
+            }
+            break;
+        }
+        // 只是这一个报文发不出去(目标不可达、报文过大等)，跳过它继续发后面的
+        LOG_ERROR("%s:%s:%d sendmmsg err:%d\n", __FILE__, __FUNCTION__, __LINE__, savedErrno);
+        droppedSends_.fetch_add(sendMsgDatagrams_[sent], std::memory_order_relaxed);
+        ++sent;
+    }
+}
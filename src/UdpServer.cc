@@ -0,0 +1,107 @@
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "UdpServer.h"
+#include "Logger.h"
+
+UdpServer::UdpServer(EventLoop *loop,
+                     const InetAddress &listenAddr,
+                     const std::string &nameArg,
+                     Option option)
+    : loop_(loop)
+    , listenAddr_(listenAddr)
+    , name_(nameArg)
+    , option_(option)
+    , threadPool_(new EventLoopThreadPool(loop, name_))
+    , receiveBufferSize_(0)
+    , started_(0)
+{
+    if(loop_ == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d mainLoop is null!\n", __FILE__, __FUNCTION__, __LINE__);
+    }
+}
+
+UdpServer::~UdpServer()
+{
+    for(std::unique_ptr<UdpEndpoint> &endpoint : endpoints_)
+    {
+        UdpEndpoint *raw = endpoint.release();
+        raw->getLoop()->runInLoopAndWait([raw]() { delete raw; });
+    }
+}
+
+int UdpServer::createSocket(bool reuseport, int cpu) const
+{
+    int sockfd = ::socket(listenAddr_.family(), SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d udp socket create err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    int on = 1;
+    ::setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if(reuseport)
+    {
+        ::setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    }
+    if(cpu >= 0)
+    {
+        ::setsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+    }
+    if(receiveBufferSize_ > 0)
+    {
+        ::setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize_, sizeof(receiveBufferSize_));
+    }
+    if(::bind(sockfd, listenAddr_.getSockAddr(), listenAddr_.length()) < 0)
+    {
+        LOG_FATAL("%s:%s:%d bind udp socket to %s fail, errno:%d\n", __FILE__, __FUNCTION__, __LINE__,
+                  listenAddr_.toIpPort().c_str(), errno);
+    }
+    return sockfd;
+}
+
+void UdpServer::start()
+{
+    if(started_.fetch_add(1) != 0)
+    {
+        return;
+    }
+    threadPool_->start(threadInitCallback_);
+
+    std::vector<EventLoop *> loops;
+    if(option_ == kReusePortPerLoop)
+    {
+        loops = threadPool_->getAllLoops();
+    }
+    else
+    {
+        loops.push_back(loop_);
+    }
+    for(EventLoop *ioLoop : loops)
+    {
+        int sockfd = createSocket(option_ == kReusePortPerLoop, ioLoop->cpu());
+        std::unique_ptr<UdpEndpoint> endpoint(new UdpEndpoint(ioLoop, sockfd, options_, datagramCallback_));
+        ioLoop->runInLoop(std::bind(&UdpEndpoint::start, endpoint.get()));
+        endpoints_.push_back(std::move(endpoint));
+    }
+    LOG_INFO("UdpServer::start [%s] - %lu socket(s) on %s\n", name_.c_str(),
+             static_cast<unsigned long>(endpoints_.size()), listenAddr_.toIpPort().c_str());
+}
+
+uint64_t UdpServer::sum(uint64_t (UdpEndpoint::*counter)() const) const
+{
+    uint64_t total = 0;
+    for(const std::unique_ptr<UdpEndpoint> &endpoint : endpoints_)
+    {
+        total += (endpoint.get()->*counter)();
+    }
+    return total;
+}
+
+uint64_t UdpServer::receivedDatagrams() const { return sum(&UdpEndpoint::receivedDatagrams); }
+uint64_t UdpServer::receiveCalls() const { return sum(&UdpEndpoint::receiveCalls); }
+uint64_t UdpServer::sentDatagrams() const { return sum(&UdpEndpoint::sentDatagrams); }
+uint64_t UdpServer::sendCalls() const { return sum(&UdpEndpoint::sendCalls); }
+uint64_t UdpServer::droppedSends() const { return sum(&UdpEndpoint::droppedSends); }
+uint64_t UdpServer::truncatedDatagrams() const { return sum(&UdpEndpoint::truncatedDatagrams); }
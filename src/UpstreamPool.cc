@@ -0,0 +1,449 @@
+#include <algorithm>
+
+#include "UpstreamPool.h"
+#include "Buffer.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+constexpr double UpstreamPool::kDefaultSweepInterval;
+
+UpstreamPool::UpstreamPool(EventLoop *loop, const InetAddress &serverAddr, const std::string &name)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , name_(name)
+    , maxConnections_(8)
+    , maxIdleSeconds_(60.0)
+    , checkoutTimeout_(1.0)
+    , connectTimeout_(1.0)
+    , maxConnectAttempts_(1)
+    , callTimeout_(5.0)
+    , maxPipelineDepth_(64)
+    , matchById_(false)
+    , connecting_(0)
+    , connectsStarted_(0)
+    , sweeping_(false)
+    , alive_(std::make_shared<bool>(true))
+{
+}
+
+UpstreamPool::~UpstreamPool()
+{
+    checkInLoop();
+    if(sweeping_)
+    {
+        loop_->cancel(sweepTimer_);
+    }
+    // 连接可能比池活得久，断开它们与本对象的联系后交给TcpClient的析构收尾
+    for(std::unique_ptr<PooledConnection> &pc : connections_)
+    {
+        if(pc->conn)
+        {
+            pc->conn->setConnectionCallback([](const TcpConnectionPtr &) {});
+            pc->conn->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        }
+    }
+    connections_.clear();
+}
+
+void UpstreamPool::checkInLoop() const
+{
+    if(!loop_->isInLoopThread())
+    {
+        LOG_FATAL("%s:%s:%d UpstreamPool %s used outside its loop thread\n", __FILE__, __FUNCTION__, __LINE__, name_.c_str());
+    }
+}
+
+void UpstreamPool::start(double sweepInterval)
+{
+    checkInLoop();
+    startSweeping(sweepInterval);
+}
+
+void UpstreamPool::startSweeping(double sweepInterval)
+{
+    if(sweeping_)
+    {
+        return;
+    }
+    sweeping_ = true;
+    sweepTimer_ = loop_->runEvery(sweepInterval, std::bind(&UpstreamPool::sweep, this));
+}
+
+size_t UpstreamPool::idleConnections() const
+{
+    size_t n = 0;
+    for(const std::unique_ptr<PooledConnection> &pc : connections_)
+    {
+        if(pc->idle())
+        {
+            ++n;
+        }
+    }
+    return n;
+}
+
+void UpstreamPool::checkout(const CheckoutCallback &cb)
+{
+    checkInLoop();
+    startSweeping(kDefaultSweepInterval);
+    waiters_.push_back(Waiter{cb, addTime(Timestamp::now(), checkoutTimeout_)});
+    dispatch();
+}
+
+void UpstreamPool::checkin(const TcpConnectionPtr &conn)
+{
+    checkInLoop();
+    // 通常在连接自己的消息回调里归还，此时不能替换正在执行的回调，推迟到本轮事件处理完之后
+    std::weak_ptr<bool> alive(alive_);
+    loop_->queueInLoop([this, alive, conn]() {
+        if(!alive.expired())
+        {
+            checkinInLoop(conn);
+        }
+    });
+}
+
+void UpstreamPool::checkinInLoop(const TcpConnectionPtr &conn)
+{
+    PooledConnection *pc = findConnection(conn);
+    if(pc == nullptr || !pc->checkedOut)
+    {
+        return;     // 已断开并移除，或不是从本池借出的
+    }
+    pc->checkedOut = false;
+    pc->lastUsed = Timestamp::now();
+    // 借出期间使用者可能替换了消息回调
+    conn->setMessageCallback([this, pc](const TcpConnectionPtr &c, Buffer *buf, Timestamp) { onMessage(pc, c, buf); });
+    dispatch();
+}
+
+void UpstreamPool::call(const std::string &request, const ResponseCallback &cb, uint64_t requestId)
+{
+    checkInLoop();
+    if(!parser_)
+    {
+        LOG_ERROR("UpstreamPool::call [%s] - no response parser set\n", name_.c_str());
+        cb(false, std::string());
+        return;
+    }
+    startSweeping(kDefaultSweepInterval);
+    Timestamp deadline = callTimeout_ > 0 ? addTime(Timestamp::now(), callTimeout_) : Timestamp::invalid();
+    pendingCalls_.push_back(PendingCall{request, cb, requestId, deadline});
+    dispatch();
+}
+
+UpstreamPool::PooledConnection *UpstreamPool::openConnection()
+{
+    PooledConnection *pc = new PooledConnection;
+    pc->client.reset(new TcpClient(loop_, serverAddr_, name_));
+    if(connectTimeout_ > 0)
+    {
+        pc->client->setConnectTimeout(connectTimeout_);
+    }
+    pc->client->setMaxConnectAttempts(maxConnectAttempts_);
+    // 连接失败可能在connect()中同步回调，推迟到本轮事件处理完之后再处理，不在dispatch()中途改动连接列表
+    std::weak_ptr<bool> alive(alive_);
+    pc->client->setConnectFailedCallback([this, alive, pc]() {
+        loop_->queueInLoop([this, alive, pc]() {
+            if(!alive.expired())
+            {
+                onConnectFailed(pc);
+            }
+        });
+    });
+    pc->client->setConnectionCallback([this, pc](const TcpConnectionPtr &conn) { onConnection(pc, conn); });
+    pc->client->setMessageCallback([this, pc](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) { onMessage(pc, conn, buf); });
+    connections_.emplace_back(pc);
+    ++connecting_;
+    ++connectsStarted_;
+    pc->client->connect();
+    return pc;
+}
+
+void UpstreamPool::onConnection(PooledConnection *pc, const TcpConnectionPtr &conn)
+{
+    if(conn->connected())
+    {
+        pc->conn = conn;
+        pc->lastUsed = Timestamp::now();
+        --connecting_;
+        dispatch();
+    }
+    else
+    {
+        removeConnection(pc);
+    }
+}
+
+void UpstreamPool::onConnectFailed(PooledConnection *pc)
+{
+    LOG_ERROR("UpstreamPool [%s] - cannot connect to %s\n", name_.c_str(), serverAddr_.toIpPort().c_str());
+    --connecting_;
+    bool usable = connecting_ > 0;
+    for(std::unique_ptr<PooledConnection> &other : connections_)
+    {
+        usable = usable || (other.get() != pc && other->conn && other->conn->connected());
+    }
+    // 失败的连接上没有在途请求，只需移出；这里不调用dispatch()，否则上游拒绝连接时会不停地新建、失败
+    detachConnection(pc);
+    if(usable)
+    {
+        return;     // 还有其他连接可用或正在建立，排队的请求继续等它们
+    }
+
+    // 上游不可达：排队的请求和checkout立即失败，而不是一直等下去；之后的请求会重新发起连接
+    std::deque<PendingCall> calls;
+    calls.swap(pendingCalls_);
+    std::deque<Waiter> waiters;
+    waiters.swap(waiters_);
+    for(PendingCall &call : calls)
+    {
+        call.cb(false, std::string());
+    }
+    for(Waiter &waiter : waiters)
+    {
+        waiter.cb(TcpConnectionPtr());
+    }
+}
+
+void UpstreamPool::onMessage(PooledConnection *pc, const TcpConnectionPtr &conn, Buffer *buf)
+{
+    if(!parser_)
+    {
+        buf->retrieveAll();
+        return;
+    }
+    uint64_t requestId = 0;
+    std::string response;
+    while(parser_(buf, &requestId, &response))
+    {
+        ResponseCallback cb;
+        bool matched = false;
+        if(matchById_)
+        {
+            auto it = pc->inflightById.find(requestId);
+            if(it != pc->inflightById.end())
+            {
+                cb = std::move(it->second.cb);
+                pc->inflightById.erase(it);
+                matched = true;
+            }
+        }
+        else if(!pc->inflight.empty())
+        {
+            cb = std::move(pc->inflight.front().cb);
+            pc->inflight.pop_front();
+            matched = true;
+        }
+        if(!matched)
+        {
+            // 无法与请求对应的响应说明流已经错位，这条连接不能再用
+            LOG_ERROR("UpstreamPool [%s] - unmatched response on %s, closing\n", name_.c_str(), conn->name().c_str());
+            buf->retrieveAll();
+            conn->forceClose();
+            return;
+        }
+        if(cb)
+        {
+            cb(true, response);     // 为空说明已按超时结束，丢弃迟到的响应
+        }
+        response.clear();
+    }
+    pc->lastUsed = Timestamp::now();
+    dispatch();
+}
+
+std::shared_ptr<UpstreamPool::PooledConnection> UpstreamPool::detachConnection(PooledConnection *pc)
+{
+    auto it = std::find_if(connections_.begin(), connections_.end(),
+                           [pc](const std::unique_ptr<PooledConnection> &p) { return p.get() == pc; });
+    if(it == connections_.end())
+    {
+        return nullptr;
+    }
+    // 可能正在TcpClient的回调中，TcpClient和PooledConnection都放到本轮事件处理完之后销毁
+    std::shared_ptr<PooledConnection> holder(it->release());
+    connections_.erase(it);
+    loop_->queueInLoop([holder]() {});
+    return holder;
+}
+
+void UpstreamPool::removeConnection(PooledConnection *pc)
+{
+    std::shared_ptr<PooledConnection> holder = detachConnection(pc);
+    if(!holder)
+    {
+        return;
+    }
+
+    std::vector<ResponseCallback> failed;
+    for(InflightCall &call : holder->inflight)
+    {
+        failed.push_back(std::move(call.cb));
+    }
+    for(auto &item : holder->inflightById)
+    {
+        failed.push_back(std::move(item.second.cb));
+    }
+    holder->inflight.clear();
+    holder->inflightById.clear();
+    for(ResponseCallback &cb : failed)
+    {
+        if(cb)
+        {
+            cb(false, std::string());
+        }
+    }
+    dispatch();
+}
+
+UpstreamPool::PooledConnection *UpstreamPool::findConnection(const TcpConnectionPtr &conn)
+{
+    for(std::unique_ptr<PooledConnection> &pc : connections_)
+    {
+        if(pc->conn == conn)
+        {
+            return pc.get();
+        }
+    }
+    return nullptr;
+}
+
+void UpstreamPool::dispatch()
+{
+    // 独占使用：优先给最近用过的空闲连接，它的拥塞窗口和缓存都还是热的
+    while(!waiters_.empty())
+    {
+        PooledConnection *best = nullptr;
+        for(std::unique_ptr<PooledConnection> &pc : connections_)
+        {
+            if(pc->idle() && (best == nullptr || best->lastUsed < pc->lastUsed))
+            {
+                best = pc.get();
+            }
+        }
+        if(best == nullptr)
+        {
+            break;
+        }
+        best->checkedOut = true;
+        Waiter waiter = std::move(waiters_.front());
+        waiters_.pop_front();
+        waiter.cb(best->conn);
+    }
+
+    while(!pendingCalls_.empty())
+    {
+        PooledConnection *pc = pickForCall();
+        if(pc == nullptr)
+        {
+            break;
+        }
+        PendingCall call = std::move(pendingCalls_.front());
+        pendingCalls_.pop_front();
+        sendCall(pc, call);
+    }
+
+    // 现有连接满足不了时才新建，排队的请求每次只多建一条
+    size_t demand = waiters_.size() + (pendingCalls_.empty() ? 0 : 1);
+    while(connecting_ < demand && connections_.size() < maxConnections_)
+    {
+        openConnection();
+    }
+}
+
+UpstreamPool::PooledConnection *UpstreamPool::pickForCall()
+{
+    PooledConnection *best = nullptr;
+    for(std::unique_ptr<PooledConnection> &pc : connections_)
+    {
+        if(pc->conn && pc->conn->connected() && !pc->checkedOut && pc->inflightCount() < maxPipelineDepth_
+           && (best == nullptr || pc->inflightCount() < best->inflightCount()))
+        {
+            best = pc.get();
+        }
+    }
+    return best;
+}
+
+void UpstreamPool::sendCall(PooledConnection *pc, PendingCall &call)
+{
+    if(matchById_)
+    {
+        pc->inflightById[call.requestId] = InflightCall{std::move(call.cb), call.deadline};
+    }
+    else
+    {
+        pc->inflight.push_back(InflightCall{std::move(call.cb), call.deadline});
+    }
+    pc->lastUsed = Timestamp::now();
+    pc->conn->send(call.request);
+}
+
+void UpstreamPool::sweep()
+{
+    Timestamp now = Timestamp::now();
+
+    std::vector<CheckoutCallback> expired;
+    while(!waiters_.empty() && waiters_.front().deadline < now)
+    {
+        expired.push_back(std::move(waiters_.front().cb));
+        waiters_.pop_front();
+    }
+
+    // 排队的请求按提交顺序排列，截止时间也是递增的；在途请求逐个检查，超时的只结束回调，保留位置等响应
+    std::vector<ResponseCallback> expiredCalls;
+    while(!pendingCalls_.empty() && pendingCalls_.front().deadline.valid() && pendingCalls_.front().deadline < now)
+    {
+        expiredCalls.push_back(std::move(pendingCalls_.front().cb));
+        pendingCalls_.pop_front();
+    }
+    for(std::unique_ptr<PooledConnection> &pc : connections_)
+    {
+        for(InflightCall &call : pc->inflight)
+        {
+            if(call.cb && call.deadline.valid() && call.deadline < now)
+            {
+                expiredCalls.push_back(std::move(call.cb));
+                call.cb = nullptr;
+            }
+        }
+        for(auto &item : pc->inflightById)
+        {
+            if(item.second.cb && item.second.deadline.valid() && item.second.deadline < now)
+            {
+                expiredCalls.push_back(std::move(item.second.cb));
+                item.second.cb = nullptr;
+            }
+        }
+    }
+
+    Timestamp idleDeadline = addTime(now, -maxIdleSeconds_);
+    for(std::unique_ptr<PooledConnection> &pc : connections_)
+    {
+        if(!pc->idle())
+        {
+            continue;
+        }
+        // 直接关闭，不等对端；断开回调中移除
+        if(pc->lastUsed < idleDeadline)
+        {
+            LOG_INFO("UpstreamPool [%s] - evicting idle connection %s\n", name_.c_str(), pc->conn->name().c_str());
+            pc->conn->forceClose();
+        }
+        else if(healthCheck_ && !healthCheck_(pc->conn))
+        {
+            LOG_INFO("UpstreamPool [%s] - connection %s failed health check\n", name_.c_str(), pc->conn->name().c_str());
+            pc->conn->forceClose();
+        }
+    }
+
+    for(CheckoutCallback &cb : expired)
+    {
+        cb(TcpConnectionPtr());
+    }
+    for(ResponseCallback &cb : expiredCalls)
+    {
+        cb(false, std::string());
+    }
+}
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <thread>
+
+#include "WorkStealingPool.h"
+#include "Logger.h"
+
+namespace
+{
+// 当前线程所属的线程池和工作线程下标，非工作线程为nullptr/-1
+__thread WorkStealingPool *t_pool = nullptr;
+__thread int t_workerIndex = -1;
+
+uint32_t xorshift(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+} // namespace
+
+WorkStealingPool::WorkStealingPool(const std::string &name)
+    : name_(name)
+    , numThreads_(static_cast<int>(std::thread::hardware_concurrency()))
+    , running_(false)
+    , pending_(0)
+    , sleepers_(0)
+    , stolen_(0)
+{
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    if(running_)
+    {
+        stop();
+    }
+}
+
+void WorkStealingPool::start()
+{
+    running_ = true;
+    int numThreads = numThreads_ > 0 ? numThreads_ : 1;
+    // 先建好所有队列再启动线程，工作线程窃取时会遍历workers_
+    for(int i = 0; i < numThreads; ++i)
+    {
+        workers_.emplace_back(new Worker);
+        workers_.back()->seed = 2463534242u + i;
+    }
+    for(int i = 0; i < numThreads; ++i)
+    {
+        char buf[name_.size() + 32];
+        snprintf(buf, sizeof(buf), "%s%d", name_.c_str(), i);
+        workers_[i]->thread.reset(new Thread(std::bind(&WorkStealingPool::workerFunc, this, i), buf));
+        workers_[i]->thread->start();
+    }
+}
+
+void WorkStealingPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        running_ = false;
+    }
+    sleepCond_.notify_all();
+    for(std::unique_ptr<Worker> &worker : workers_)
+    {
+        worker->thread->join();
+    }
+    workers_.clear();
+}
+
+void WorkStealingPool::run(Task task)
+{
+    push(new Task(std::move(task)));
+}
+
+void WorkStealingPool::run(uint64_t orderingKey, Task task)
+{
+    StrandStripe &stripe = strandStripes_[orderingKey % kStrandStripes];
+    {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.strands.find(orderingKey);
+        if(it != stripe.strands.end())
+        {
+            // 该key已有任务在执行或排队，等它执行完再提交
+            it->second.push_back(std::move(task));
+            return;
+        }
+        stripe.strands[orderingKey];
+    }
+    run([this, orderingKey, task]() {
+        task();
+        runNextInStrand(orderingKey);
+    });
+}
+
+void WorkStealingPool::runNextInStrand(uint64_t orderingKey)
+{
+    StrandStripe &stripe = strandStripes_[orderingKey % kStrandStripes];
+    Task next;
+    {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        auto it = stripe.strands.find(orderingKey);
+        if(it->second.empty())
+        {
+            stripe.strands.erase(it);
+            return;
+        }
+        next = std::move(it->second.front());
+        it->second.pop_front();
+    }
+    // 重新提交而不是在这里接着执行，避免一个繁忙的key一直占住这个工作线程
+    run([this, orderingKey, next]() {
+        next();
+        runNextInStrand(orderingKey);
+    });
+}
+
+void WorkStealingPool::push(Task *task)
+{
+    if(t_pool == this)
+    {
+        workers_[t_workerIndex]->deque.push(task);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(injectMutex_);
+        injectQueue_.push_back(task);
+    }
+    // 先放入队列再计数：醒来的线程看到pending_大于0时一定能找到任务
+    pending_.fetch_add(1);
+    if(sleepers_.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        sleepCond_.notify_one();
+    }
+}
+
+WorkStealingPool::Task *WorkStealingPool::takeTask(int index)
+{
+    Worker &self = *workers_[index];
+    Task *task = self.deque.pop();
+    if(task)
+    {
+        return task;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(injectMutex_);
+        if(!injectQueue_.empty())
+        {
+            task = injectQueue_.front();
+            injectQueue_.pop_front();
+            return task;
+        }
+    }
+
+    // 从随机位置开始依次尝试窃取，避免所有空闲线程都去抢同一个队列
+    size_t n = workers_.size();
+    size_t start = xorshift(&self.seed) % n;
+    for(size_t i = 0; i < n; ++i)
+    {
+        size_t victim = (start + i) % n;
+        if(victim == static_cast<size_t>(index))
+        {
+            continue;
+        }
+        task = workers_[victim]->deque.steal();
+        if(task)
+        {
+            stolen_.fetch_add(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+void WorkStealingPool::workerFunc(int index)
+{
+    t_pool = this;
+    t_workerIndex = index;
+    while(true)
+    {
+        Task *task = takeTask(index);
+        if(task)
+        {
+            pending_.fetch_sub(1);
+            (*task)();
+            delete task;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        // sleepers_与pending_都是顺序一致的：提交者要么看到sleepers_大于0并唤醒，要么这里看到pending_大于0
+        sleepers_.fetch_add(1);
+        sleepCond_.wait(lock, [this]() { return pending_.load() > 0 || !running_; });
+        sleepers_.fetch_sub(1);
+        if(!running_ && pending_.load() == 0)
+        {
+            break;
+        }
+    }
+    LOG_DEBUG("WorkStealingPool %s worker %d exits\n", name_.c_str(), index);
+}
@@ -1,24 +1,41 @@
 #include <iostream>
+#include <stdlib.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
 #include "InetAddress.h"
 #include "Acceptor.h"
 #include "EventLoop.h"
 
+Acceptor *g_acceptor = nullptr;
+
+// 连接不关闭，配合较小的fd上限可以复现fd耗尽
 void newConnection(int sockfd, const InetAddress& peerAddr)
 {
-    printf("newConnection(): accepted a new connection from %s\n", peerAddr.toIpPort().c_str());
+    printf("newConnection(): accepted a new connection from %s, accepted=%lu events=%lu dropped=%lu\n",
+           peerAddr.toIpPort().c_str(),
+           static_cast<unsigned long>(g_acceptor->acceptedCount()),
+           static_cast<unsigned long>(g_acceptor->acceptEvents()),
+           static_cast<unsigned long>(g_acceptor->droppedForFdLimit()));
     ::write(sockfd, "How are you?\n", 13);
 }
 
-int main()
+// 用法：Acceptor_test [maxfds]，指定maxfds时降低RLIMIT_NOFILE，超出后的连接被立即关闭而不是让loop空转
+int main(int argc, char *argv[])
 {
     printf("main(): pid = %d\n", getpid());
+    if (argc > 1)
+    {
+        rlimit rl;
+        rl.rlim_cur = rl.rlim_max = atoi(argv[1]);
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+    }
 
     InetAddress listenAddr(9981);
     EventLoop loop;
 
     Acceptor acceptor(&loop, listenAddr, true);
+    g_acceptor = &acceptor;
     acceptor.setNewConnectionCallback(newConnection);
     acceptor.listen();
 
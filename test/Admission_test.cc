@@ -0,0 +1,314 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TcpServer.h"
+#include "Logger.h"
+#include "TestHarness.h"
+
+// TcpServer的过载保护：总连接数上限、每个IP的连接数上限、接入速率(暂停接受与直接拒绝两种方式)、
+// 输出缓冲区总量超限时拒绝新连接以及削减积压最多的连接
+// 服务端在连接建立时发出"hi\n"(可以再跟一段数据)，客户端据此判断连接是被接受还是被RST关闭
+
+const uint16_t kPort = 9970;
+
+// sourceIp非空时绑定本端地址；rcvbuf大于0时设置接收缓冲区，让服务端的数据积压在它的输出缓冲区里
+int connectFrom(const char *sourceIp = nullptr, int rcvbuf = 0)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sourceIp)
+    {
+        sockaddr_in local;
+        ::memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        ::inet_pton(AF_INET, sourceIp, &local.sin_addr);
+        ::bind(fd, reinterpret_cast<sockaddr *>(&local), sizeof(local));
+    }
+    if (rcvbuf > 0)
+    {
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    InetAddress addr(kPort);
+    if (::connect(fd, addr.getSockAddr(), addr.length()) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 等待问候语，收到即被接受；被RST或超时都算没有被接受
+bool greeted(int fd, double timeoutSeconds)
+{
+    if (fd < 0)
+    {
+        return false;
+    }
+    timeval timeout = {static_cast<time_t>(timeoutSeconds), static_cast<suseconds_t>((timeoutSeconds - static_cast<int>(timeoutSeconds)) * 1e6)};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char buf[3];
+    size_t got = 0;
+    while (got < sizeof(buf))
+    {
+        ssize_t n = ::recv(fd, buf + got, sizeof(buf) - got, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        got += n;
+    }
+    return ::memcmp(buf, "hi\n", 3) == 0;
+}
+
+bool waitFor(const std::function<bool()> &cond, double timeoutSeconds)
+{
+    for (int i = 0; i < timeoutSeconds * 100; ++i)
+    {
+        if (cond())
+        {
+            return true;
+        }
+        ::usleep(10 * 1000);
+    }
+    return cond();
+}
+
+void closeAll(std::vector<int> *fds)
+{
+    for (int fd : *fds)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+    fds->clear();
+}
+
+// 在main线程中运行服务器，scenario在另一个线程中扮演客户端
+void runServer(const AdmissionControl::Limits &limits, size_t payloadBytes,
+               const std::function<void(TcpServer &)> &scenario)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(kPort), "admission", TcpServer::kReusePort);
+    server.setThreadNum(2);
+    server.setAdmissionLimits(limits);
+    std::string greeting = "hi\n" + std::string(payloadBytes, 'x');
+    server.setConnectionCallback([greeting](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->send(greeting);
+        }
+    });
+    server.start();
+    std::thread driver([&]() {
+        ::usleep(50 * 1000);
+        scenario(server);
+        loop.quit();
+    });
+    loop.loop();
+    driver.join();
+}
+
+void testConnectionCap()
+{
+    AdmissionControl::Limits limits;
+    limits.maxConnections = 50;
+    runServer(limits, 0, [](TcpServer &server) {
+        std::vector<int> fds;
+        for (int i = 0; i < 80; ++i)
+        {
+            fds.push_back(connectFrom());
+        }
+        int accepted = 0;
+        for (int fd : fds)
+        {
+            accepted += greeted(fd, 0.5);
+        }
+        printf("cap 50: accepted %d of 80, rejected %lu\n", accepted,
+               static_cast<unsigned long>(server.rejectedConnections()));
+        check(accepted == 50, "connection cap admits exactly maxConnections");
+        check(server.rejectedConnections(AdmissionControl::kOverConnections) == 30, "the rest are rejected with RST");
+
+        // 关闭一些连接后腾出的名额可以再用
+        for (int i = 0; i < 10; ++i)
+        {
+            ::close(fds[i]);
+            fds[i] = -1;
+        }
+        waitFor([&server]() { return server.connectionCount() == 40; }, 1.0);
+        int reaccepted = 0;
+        for (int i = 0; i < 10; ++i)
+        {
+            int fd = connectFrom();
+            reaccepted += greeted(fd, 0.5);
+            fds.push_back(fd);
+        }
+        check(reaccepted == 10, "closed connections free their slots");
+        closeAll(&fds);
+    });
+}
+
+void testPerIpCap()
+{
+    AdmissionControl::Limits limits;
+    limits.maxConnectionsPerIp = 5;
+    runServer(limits, 0, [](TcpServer &server) {
+        std::vector<int> fds;
+        int fromA = 0, fromB = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            fds.push_back(connectFrom("127.0.0.1"));
+            fromA += greeted(fds.back(), 0.5);
+        }
+        for (int i = 0; i < 4; ++i)
+        {
+            fds.push_back(connectFrom("127.0.0.2"));
+            fromB += greeted(fds.back(), 0.5);
+        }
+        printf("per-ip 5: 127.0.0.1 got %d of 8, 127.0.0.2 got %d of 4\n", fromA, fromB);
+        check(fromA == 5 && fromB == 4, "per-ip cap limits each source separately");
+        check(server.rejectedConnections(AdmissionControl::kOverPeerConnections) == 3, "rejections counted as peer connections");
+        closeAll(&fds);
+    });
+}
+
+// 60个连接一起到达，每秒放行100个、突发10个
+void testAcceptRate(AdmissionControl::OverloadAction action)
+{
+    AdmissionControl::Limits limits;
+    limits.acceptRate = 100;
+    limits.acceptBurst = 10;
+    limits.action = action;
+    bool pause = action == AdmissionControl::kPauseAccepting;
+    runServer(limits, 0, [pause](TcpServer &server) {
+        std::vector<int> fds;
+        Timestamp start = Timestamp::now();
+        for (int i = 0; i < 60; ++i)
+        {
+            fds.push_back(connectFrom());
+        }
+        int accepted = 0;
+        for (int fd : fds)
+        {
+            accepted += greeted(fd, 2.0);
+        }
+        double elapsed = (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1e6;
+        printf("rate 100/s burst 10, %s: accepted %d of 60 in %.3fs, rejected %lu, pauses %lu\n",
+               pause ? "pause" : "reject", accepted, elapsed,
+               static_cast<unsigned long>(server.rejectedConnections()),
+               static_cast<unsigned long>(server.acceptPauses()));
+        if (pause)
+        {
+            check(accepted == 60 && server.rejectedConnections() == 0, "paused acceptor keeps connections in the backlog");
+            check(elapsed > 0.4 && server.acceptPauses() > 0, "backlog drained at the accept rate");
+        }
+        else
+        {
+            check(accepted >= 10 && accepted < 30, "reject mode admits about the burst");
+            check(server.rejectedConnections(AdmissionControl::kOverAcceptRate) == static_cast<uint64_t>(60 - accepted),
+                  "the rest are rejected for accept rate");
+        }
+        closeAll(&fds);
+    });
+}
+
+// 慢消费者让服务端输出缓冲区积压，超过上限后新连接被拒绝
+void testOutputBufferLimit()
+{
+    AdmissionControl::Limits limits;
+    limits.maxOutputBufferBytes = 4 << 20;
+    runServer(limits, 16 << 20, [](TcpServer &server) {
+        int slow = connectFrom(nullptr, 4096);
+        bool slowGreeted = greeted(slow, 0.5);
+        waitFor([&server]() { return server.outputBufferBytes() > (4u << 20); }, 1.0);
+        int late = connectFrom();
+        bool lateGreeted = greeted(late, 0.5);
+        printf("output limit 4MB: %lu bytes pending, late connection %s\n",
+               static_cast<unsigned long>(server.outputBufferBytes()), lateGreeted ? "accepted" : "rejected");
+        check(slowGreeted && !lateGreeted, "new connections rejected while output buffers are over the limit");
+        check(server.rejectedConnections(AdmissionControl::kOverMemory) == 1, "rejection counted as output buffers");
+        ::close(slow);
+        ::close(late);
+    });
+}
+
+// 积压超过削减阈值后关闭积压最多的连接，正常读取的连接不受影响
+// 不设maxOutputBufferBytes，慢消费者不会因为采样滞后被拒绝
+void testShedding()
+{
+    AdmissionControl::Limits limits;
+    limits.shedOutputBufferBytes = 8 << 20;
+    runServer(limits, 16 << 20, [](TcpServer &server) {
+        // 正常的客户端先读完所有数据，检查完之后才关闭连接
+        std::atomic_bool checked(false);
+        std::atomic<int> drained(0);
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 3; ++i)
+        {
+            readers.emplace_back([&checked, &drained]() {
+                int fd = connectFrom();
+                greeted(fd, 1.0);
+                std::vector<char> buf(1 << 20);
+                size_t total = 0;
+                while (total < (16u << 20))
+                {
+                    ssize_t n = ::recv(fd, buf.data(), buf.size(), 0);
+                    if (n <= 0)
+                    {
+                        break;
+                    }
+                    total += n;
+                }
+                ++drained;
+                while (!checked)
+                {
+                    ::usleep(10 * 1000);
+                }
+                ::close(fd);
+            });
+        }
+        waitFor([&drained]() { return drained == 3; }, 5.0);
+        // 之后到来的慢消费者不读数据
+        std::vector<int> slow;
+        for (int i = 0; i < 3; ++i)
+        {
+            slow.push_back(connectFrom(nullptr, 4096));
+            greeted(slow.back(), 0.5);
+        }
+        bool shed = waitFor([&server]() { return server.shedConnections() >= 3 && server.connectionCount() == 3; }, 2.0);
+        size_t remaining = server.connectionCount();
+        printf("shed at 8MB: %lu connection(s) shed, %lu left, %lu rejected, %lu pending\n",
+               static_cast<unsigned long>(server.shedConnections()), static_cast<unsigned long>(remaining),
+               static_cast<unsigned long>(server.rejectedConnections()), static_cast<unsigned long>(server.outputBufferBytes()));
+        check(shed && server.shedConnections() == 3, "slow consumers shed");
+        check(remaining == 3, "well-behaved connections kept");
+        checked = true;
+        for (std::thread &t : readers)
+        {
+            t.join();
+        }
+        closeAll(&slow);
+    });
+}
+
+int main()
+{
+    Logger::setLogLevel(ERROR);
+    testConnectionCap();
+    testPerIpCap();
+    testAcceptRate(AdmissionControl::kPauseAccepting);
+    testAcceptRate(AdmissionControl::kRejectAndClose);
+    testOutputBufferLimit();
+    testShedding();
+    return testExitCode();
+}
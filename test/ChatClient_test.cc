@@ -1,4 +1,4 @@
-#include "TcpConnection.h"
+#include "TcpClient.h"
 #include "EventLoop.h"
 #include "InetAddress.h"
 #include "Logger.h"
@@ -7,26 +7,18 @@
 #include <memory>
 #include <atomic>
 
-class ChatClient : public std::enable_shared_from_this<ChatClient> {
+class ChatClient {
 public:
     ChatClient(EventLoop* loop, const InetAddress& serverAddr)
-        : loop_(loop), serverAddr_(serverAddr), conn_(nullptr) {}
+        : client_(loop, serverAddr, "ChatClient") {
+        client_.setConnectionCallback([this](const TcpConnectionPtr& conn) { onConnection(conn); });
+        client_.setMessageCallback([this](const TcpConnectionPtr& conn, Buffer* buf, Timestamp time) { onMessage(conn, buf, time); });
+        // 服务器重启后自动重连
+        client_.enableRetry();
+    }
 
     void start() {
-        int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
-        if (sockfd < 0) {
-            LOG_ERROR("socket error\n");
-            return;
-        }
-        if (::connect(sockfd, reinterpret_cast<const sockaddr*>(serverAddr_.getSockAddr()), sizeof(sockaddr_in)) < 0) {
-            LOG_ERROR("connect error\n");
-            ::close(sockfd);
-            return;
-        }
-        conn_ = std::make_shared<TcpConnection>(loop_, "ChatClientConn", sockfd, InetAddress(), serverAddr_);
-        conn_->setConnectionCallback([this](const TcpConnectionPtr& conn) { onConnection(conn); });
-        conn_->setMessageCallback([this](const TcpConnectionPtr& conn, Buffer* buf, Timestamp time) { onMessage(conn, buf, time); });
-        conn_->connectEstablished();
+        client_.connect();
     }
 
 private:
@@ -38,7 +30,7 @@ private:
                 std::thread([this] {
                     std::string line;
                     while (std::getline(std::cin, line)) {
-                        TcpConnectionPtr conn = conn_; // 拷贝智能指针，防止析构
+                        TcpConnectionPtr conn = client_.connection(); // 拷贝智能指针，防止析构
                         if (conn && conn->connected()) {
                             conn->send(line + "\n");
                         }
@@ -47,27 +39,23 @@ private:
             }
         } else {
             LOG_INFO("Disconnected from server.\n");
-            conn_.reset();
         }
     }
 
     void onMessage(const TcpConnectionPtr&, Buffer* buf, Timestamp) {
-        if (!conn_ || !conn_->connected()) return;
         std::string msg = buf->retrieveAllAsString();
         std::cout << "Server: " << msg;
     }
 
-    EventLoop* loop_;
-    InetAddress serverAddr_;
-    TcpConnectionPtr conn_;
+    TcpClient client_;
     std::atomic_bool inputThreadStarted_{false};
 };
 
 int main() {
     EventLoop loop;
     InetAddress serverAddr(8888, "127.0.0.1");
-    auto client = std::make_shared<ChatClient>(&loop, serverAddr);
-    client->start();
+    ChatClient client(&loop, serverAddr);
+    client.start();
     loop.loop();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "TcpServer.h"
+#include "Logger.h"
+
+// 连接频繁建立/断开的压测：客户端线程循环执行 connect -> 发1字节 -> 收回显 -> close
+// 分别测单个Acceptor在main loop上接受再转交subloop，以及每个subloop一个SO_REUSEPORT Acceptor
+// 用法：ConnectionChurn_bench [threads=4] [clients=8] [seconds=3]
+
+std::atomic_bool g_stop(false);
+
+void churnClient(uint16_t port, std::atomic<long> *connections, std::atomic<long> *failures)
+{
+    sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    while (!g_stop)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        char c = 'x';
+        if (::connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0 && ::write(fd, &c, 1) == 1 && ::read(fd, &c, 1) == 1)
+        {
+            ++*connections;
+        }
+        else
+        {
+            ++*failures;    // 各loop的Acceptor是异步开始监听的，最开始的几次连接可能被拒绝
+        }
+        // 以RST关闭，避免大量TIME_WAIT耗尽本地端口
+        linger lg = {1, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        ::close(fd);
+    }
+}
+
+void runMode(const char *modeName, TcpServer::Option option, uint16_t port, int threads, int clients, int seconds)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), modeName, option);
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.setThreadNum(threads);
+    server.start();
+
+    std::atomic<long> connections(0);
+    std::atomic<long> failures(0);
+    g_stop = false;
+    std::thread driver([&]() {
+        std::vector<std::thread> clientThreads;
+        for (int i = 0; i < clients; ++i)
+        {
+            clientThreads.emplace_back(churnClient, port, &connections, &failures);
+        }
+        ::sleep(seconds);
+        g_stop = true;
+        for (std::thread &t : clientThreads)
+        {
+            t.join();
+        }
+        loop.quit();
+    });
+    loop.loop();
+    driver.join();
+
+    printf("%-28s threads=%d clients=%d: %8.0f conn/s (failed %ld)\n",
+           modeName, threads, clients, static_cast<double>(connections) / seconds, failures.load());
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    int clients = argc > 2 ? atoi(argv[2]) : 8;
+    int seconds = argc > 3 ? atoi(argv[3]) : 3;
+
+    // 每个连接都会打若干条INFO日志，压测的是接受连接的路径，关掉日志
+    Logger::setLogLevel(FATAL);
+    runMode("single acceptor (kReusePort)", TcpServer::kReusePort, 9981, threads, clients, seconds);
+    runMode("kReusePortPerLoop", TcpServer::kReusePortPerLoop, 9982, threads, clients, seconds);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "TcpServer.h"
+#include "Logger.h"
+#include "TestHarness.h"
+
+// 检查IO线程绑核、线程命名以及已接受连接上的SO_INCOMING_CPU
+// 用法：CpuAffinity_test [cpu...]，默认把两个IO线程都绑到CPU 0
+
+int main(int argc, char *argv[])
+{
+    Logger::setLogLevel(ERROR);
+    std::vector<int> cpus;
+    for (int i = 1; i < argc; ++i)
+    {
+        cpus.push_back(atoi(argv[i]));
+    }
+    if (cpus.empty())
+    {
+        cpus.push_back(0);
+    }
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(9930), "Affinity");
+    std::mutex mutex;
+    server.setThreadInitCallback([&](EventLoop *ioLoop) {
+        cpu_set_t cpuset;
+        ::pthread_getaffinity_np(::pthread_self(), sizeof(cpuset), &cpuset);
+        char name[16];
+        ::pthread_getname_np(::pthread_self(), name, sizeof(name));
+        std::lock_guard<std::mutex> lock(mutex);
+        printf("thread %s bound to cpu %d, running on %d\n", name, ioLoop->cpu(), ::sched_getcpu());
+        check(ioLoop->cpu() >= 0 && CPU_COUNT(&cpuset) == 1 && CPU_ISSET(ioLoop->cpu(), &cpuset), "affinity mask has exactly the bound cpu");
+        check(::sched_getcpu() == ioLoop->cpu(), "thread runs on the bound cpu");
+        check(strncmp(name, "Affinity", 8) == 0, "thread name taken from pool name");
+    });
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            int cpu = -1;
+            socklen_t len = sizeof(cpu);
+            ::getsockopt(conn->fd(), SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len);
+            check(cpu == conn->getLoop()->cpu(), "SO_INCOMING_CPU set on accepted socket");
+            loop.queueInLoop([&loop]() { loop.quit(); });
+        }
+    });
+    server.setCpuAffinity(cpus);
+    server.setThreadNum(2);
+    server.start();
+
+    std::thread client([]() {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in addr;
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(9930);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ::connect(fd, (sockaddr *)&addr, sizeof(addr));
+        ::sleep(1);
+        ::close(fd);
+    });
+    loop.loop();
+    client.join();
+    return testExitCode();
+}
@@ -0,0 +1,299 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TcpServer.h"
+#include "ListenSocketHandoff.h"
+#include "Logger.h"
+#include "TestHarness.h"
+
+// 两个进程之间的不停机重启：旧进程A把监听socket交给新进程B后优雅退出
+// 客户端在整个过程中持续发请求(长连接和短连接都有)，不应出现连接被拒绝或请求没有回复
+// 服务端退出期间在回复中带上"close"，客户端收到后重新连接，新连接由B接受
+// 最后测试进程自己接管B的监听socket，让B也退出：B上有一个一直空闲的连接，到截止时间后被强制关闭
+// 另外检查：没有转交时drain关闭监听socket；头部与收到的fd数不符时receive()不返回部分fd
+
+const uint16_t kPort = 9990;
+
+// 服务端进程，退出码：0正常退出，2有连接被强制关闭
+int runServer(char tag, const std::vector<int> &inheritedFds, const InetAddress &control, double drainSeconds, int readyFd)
+{
+    Logger::setLogLevel(ERROR);
+    EventLoop loop;
+    std::string name(1, tag);
+    std::unique_ptr<TcpServer> server(inheritedFds.empty()
+        ? new TcpServer(&loop, InetAddress(kPort), name, TcpServer::kReusePortPerLoop)
+        : new TcpServer(&loop, inheritedFds, name, TcpServer::kReusePortPerLoop));
+    server->setThreadNum(2);
+    TcpServer *raw = server.get();
+    server->setConnectionCallback([](const TcpConnectionPtr &) {});
+    server->setMessageCallback([raw, tag](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        const char *begin = buf->peek();
+        const char *end = begin + buf->readableBytes();
+        const char *eol = std::find(begin, end, '\n');
+        if (eol == end)
+        {
+            return;
+        }
+        buf->retrieve(eol - begin + 1);
+        // 退出期间回复完当前请求后关闭连接，并告诉客户端不要再在这条连接上发请求
+        bool closing = raw->draining();
+        conn->send(std::string(1, tag) + (closing ? " close\n" : "\n"));
+        if (closing)
+        {
+            conn->shutdown();
+        }
+    });
+    server->start();
+
+    int exitCode = 1;
+    server->enableHandoff(control, drainSeconds, [&loop, &exitCode](bool forced) {
+        exitCode = forced ? 2 : 0;
+        loop.quit();
+    });
+    loop.runInLoop([readyFd]() {
+        char c = 'r';
+        ::write(readyFd, &c, 1);
+    });
+    loop.loop();
+    return exitCode;
+}
+
+int connectToServer()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    InetAddress addr(kPort);
+    if (::connect(fd, addr.getSockAddr(), addr.length()) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    timeval timeout = {2, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+std::atomic_bool g_stop(false);
+std::atomic<long> g_refused(0);
+std::atomic<long> g_lost(0);
+std::atomic<long> g_servedBy[2];
+
+void client(bool shortLived)
+{
+    int fd = -1;
+    while (!g_stop)
+    {
+        if (fd < 0)
+        {
+            fd = connectToServer();
+            if (fd < 0)
+            {
+                ++g_refused;
+                ::usleep(1000);
+                continue;
+            }
+        }
+        std::string reply;
+        char c;
+        bool ok = ::send(fd, "req\n", 4, MSG_NOSIGNAL) == 4;
+        while (ok && ::recv(fd, &c, 1, 0) == 1)
+        {
+            if (c == '\n')
+            {
+                break;
+            }
+            reply += c;
+        }
+        if (reply.empty() || (reply[0] != 'A' && reply[0] != 'B'))
+        {
+            ++g_lost;   // 请求发出后没有收到回复
+            ::close(fd);
+            fd = -1;
+            continue;
+        }
+        ++g_servedBy[reply[0] - 'A'];
+        if (shortLived || reply.find("close") != std::string::npos)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+        ::usleep(1000);
+    }
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+// 等待子进程退出，超时返回-1
+int waitExit(pid_t pid, double timeoutSeconds)
+{
+    for (int i = 0; i < timeoutSeconds * 100; ++i)
+    {
+        int status;
+        if (::waitpid(pid, &status, WNOHANG) == pid)
+        {
+            return WIFEXITED(status) ? WEXITSTATUS(status) : 128;
+        }
+        ::usleep(10 * 1000);
+    }
+    ::kill(pid, SIGKILL);
+    ::waitpid(pid, nullptr, 0);
+    return -1;
+}
+
+// 没有新进程接手时drain应关闭监听socket，之后的连接被拒绝，也不再接受转交
+void testPlainDrainClosesListener()
+{
+    const uint16_t port = kPort + 1;
+    InetAddress control = InetAddress::fromUnixPath("@handoff_test.plain." + std::to_string(::getpid()));
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "Plain", TcpServer::kReusePortPerLoop);
+    server.setThreadNum(2);
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.start();
+    server.enableHandoff(control, 1.0, TcpServer::DrainedCallback());
+    loop.runAfter(0.1, [&]() { server.drain(1.0, [&](bool) { loop.quit(); }); });
+    loop.runAfter(3.0, [&]() { loop.quit(); });
+    loop.loop();
+    // 各subloop中的监听socket在自己的线程中关闭
+    loop.runAfter(0.05, [&]() { loop.quit(); });
+    loop.loop();
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    InetAddress addr(port);
+    bool refused = ::connect(fd, addr.getSockAddr(), addr.length()) < 0 && errno == ECONNREFUSED;
+    ::close(fd);
+    check(refused, "plain drain closed the listening sockets");
+    check(server.listenFds().empty(), "no listening fds left after plain drain");
+    check(ListenSocketHandoff::receive(control, 0.5).empty(), "no handoff offered after plain drain");
+}
+
+// 假冒的旧进程：头部声称2个fd，实际只附带1个
+void testIncompleteHandoffRejected()
+{
+    InetAddress control = InetAddress::fromUnixPath("@handoff_test.bad." + std::to_string(::getpid()));
+    int listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ::bind(listenFd, control.getSockAddr(), control.length());
+    ::listen(listenFd, 1);
+    std::thread fake([listenFd]() {
+        int connfd = ::accept(listenFd, nullptr, nullptr);
+        int passed = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        uint32_t count = 2;
+        iovec iov = {&count, sizeof(count)};
+        char control[CMSG_SPACE(sizeof(int))];
+        msghdr msg;
+        ::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        ::memcpy(CMSG_DATA(cmsg), &passed, sizeof(int));
+        ::sendmsg(connfd, &msg, MSG_NOSIGNAL);
+        ::close(passed);
+        ::close(connfd);
+    });
+    std::vector<int> fds = ListenSocketHandoff::receive(control, 2.0);
+    fake.join();
+    ::close(listenFd);
+    check(fds.empty(), "handoff with fewer fds than announced rejected");
+}
+
+int main()
+{
+    InetAddress control = InetAddress::fromUnixPath("@handoff_test." + std::to_string(::getpid()));
+    int readyA[2], readyB[2], goB[2];
+    if (::pipe(readyA) < 0 || ::pipe(readyB) < 0 || ::pipe(goB) < 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+    char c;
+
+    // 在创建任何线程之前fork出两个服务端进程
+    pid_t a = ::fork();
+    if (a == 0)
+    {
+        ::_exit(runServer('A', std::vector<int>(), control, 2.0, readyA[1]));
+    }
+    ::read(readyA[0], &c, 1);
+    pid_t b = ::fork();
+    if (b == 0)
+    {
+        ::read(goB[0], &c, 1);
+        std::vector<int> fds = ListenSocketHandoff::receive(control, 2.0);
+        if (fds.empty())
+        {
+            ::_exit(3);
+        }
+        ::_exit(runServer('B', fds, control, 0.5, readyB[1]));
+    }
+
+    std::vector<std::thread> clients;
+    for (int i = 0; i < 4; ++i)
+    {
+        clients.emplace_back(client, false);
+    }
+    clients.emplace_back(client, true);
+    clients.emplace_back(client, true);
+
+    ::usleep(300 * 1000);
+    Timestamp handoffStart = Timestamp::now();
+    ::write(goB[1], "g", 1);
+    ::read(readyB[0], &c, 1);
+    int exitA = waitExit(a, 5.0);
+    double drainSeconds = (Timestamp::now().microSecondsSinceEpoch() - handoffStart.microSecondsSinceEpoch()) / 1e6;
+    long servedByAAfterHandoff = g_servedBy[0];
+    ::usleep(300 * 1000);
+
+    g_stop = true;
+    for (std::thread &t : clients)
+    {
+        t.join();
+    }
+    printf("served by A %ld, by B %ld, refused %ld, lost %ld; A exited %d after %.3fs\n",
+           g_servedBy[0].load(), g_servedBy[1].load(), g_refused.load(), g_lost.load(), exitA, drainSeconds);
+    check(g_servedBy[0] > 0 && g_servedBy[1] > 0, "both processes served requests");
+    check(g_refused == 0, "no connection refused during handoff");
+    check(g_lost == 0, "every request got a reply");
+    check(exitA == 0, "A drained without forcing connections");
+    check(g_servedBy[0] == servedByAAfterHandoff, "A served nothing after it exited");
+
+    // 接管B的监听socket，B上留一个空闲连接，B应在截止时间后强制关闭它
+    int idle = connectToServer();
+    ::usleep(50 * 1000);
+    std::vector<int> fds = ListenSocketHandoff::receive(control, 2.0);
+    int exitB = waitExit(b, 5.0);
+    char buf[16];
+    bool idleClosed = idle >= 0 && ::recv(idle, buf, sizeof(buf), 0) == 0;
+    printf("received %lu socket(s) from B; B exited %d\n", static_cast<unsigned long>(fds.size()), exitB);
+    check(fds.size() == 2, "B handed over its per-loop listening sockets");
+    check(exitB == 2 && idleClosed, "idle connection force-closed at deadline");
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+    if (idle >= 0)
+    {
+        ::close(idle);
+    }
+
+    testPlainDrainClosesListener();
+    testIncompleteHandoffRejected();
+    return testExitCode();
+}
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "TcpServer.h"
+#include "Logger.h"
+#include "LoadBalancePolicy.h"
+
+// 负载倾斜的压测：每4个连接中第1个是长连接且每条消息要耗费200us CPU，其余3个是发一条消息就断开的短连接
+// 轮询策略下重连接会全部落在同一个loop上；比较各策略下重连接的分布和各loop的忙碌时间
+// 客户端从127.0.0.x的不同地址发起连接，让按对端地址哈希的策略也能分散开
+// 最后一组用轮询分配再开启自动负载均衡，观察重连接被迁移后的分布
+
+const int kLoops = 4;
+const int kConnections = 32;
+const int kHeavyCostUs = 200;
+
+std::atomic_bool g_stop(false);
+std::atomic<long> g_heavyMessages(0);
+
+int connectFrom(int clientIndex, uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in local;
+    local.sin_family = AF_INET;
+    local.sin_port = 0;
+    local.sin_addr.s_addr = htonl(0x7f000001 + clientIndex);
+    ::bind(fd, (sockaddr *)&local, sizeof(local));
+
+    sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void heavyClient(int fd)
+{
+    char c = 'H';
+    while (!g_stop && ::write(fd, &c, 1) == 1 && ::read(fd, &c, 1) == 1)
+    {
+        ++g_heavyMessages;
+    }
+    ::close(fd);
+}
+
+void burnCpu(int us)
+{
+    int64_t end = Timestamp::now().microSecondsSinceEpoch() + us;
+    while (Timestamp::now().microSecondsSinceEpoch() < end)
+    {
+    }
+}
+
+void runPolicy(const char *policyName, const std::shared_ptr<LoadBalancePolicy> &policy, uint16_t port,
+               bool autoRebalance = false)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), policyName);
+    std::mutex mutex;
+    std::vector<EventLoop *> loops;
+    server.setThreadInitCallback([&](EventLoop *ioLoop) {
+        std::lock_guard<std::mutex> lock(mutex);
+        loops.push_back(ioLoop);
+    });
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        std::string msg = buf->retrieveAllAsString();
+        if (msg[0] == 'H')
+        {
+            burnCpu(kHeavyCostUs);
+        }
+        conn->send(msg);
+    });
+    server.setLoadBalancePolicy(policy);
+    if (autoRebalance)
+    {
+        server.enableAutoRebalance(0.25, 0.2);
+    }
+    server.setThreadNum(kLoops);
+    server.start();
+
+    g_stop = false;
+    g_heavyMessages = 0;
+    std::vector<int64_t> busy(kLoops);
+    std::vector<int> heavyPerLoop(kLoops);
+    std::thread driver([&]() {
+        std::vector<std::thread> heavyClients;
+        for (int i = 0; i < kConnections; ++i)
+        {
+            int fd = connectFrom(i, port);
+            if (fd < 0)
+            {
+                continue;
+            }
+            if (i % 4 == 0)
+            {
+                heavyClients.emplace_back(heavyClient, fd);
+            }
+            else
+            {
+                char c = 'L';
+                if (::write(fd, &c, 1) == 1)
+                {
+                    ::read(fd, &c, 1);
+                }
+                ::close(fd);
+            }
+            ::usleep(20 * 1000);
+        }
+
+        // 短连接都已断开，剩下的就是重连接；自动负载均衡时先给它一点时间迁移
+        if (autoRebalance)
+        {
+            ::sleep(2);
+        }
+        for (int i = 0; i < kLoops; ++i)
+        {
+            busy[i] = loops[i]->busyMicroSeconds();
+        }
+        g_heavyMessages = 0;
+        ::sleep(2);
+        for (int i = 0; i < kLoops; ++i)
+        {
+            busy[i] = loops[i]->busyMicroSeconds() - busy[i];
+            heavyPerLoop[i] = loops[i]->connectionCount();
+        }
+        long messages = g_heavyMessages;
+        g_stop = true;
+        for (std::thread &t : heavyClients)
+        {
+            t.join();
+        }
+        loop.quit();
+
+        int64_t maxBusy = 0, totalBusy = 0;
+        printf("%-18s heavy conns per loop:", policyName);
+        for (int i = 0; i < kLoops; ++i)
+        {
+            printf(" %d", heavyPerLoop[i]);
+            maxBusy = std::max(maxBusy, busy[i]);
+            totalBusy += busy[i];
+        }
+        printf(" | busy ms per loop:");
+        for (int i = 0; i < kLoops; ++i)
+        {
+            printf(" %4ld", static_cast<long>(busy[i] / 1000));
+        }
+        printf(" | max/mean %.2f | heavy msgs/s %ld | migrated %lu\n",
+               totalBusy > 0 ? static_cast<double>(maxBusy) * kLoops / totalBusy : 0.0, messages / 2,
+               static_cast<unsigned long>(server.migratedConnections()));
+    });
+    loop.loop();
+    driver.join();
+}
+
+int main()
+{
+    Logger::setLogLevel(FATAL);
+    runPolicy("RoundRobin", std::make_shared<RoundRobinPolicy>(), 9991);
+    runPolicy("LeastConnections", std::make_shared<LeastConnectionsPolicy>(), 9992);
+    runPolicy("LeastPendingWork", std::make_shared<LeastPendingWorkPolicy>(), 9993);
+    runPolicy("PeerHash", std::make_shared<PeerHashPolicy>(), 9994);
+    runPolicy("RR+AutoRebalance", std::make_shared<RoundRobinPolicy>(), 9995, true);
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+
+#include "LogFile.h"
+#include "TestHarness.h"
+
+// 同步使用LogFile时，停止写入后缓冲区中的日志由LogFile自己的定时落盘写入文件，不需要调用者flush()
+
+off_t fileSize(const std::string &filename)
+{
+    struct stat st;
+    return ::stat(filename.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+int main()
+{
+    const int kFlushIntervalMs = 100;
+    std::string line = "idle logger line\n";
+    std::string filename;
+    ::mkdir("../log", 0755);
+    {
+        LogFile logFile("../log/logfile_test", 64 * 1024 * 1024, true, kFlushIntervalMs);
+        filename = logFile.currentFilename();
+        logFile.append(line.data(), line.size());
+        off_t buffered = fileSize(filename);
+
+        ::usleep(kFlushIntervalMs * 3 * 1000);
+        off_t flushed = fileSize(filename);
+        printf("file size %ld while buffered, %ld after %dms idle\n",
+               static_cast<long>(buffered), static_cast<long>(flushed), kFlushIntervalMs * 3);
+        check(buffered == 0, "append stays in the user-space buffer");
+        check(flushed == static_cast<off_t>(line.size()), "idle buffer flushed by the timer");
+    }
+    ::unlink(filename.c_str());
+    return testExitCode();
+}
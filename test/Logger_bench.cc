@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <algorithm>
+
+#include "Logger.h"
+#include "AsyncLogging.h"
+#include "LogFile.h"
+#include "Timestamp.h"
+
+const int kCount = 200000;
+
+double nsPerCall(Timestamp start, int count)
+{
+    return (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) * 1000.0 / count;
+}
+
+void benchLatency(const char *name, int fd, int events)
+{
+    int64_t maxUs = 0;
+    Timestamp start = Timestamp::now();
+    for (int i = 0; i < kCount; ++i)
+    {
+        int64_t before = Timestamp::now().microSecondsSinceEpoch();
+        LOG_INFO("func=%s => fd=%d events=%d index=%d\n", __FUNCTION__, fd, events, i);
+        maxUs = std::max(maxUs, Timestamp::now().microSecondsSinceEpoch() - before);
+    }
+    int64_t totalUs = Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
+    printf("%s: %8.0f lines/s, avg %6.2f us, max %6ld us\n",
+           name, kCount * 1e6 / totalUs, static_cast<double>(totalUs) / kCount, static_cast<long>(maxUs));
+}
+
+int main()
+{
+    int fd = 7;
+    int events = 3;
+
+    // 编译期被去掉的日志(默认MUDUO_MIN_LOG_LEVEL为INFO)
+    Timestamp start = Timestamp::now();
+    for (int i = 0; i < kCount; ++i)
+    {
+        LOG_DEBUG("func=%s => fd=%d events=%d index=%d\n", __FUNCTION__, fd, events, i);
+    }
+    printf("LOG_DEBUG compiled out:       %8.2f ns/call\n", nsPerCall(start, kCount));
+
+    // 运行期被过滤的日志，只做一次级别比较
+    Logger::setLogLevel(ERROR);
+    start = Timestamp::now();
+    for (int i = 0; i < kCount; ++i)
+    {
+        LOG_INFO("func=%s => fd=%d events=%d index=%d\n", __FUNCTION__, fd, events, i);
+    }
+    printf("LOG_INFO filtered at runtime: %8.2f ns/call\n", nsPerCall(start, kCount));
+
+    // 真正输出的日志
+    Logger::setLogLevel(INFO);
+    start = Timestamp::now();
+    for (int i = 0; i < kCount; ++i)
+    {
+        LOG_INFO("func=%s => fd=%d events=%d index=%d\n", __FUNCTION__, fd, events, i);
+    }
+    printf("LOG_INFO written:             %8.2f ns/call\n", nsPerCall(start, kCount));
+
+    // 时间戳格式化：每次localtime+snprintf+std::string 与 按秒缓存前缀写入栈上缓冲区
+    Timestamp now = Timestamp::now();
+    size_t totalLen = 0;
+    start = Timestamp::now();
+    for (int i = 0; i < kCount; ++i)
+    {
+        totalLen += now.toString().size();
+    }
+    printf("Timestamp::toString:          %8.2f ns/call\n", nsPerCall(start, kCount));
+    start = Timestamp::now();
+    for (int i = 0; i < kCount; ++i)
+    {
+        char timebuf[32];
+        totalLen += Timestamp(now.microSecondsSinceEpoch() + i).toFormattedString(timebuf, sizeof(timebuf));
+    }
+    printf("Timestamp::toFormattedString: %8.2f ns/call (%zu bytes)\n", nsPerCall(start, kCount), totalLen);
+
+    // 同步写文件与异步后端对比：吞吐以及单次调用的平均/最大延迟
+    benchLatency("sync  (ofstream + flush)", fd, events);
+
+    // 同步写入带用户态缓冲区的滚动日志文件
+    {
+        LogFile logFile("../log/logfile_bench", 64 * 1024 * 1024);
+        Logger::instance().setOutput([&logFile](const char *msg, size_t len) { logFile.append(msg, len); });
+        Logger::instance().setFlush([&logFile]() { logFile.flush(); });
+        benchLatency("sync  (LogFile)         ", fd, events);
+    }
+
+    AsyncLogging asyncLog("../log/async_bench", 64 * 1024 * 1024);
+    asyncLog.start();
+    Logger::instance().setOutput([&asyncLog](const char *msg, size_t len) { asyncLog.append(msg, len); });
+    Logger::instance().setFlush([&asyncLog]() { asyncLog.flush(); });
+    benchLatency("async (double buffer)   ", fd, events);
+    asyncLog.stop();
+    Logger::instance().setOutput(Logger::OutputFunc());
+    Logger::instance().setFlush(Logger::FlushFunc());
+    printf("async dropped lines: %zu\n", asyncLog.droppedLines());
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TcpServer.h"
+#include "Logger.h"
+#include "TestHarness.h"
+
+// 连接迁移时的发送顺序：一个非loop线程不停地send带序号的消息，另一个线程同时把连接在几个subloop之间来回迁移，
+// 客户端收到的序号必须连续递增，最后shutdown之前发出的数据也不能丢
+
+const uint16_t kPort = 9980;
+const int kLoops = 3;
+const int kMessages = 200000;
+
+int connectTo()
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    // 数据丢失、收不到EOF时不会一直阻塞
+    timeval timeout = {10, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    InetAddress addr(kPort);
+    if (::connect(fd, addr.getSockAddr(), addr.length()) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+uint16_t localPort(int fd)
+{
+    sockaddr_in local;
+    socklen_t len = sizeof local;
+    ::getsockname(fd, reinterpret_cast<sockaddr *>(&local), &len);
+    return ntohs(local.sin_port);
+}
+
+int main()
+{
+    Logger::setLogLevel(ERROR);
+    // 顺序错乱时服务端可能在客户端关闭后还在写
+    ::signal(SIGPIPE, SIG_IGN);
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(kPort), "migration", TcpServer::kReusePort);
+    server.setThreadNum(kLoops);
+    std::mutex mutex;
+    std::vector<TcpConnectionPtr> conns;
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (conn->connected())
+        {
+            conns.push_back(conn);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    server.start();
+
+    int received = 0;
+    bool inOrder = true;
+    std::atomic_bool sending(true);
+    std::thread driver([&]() {
+        // 轮询分配，每个subloop一条连接，用来拿到各loop的指针
+        std::vector<int> fds;
+        for (int i = 0; i < kLoops; ++i)
+        {
+            fds.push_back(connectTo());
+        }
+        std::vector<EventLoop *> loops;
+        TcpConnectionPtr conn;
+        for (int i = 0; i < 200 && loops.size() < kLoops; ++i)
+        {
+            ::usleep(10 * 1000);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (conns.size() == kLoops)
+            {
+                for (const TcpConnectionPtr &c : conns)
+                {
+                    loops.push_back(c->getLoop());
+                    if (c->peerAddress().toPort() == localPort(fds[0]))
+                    {
+                        conn = c;
+                    }
+                }
+            }
+        }
+        if (!conn)
+        {
+            check(false, "connections established");
+            loop.runInLoop([&loop]() { loop.quit(); });
+            return;
+        }
+
+        std::thread sender([&]() {
+            char msg[16];
+            for (int i = 0; i < kMessages; ++i)
+            {
+                snprintf(msg, sizeof msg, "%08d\n", i);
+                conn->send(msg);
+                // 让发送跨过多次迁移
+                if (i % 1000 == 999)
+                {
+                    ::usleep(1000);
+                }
+            }
+            sending = false;
+            conn->shutdown();
+        });
+        std::thread migrator([&]() {
+            // 上一次迁移完成后再发起下一次
+            while (sending)
+            {
+                uint64_t migrated = server.migratedConnections();
+                size_t current = std::find(loops.begin(), loops.end(), conn->getLoop()) - loops.begin();
+                server.migrateConnection(conn, loops[(current + 1) % kLoops]);
+                while (sending && server.migratedConnections() == migrated)
+                {
+                    ::usleep(100);
+                }
+            }
+        });
+
+        // 按9字节一条解析，检查序号连续
+        std::string pending;
+        char buf[64 * 1024];
+        ssize_t n;
+        while ((n = ::recv(fds[0], buf, sizeof buf, 0)) > 0)
+        {
+            pending.append(buf, n);
+            size_t pos = 0;
+            for (; pending.size() - pos >= 9; pos += 9)
+            {
+                if (inOrder && atoi(pending.substr(pos, 8).c_str()) != received)
+                {
+                    printf("expected message %d, got %s\n", received, pending.substr(pos, 8).c_str());
+                    inOrder = false;
+                }
+                ++received;
+            }
+            pending.erase(0, pos);
+        }
+        sender.join();
+        migrator.join();
+        for (int fd : fds)
+        {
+            ::close(fd);
+        }
+        conn.reset();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            conns.clear();
+        }
+        loop.runInLoop([&loop]() { loop.quit(); });
+    });
+    loop.runAfter(20.0, [&loop]() { loop.quit(); });
+    loop.loop();
+    driver.join();
+
+    printf("received %d/%d messages across %lu migrations\n", received, kMessages,
+           static_cast<unsigned long>(server.migratedConnections()));
+    check(server.migratedConnections() >= 3, "connection migrated repeatedly while sending");
+    check(inOrder, "messages arrive in send order across migrations");
+    check(received == kMessages, "every message sent before shutdown arrives");
+    return testExitCode();
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TcpServer.h"
+#include "Logger.h"
+#include "TestHarness.h"
+
+// 发送限速：服务端在连接建立时发出一段数据后shutdown，客户端读到EOF，按耗时计算实际速率
+// 对比不限速、单连接用户态令牌桶、单连接SO_MAX_PACING_RATE以及多个连接共用的服务器总速率
+
+const uint16_t kPort = 9950;
+const double kRate = 8 << 20;   // 8MB/s
+
+// 读到EOF，返回收到的字节数
+size_t drain(double *seconds)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    InetAddress addr(kPort);
+    size_t total = 0;
+    Timestamp start = Timestamp::now();
+    if (::connect(fd, addr.getSockAddr(), addr.length()) == 0)
+    {
+        std::vector<char> buf(64 * 1024);
+        ssize_t n;
+        while ((n = ::recv(fd, buf.data(), buf.size(), 0)) > 0)
+        {
+            total += n;
+        }
+    }
+    *seconds = (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1e6;
+    ::close(fd);
+    return total;
+}
+
+// clients个客户端同时各收bytes字节，返回最慢的一个的耗时
+double run(const char *name, size_t bytes, int clients, double connectionRate, double serverRate, bool kernelPacing)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(kPort), "pacing", TcpServer::kReusePort);
+    server.setThreadNum(2);
+    server.setSendRateLimit(connectionRate, serverRate, kernelPacing);
+    std::string payload(bytes, 'p');
+    server.setConnectionCallback([&payload](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->send(payload);
+            conn->shutdown();
+        }
+    });
+    server.start();
+
+    double slowest = 0;
+    size_t received = 0;
+    std::thread driver([&]() {
+        ::usleep(50 * 1000);
+        std::vector<std::thread> threads;
+        std::vector<double> seconds(clients);
+        std::vector<size_t> got(clients);
+        for (int i = 0; i < clients; ++i)
+        {
+            threads.emplace_back([&, i]() { got[i] = drain(&seconds[i]); });
+        }
+        for (std::thread &t : threads)
+        {
+            t.join();
+        }
+        for (int i = 0; i < clients; ++i)
+        {
+            slowest = std::max(slowest, seconds[i]);
+            received += got[i];
+        }
+        loop.quit();
+    });
+    loop.loop();
+    driver.join();
+
+    printf("%-28s %d x %4.1fMB in %.3fs, %7.2f MB/s total\n", name, clients, bytes / 1048576.0, slowest,
+           received / 1048576.0 / slowest);
+    check(received == bytes * clients, "all data delivered before EOF");
+    return slowest;
+}
+
+int main()
+{
+    Logger::setLogLevel(ERROR);
+    double expected = (4 << 20) / kRate;
+    double t = run("unlimited", 4 << 20, 1, 0, 0, false);
+    check(t < expected / 2, "unlimited connection is not paced");
+    t = run("per connection, token bucket", 4 << 20, 1, kRate, 0, false);
+    check(t > expected * 0.8 && t < expected * 1.5, "token bucket holds the connection at its rate");
+    t = run("per connection, kernel", 4 << 20, 1, kRate, 0, true);
+    check(t > expected * 0.7 && t < expected * 1.5, "SO_MAX_PACING_RATE holds the connection at its rate");
+    t = run("server total", 1 << 20, 4, 0, kRate, false);
+    check(t > expected * 0.8 && t < expected * 1.5, "connections share the server rate");
+    return testExitCode();
+}
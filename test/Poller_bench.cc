@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+
+#include "Poller.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Timestamp.h"
+
+// 只测Channel表本身的开销：100k个fd的add/find/del
+class TablePoller : public Poller
+{
+public:
+    TablePoller() : Poller(nullptr) {}
+    Timestamp poll(int, ChannelList *) override { return Timestamp::now(); }
+    void updateChannel(Channel *channel) override
+    {
+        if (findChannel(channel->fd()) != channel)
+        {
+            addChannel(channel);
+        }
+    }
+    void removeChannel(Channel *channel) override { eraseChannel(channel); }
+};
+
+double elapsedMs(Timestamp start)
+{
+    return (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000.0;
+}
+
+void benchTable(int numFds, int rounds)
+{
+    std::vector<std::unique_ptr<Channel>> channels;
+    for (int fd = 0; fd < numFds; ++fd)
+    {
+        channels.emplace_back(new Channel(nullptr, fd));
+    }
+
+    // 改造前Poller::channels_的做法
+    std::unordered_map<int, Channel *> map;
+    Timestamp start = Timestamp::now();
+    for (int r = 0; r < rounds; ++r)
+    {
+        for (auto &ch : channels) map[ch->fd()] = ch.get();
+        for (auto &ch : channels) { auto it = map.find(ch->fd()); if (it == map.end() || it->second != ch.get()) abort(); }
+        for (auto &ch : channels) map.erase(ch->fd());
+    }
+    printf("unordered_map   %d fds x %d rounds add/mod/del: %8.2f ms\n", numFds, rounds, elapsedMs(start));
+
+    TablePoller poller;
+    start = Timestamp::now();
+    for (int r = 0; r < rounds; ++r)
+    {
+        for (auto &ch : channels) poller.updateChannel(ch.get());
+        for (auto &ch : channels) { if (!poller.hasChannel(ch.get())) abort(); }
+        for (auto &ch : channels) poller.removeChannel(ch.get());
+    }
+    printf("fd-indexed slot %d fds x %d rounds add/mod/del: %8.2f ms\n", numFds, rounds, elapsedMs(start));
+}
+
+// 通过EventLoop走完整的Channel add/mod/del路径(包含epoll_ctl)，每一步在单独的一轮循环中执行
+void benchEventLoop(int numFds)
+{
+    EventLoop loop;
+    std::vector<int> fds;
+    std::vector<std::unique_ptr<Channel>> channels;
+    for (int i = 0; i < numFds; ++i)
+    {
+        int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0)
+        {
+            break;
+        }
+        fds.push_back(fd);
+        channels.emplace_back(new Channel(&loop, fd));
+    }
+
+    std::vector<EventLoop::Functor> steps;
+    // 注册读事件
+    steps.push_back([&]() { for (auto &ch : channels) ch->enableReading(); });
+    // 模拟sendInLoop一次写完：同一轮内打开又关闭写事件
+    steps.push_back([&]() { for (auto &ch : channels) { ch->enableWriting(); ch->disableWriting(); } });
+    // 模拟数据没写完：打开写事件，下一轮再关闭
+    steps.push_back([&]() { for (auto &ch : channels) ch->enableWriting(); });
+    steps.push_back([&]() { for (auto &ch : channels) ch->disableWriting(); });
+    steps.push_back([&]() { for (auto &ch : channels) { ch->disableAll(); ch->remove(); } });
+
+    size_t next = 0;
+    std::function<void()> runStep = [&]() {
+        if (next == steps.size())
+        {
+            loop.quit();
+            return;
+        }
+        steps[next++]();
+        loop.queueInLoop(runStep);
+    };
+
+    Timestamp start = Timestamp::now();
+    loop.queueInLoop(runStep);
+    loop.wakeup();
+    loop.loop();
+    printf("EventLoop       %zu fds add/mod/mod/del:            %8.2f ms, elided updates %zu\n",
+           fds.size(), elapsedMs(start), loop.elidedChannelUpdates());
+
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+}
+
+int main()
+{
+    benchTable(100000, 10);
+
+    // 尽量提高fd上限，实际能打开多少个eventfd就测多少个
+    rlimit rl;
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &rl);
+    int numFds = static_cast<int>(std::min<rlim_t>(100000, rl.rlim_cur - 64));
+    benchEventLoop(numFds);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <memory>
+
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "TestHarness.h"
+
+// Poller的关注事件语义，epoll和io_uring两个后端各跑一遍：
+//   1. 可读事件触发后在回调里关闭读，之后的循环中重新打开，数据还在就应该再次触发
+//   2. 在同一个回调里先关闭再打开读，修改被合并后仍然继续触发
+//   3. 数据不读走时保持LT语义，每轮循环都触发
+// eventfd的计数不读走就一直可读
+
+const double kTimeout = 2.0;
+
+std::unique_ptr<EventLoop> newLoop(bool ioUring)
+{
+    if (ioUring)
+    {
+        ::setenv("MUDUO_USE_IO_URING", "1", 1);
+    }
+    std::unique_ptr<EventLoop> loop(new EventLoop);
+    ::unsetenv("MUDUO_USE_IO_URING");
+    return loop;
+}
+
+// 回调里关闭读，20ms后重新打开
+void testReenableAfterFire(bool ioUring, const char *backend)
+{
+    std::unique_ptr<EventLoop> loop = newLoop(ioUring);
+    int fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    Channel channel(loop.get(), fd);
+    int fires = 0;
+    Timestamp firstFire;
+    double refireAfter = -1;
+    channel.setReadCallback([&](Timestamp) {
+        if (++fires == 1)
+        {
+            firstFire = Timestamp::now();
+            channel.disableReading();
+            loop->runAfter(0.02, [&]() { channel.enableReading(); });
+        }
+        else
+        {
+            refireAfter = (Timestamp::now().microSecondsSinceEpoch() - firstFire.microSecondsSinceEpoch()) / 1e6;
+            channel.disableAll();
+            loop->quit();
+        }
+    });
+    channel.enableReading();
+    loop->runAfter(kTimeout, [&]() { loop->quit(); });
+    loop->loop();
+
+    printf("%s: re-enabled channel fired %d time(s), again after %.3fs\n", backend, fires, refireAfter);
+    check(fires == 2, "re-enabled read interest fires again");
+    check(refireAfter >= 0.019, "no events while reading was disabled");
+    channel.disableAll();
+    channel.remove();
+    ::close(fd);
+}
+
+// 回调里关闭读又立即打开，两次修改合并为无变化
+void testToggleInSameCallback(bool ioUring)
+{
+    std::unique_ptr<EventLoop> loop = newLoop(ioUring);
+    int fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    Channel channel(loop.get(), fd);
+    int fires = 0;
+    channel.setReadCallback([&](Timestamp) {
+        if (++fires == 3)
+        {
+            channel.disableAll();
+            loop->quit();
+            return;
+        }
+        channel.disableReading();
+        channel.enableReading();
+    });
+    channel.enableReading();
+    loop->runAfter(kTimeout, [&]() { loop->quit(); });
+    loop->loop();
+
+    check(fires == 3, "read interest toggled in one callback keeps firing");
+    channel.disableAll();
+    channel.remove();
+    ::close(fd);
+}
+
+// 不读走数据，每轮循环都应触发
+void testLevelTriggered(bool ioUring)
+{
+    std::unique_ptr<EventLoop> loop = newLoop(ioUring);
+    int fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    Channel channel(loop.get(), fd);
+    int fires = 0;
+    channel.setReadCallback([&](Timestamp) {
+        if (++fires == 10)
+        {
+            loop->quit();
+        }
+    });
+    channel.enableReading();
+    loop->runAfter(kTimeout, [&]() { loop->quit(); });
+    loop->loop();
+
+    check(fires == 10, "unread data keeps firing (level triggered)");
+    channel.disableAll();
+    channel.remove();
+    ::close(fd);
+}
+
+int main()
+{
+    Logger::setLogLevel(ERROR);
+    const char *backends[] = {"epoll", "io_uring"};
+    for (int i = 0; i < 2; ++i)
+    {
+        bool ioUring = i == 1;
+        testReenableAfterFire(ioUring, backends[i]);
+        testToggleInSameCallback(ioUring);
+        testLevelTriggered(ioUring);
+    }
+    return testExitCode();
+}
@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <set>
+#include <string>
+
+#include "PreforkServer.h"
+#include "TcpServer.h"
+#include "Logger.h"
+#include "TestHarness.h"
+
+// 多进程模式：supervisor进程fork出若干worker，worker被杀后supervisor重新fork，期间客户端的连接不被拒绝
+// worker回复"pid"请求时带上自己的进程号，回复"stats"请求时带上共享内存页中所有worker的汇总统计
+// 测试进程只做客户端，supervisor在fork出的子进程中运行
+
+const uint16_t kPort = 9960;
+
+pid_t startSupervisor(PreforkServer::Option option, int workers)
+{
+    pid_t pid = ::fork();
+    if (pid != 0)
+    {
+        return pid;
+    }
+    Logger::setLogLevel(ERROR);
+    PreforkServer prefork(InetAddress(kPort), "prefork", workers, option);
+    prefork.setDrainSeconds(1.0);
+    PreforkServer *raw = &prefork;
+    prefork.setWorkerSetup([raw](TcpServer &server, int) {
+        server.setConnectionCallback([](const TcpConnectionPtr &) {});
+        server.setMessageCallback([raw](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            std::string request = buf->retrieveAllAsString();
+            ++raw->localStats()->counters[0];
+            if (request == "stats\n")
+            {
+                PreforkServer::Totals totals = raw->totals();
+                conn->send(std::to_string(totals.liveWorkers) + " " + std::to_string(totals.restarts) + " "
+                           + std::to_string(totals.counters[0]) + "\n");
+            }
+            else
+            {
+                conn->send(std::to_string(::getpid()) + "\n");
+            }
+        });
+    });
+    prefork.run();
+    ::_exit(0);
+}
+
+// 发一个请求并读一行回复，失败返回空串
+std::string request(const char *req)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    InetAddress addr(kPort);
+    std::string reply;
+    if (::connect(fd, addr.getSockAddr(), addr.length()) == 0)
+    {
+        timeval timeout = {2, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ::send(fd, req, strlen(req), MSG_NOSIGNAL);
+        char c;
+        while (::recv(fd, &c, 1, 0) == 1 && c != '\n')
+        {
+            reply += c;
+        }
+    }
+    ::close(fd);
+    return reply;
+}
+
+bool waitUntilServing()
+{
+    for (int i = 0; i < 200; ++i)
+    {
+        if (!request("pid\n").empty())
+        {
+            return true;
+        }
+        ::usleep(10 * 1000);
+    }
+    return false;
+}
+
+// 停止supervisor，返回其退出码，超时返回-1
+int stopSupervisor(pid_t supervisor)
+{
+    ::kill(supervisor, SIGTERM);
+    for (int i = 0; i < 500; ++i)
+    {
+        int status;
+        if (::waitpid(supervisor, &status, WNOHANG) == supervisor)
+        {
+            return WIFEXITED(status) ? WEXITSTATUS(status) : 128;
+        }
+        ::usleep(10 * 1000);
+    }
+    ::kill(supervisor, SIGKILL);
+    ::waitpid(supervisor, nullptr, 0);
+    return -1;
+}
+
+void run(PreforkServer::Option option, const char *name)
+{
+    const int kWorkers = 3;
+    printf("--- %s ---\n", name);
+    pid_t supervisor = startSupervisor(option, kWorkers);
+    check(waitUntilServing(), "workers serving");
+
+    std::set<std::string> pids;
+    int failed = 0;
+    for (int i = 0; i < 60; ++i)
+    {
+        std::string pid = request("pid\n");
+        failed += pid.empty();
+        pids.insert(pid);
+    }
+    std::string stats = request("stats\n");
+    int live = 0, restarts = -1;
+    unsigned long requests = 0;
+    sscanf(stats.c_str(), "%d %d %lu", &live, &restarts, &requests);
+    printf("%lu distinct worker(s) served 60 requests; stats: %d live, %d restarts, %lu requests\n",
+           static_cast<unsigned long>(pids.size()), live, restarts, requests);
+    check(failed == 0, "every request answered");
+    if (option == PreforkServer::kReusePortPerWorker)
+    {
+        check(pids.size() == kWorkers, "connections spread over all workers");
+    }
+    check(live == kWorkers && restarts == 0, "stats page shows all workers");
+    check(requests >= 61, "request counters aggregated across processes");
+
+    // 杀掉一个worker，期间连接继续到达
+    ::usleep(1100 * 1000);   // 活过最短存活时间，立即重启
+    pid_t victim = static_cast<pid_t>(atoi(pids.begin()->c_str()));
+    ::kill(victim, SIGKILL);
+    failed = 0;
+    std::set<std::string> after;
+    for (int i = 0; i < 100; ++i)
+    {
+        std::string pid = request("pid\n");
+        failed += pid.empty();
+        after.insert(pid);
+        ::usleep(2000);
+    }
+    stats = request("stats\n");
+    sscanf(stats.c_str(), "%d %d %lu", &live, &restarts, &requests);
+    bool replaced = after.count(std::to_string(victim)) == 0 && after.size() == pids.size();
+    printf("after killing pid %d: %d failed, %lu distinct worker(s); stats: %d live, %d restarts\n",
+           victim, failed, static_cast<unsigned long>(after.size()), live, restarts);
+    check(failed == 0, "no request lost while a worker restarts");
+    check(replaced, "killed worker replaced by a new process");
+    check(live == kWorkers && restarts == 1, "restart recorded in stats page");
+
+    int exitCode = stopSupervisor(supervisor);
+    check(exitCode == 0, "supervisor stops its workers and exits");
+    check(request("pid\n").empty(), "nothing listening after shutdown");
+}
+
+int main()
+{
+    ::signal(SIGPIPE, SIG_IGN);
+    run(PreforkServer::kReusePortPerWorker, "SO_REUSEPORT socket per worker");
+    run(PreforkServer::kSharedListenSocket, "shared listen socket");
+    return testExitCode();
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TcpServer.h"
+#include "Logger.h"
+#include "TestHarness.h"
+
+// 慢消费者保护：服务端每隔几毫秒向所有连接广播一条消息，一个客户端正常读取，另一个不读
+// 丢弃策略下慢连接的输出缓冲区始终不超过上限，正常连接收到全部消息；关闭策略下慢连接在延迟后被关闭
+// 同时检查TcpServer转交的高水位回调，以及等待延迟关闭期间执行的跨线程发送被丢弃
+
+const uint16_t kPort = 9940;
+const size_t kMessageBytes = 16 * 1024;
+const int kMessages = 500;
+const size_t kCap = 512 * 1024;
+
+int connectToServer(int rcvbuf, uint16_t port = kPort)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (rcvbuf > 0)
+    {
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    InetAddress addr(port);
+    if (::connect(fd, addr.getSockAddr(), addr.length()) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+struct Result
+{
+    size_t fastReceived = 0;
+    size_t maxSlowPending = 0;
+    int highWaterMarks = 0;
+    uint64_t dropped = 0;
+    uint64_t closed = 0;
+    size_t connectionsAfter = 0;
+    double slowClosedAfter = -1;    // 慢连接被关闭时距第一次超限的秒数
+};
+
+Result run(TcpConnection::OverflowPolicy policy, double closeDelay)
+{
+    Result result;
+    EventLoop loop;
+    // 服务器析构时还会回调连接断开，这两个要比server活得久
+    std::set<TcpConnectionPtr> conns;
+    Timestamp firstOverflow;
+    TcpServer server(&loop, InetAddress(kPort), "broadcast", TcpServer::kReusePort);
+    server.setOutputBufferCap(kCap, policy, closeDelay);
+    server.setHighWaterMarkCallback([&result](const TcpConnectionPtr &, size_t) { ++result.highWaterMarks; }, kCap / 4);
+    server.setOutputOverflowCallback([&firstOverflow](const TcpConnectionPtr &, size_t, size_t) {
+        if (!firstOverflow.valid())
+        {
+            firstOverflow = Timestamp::now();
+        }
+    });
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conns.insert(conn);
+        }
+        else
+        {
+            conns.erase(conn);
+            if (firstOverflow.valid() && result.slowClosedAfter < 0)
+            {
+                result.slowClosedAfter = (Timestamp::now().microSecondsSinceEpoch() - firstOverflow.microSecondsSinceEpoch()) / 1e6;
+            }
+        }
+    });
+    server.start();
+
+    std::atomic_bool done(false);
+    std::thread fast([&result, &done]() {
+        int fd = connectToServer(0);
+        std::vector<char> buf(64 * 1024);
+        while (result.fastReceived < kMessages * kMessageBytes)
+        {
+            ssize_t n = ::recv(fd, buf.data(), buf.size(), 0);
+            if (n <= 0)
+            {
+                break;
+            }
+            result.fastReceived += n;
+        }
+        while (!done)
+        {
+            ::usleep(10 * 1000);
+        }
+        ::close(fd);
+    });
+    int slow = connectToServer(4096);
+
+    // 两个客户端都连上之后开始广播
+    int sent = 0;
+    std::string message(kMessageBytes, 'b');
+    TimerId broadcast = loop.runEvery(0.002, [&]() {
+        if (conns.size() < 2 && sent == 0)
+        {
+            return;
+        }
+        if (sent < kMessages)
+        {
+            ++sent;
+            for (const TcpConnectionPtr &conn : conns)
+            {
+                conn->send(message);
+                result.maxSlowPending = std::max(result.maxSlowPending, conn->outputBufferBytes());
+            }
+        }
+        else
+        {
+            loop.quit();
+        }
+    });
+    loop.loop();
+    loop.cancel(broadcast);
+    // 等延迟关闭完成
+    loop.runAfter(closeDelay + 0.1, [&loop]() { loop.quit(); });
+    loop.loop();
+
+    result.dropped = server.overflowDroppedMessages();
+    result.closed = server.overflowClosedConnections();
+    result.connectionsAfter = server.connectionCount();
+    done = true;
+    fast.join();
+    ::close(slow);
+    return result;
+}
+
+// 其他线程send()时连接还是kConnected，投递的发送执行前调用了forceCloseWithDelay，这条消息不应发出
+void testSendDroppedWhileClosePending()
+{
+    const uint16_t port = kPort + 1;
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "closing", TcpServer::kReusePort);
+    server.setThreadNum(1);
+    TcpConnectionPtr conn;
+    std::atomic_bool connected(false);
+    server.setConnectionCallback([&](const TcpConnectionPtr &c) {
+        if (c->connected())
+        {
+            conn = c;
+            connected = true;
+        }
+        else
+        {
+            conn.reset();   // socket随最后一个引用关闭，客户端才能读到EOF
+        }
+    });
+    server.start();
+
+    std::string received;
+    ssize_t n = -1;
+    std::thread client([&]() {
+        int fd = connectToServer(0, port);
+        while (!connected)
+        {
+            ::usleep(1000);
+        }
+        // 先让连接所在的loop忙一会儿，保证投递的发送在forceCloseWithDelay之后才执行
+        std::atomic_bool release(false);
+        conn->getLoop()->queueInLoop([&release]() {
+            while (!release)
+            {
+                ::usleep(1000);
+            }
+        });
+        conn->send("late\n");
+        conn->forceCloseWithDelay(0.2);
+        release = true;
+
+        char buf[64];
+        while ((n = ::recv(fd, buf, sizeof(buf), 0)) > 0)
+        {
+            received.append(buf, n);
+        }
+        ::close(fd);
+        loop.runInLoop([&loop]() { loop.quit(); });
+    });
+    loop.runAfter(3.0, [&loop]() { loop.quit(); });
+    loop.loop();
+    client.join();
+    check(n == 0 && received.empty(), "send queued before delayed close is dropped");
+}
+
+int main()
+{
+    Logger::setLogLevel(ERROR);
+    Result drop = run(TcpConnection::kDropMessage, 0);
+    printf("drop: fast got %lu/%lu bytes, slow pending peak %lu, %lu message(s) dropped, %d high-water callback(s)\n",
+           static_cast<unsigned long>(drop.fastReceived), static_cast<unsigned long>(kMessages * kMessageBytes),
+           static_cast<unsigned long>(drop.maxSlowPending), static_cast<unsigned long>(drop.dropped), drop.highWaterMarks);
+    check(drop.fastReceived == kMessages * kMessageBytes, "fast reader receives every message");
+    check(drop.maxSlowPending <= kCap, "slow reader's output buffer stays under the cap");
+    check(drop.dropped > 0 && drop.connectionsAfter == 2, "messages dropped, slow connection kept");
+    check(drop.highWaterMarks == 1, "server-level high-water callback fires once");
+
+    Result close = run(TcpConnection::kForceClose, 0.2);
+    printf("close: fast got %lu/%lu bytes, %lu connection(s) closed %.3fs after overflow, %lu left\n",
+           static_cast<unsigned long>(close.fastReceived), static_cast<unsigned long>(kMessages * kMessageBytes),
+           static_cast<unsigned long>(close.closed), close.slowClosedAfter, static_cast<unsigned long>(close.connectionsAfter));
+    check(close.fastReceived == kMessages * kMessageBytes, "fast reader unaffected");
+    check(close.closed == 1 && close.connectionsAfter == 1, "slow connection force-closed");
+    check(close.slowClosedAfter >= 0.19 && close.slowClosedAfter < 0.5, "close delayed by forceCloseWithDelay");
+
+    testSendDroppedWhileClosePending();
+    return testExitCode();
+}
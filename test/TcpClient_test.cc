@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory>
+#include <vector>
+
+#include "TcpClient.h"
+#include "TcpServer.h"
+#include "Logger.h"
+#include "TestHarness.h"
+
+// TcpClient/Connector的三个场景：
+//   1. 服务器晚于客户端启动，客户端按指数退避重试直到连上
+//   2. 在同一个loop上并发发起大量连接，定时器检查loop没有被connect阻塞
+//   3. 连接不可达的地址时按超时放弃并重试
+//   4. 设置了最大尝试次数时，连续失败后放弃并回调
+//   5. 在io_uring后端上析构已连接的TcpClient(只有它持有连接/别人也持有连接)，连接在Channel注销后才析构
+// 用法：TcpClient_test [clients]
+
+void testRetryUntilServerUp()
+{
+    EventLoop loop;
+    InetAddress addr(9920);
+    TcpClient client(&loop, addr, "RetryClient");
+    client.setRetryDelay(50, 1000);
+    Timestamp start = Timestamp::now();
+    double connectedAfter = -1;
+    client.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            connectedAfter = (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1e6;
+            loop.quit();
+        }
+    });
+    client.connect();
+
+    std::unique_ptr<TcpServer> server;
+    loop.runAfter(0.6, [&]() {
+        server.reset(new TcpServer(&loop, addr, "LateServer", TcpServer::kReusePort));
+        server->setConnectionCallback([](const TcpConnectionPtr &) {});
+        server->start();
+    });
+    loop.runAfter(5.0, [&]() { loop.quit(); });
+    loop.loop();
+
+    printf("connected after %.3fs, %d connect attempts\n", connectedAfter, client.connectAttempts());
+    check(connectedAfter >= 0.6 && connectedAfter < 2.0, "reconnected with backoff after server came up");
+    check(client.connectAttempts() >= 3 && client.connectAttempts() <= 8, "backoff kept attempts bounded");
+    client.disconnect();
+}
+
+void testManyConcurrentConnects(int numClients)
+{
+    EventLoop loop;
+    InetAddress addr(9921);
+    TcpServer server(&loop, addr, "FanInServer", TcpServer::kReusePort);
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.start();
+
+    int connected = 0;
+    Timestamp start = Timestamp::now();
+    double allConnectedAfter = -1;
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    for (int i = 0; i < numClients; ++i)
+    {
+        clients.emplace_back(new TcpClient(&loop, addr, "Upstream"));
+        clients.back()->setConnectionCallback([&](const TcpConnectionPtr &conn) {
+            if (conn->connected() && ++connected == numClients)
+            {
+                allConnectedAfter = (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1e6;
+                loop.quit();
+            }
+        });
+        clients.back()->connect();
+    }
+
+    // 1ms的定时器，统计相邻两次触发的最大间隔
+    int64_t lastTick = Timestamp::now().microSecondsSinceEpoch();
+    int64_t maxGap = 0;
+    loop.runEvery(0.001, [&]() {
+        int64_t now = Timestamp::now().microSecondsSinceEpoch();
+        maxGap = std::max(maxGap, now - lastTick);
+        lastTick = now;
+    });
+    loop.runAfter(5.0, [&]() { loop.quit(); });
+    loop.loop();
+
+    printf("%d/%d connected in %.3fs, max timer gap %.2fms\n", connected, numClients, allConnectedAfter, maxGap / 1000.0);
+    check(connected == numClients, "all concurrent connects completed");
+    check(maxGap < 100 * 1000, "loop was never blocked for 100ms");
+    for (std::unique_ptr<TcpClient> &client : clients)
+    {
+        client->disconnect();
+    }
+}
+
+void testConnectTimeout()
+{
+    EventLoop loop;
+    // 保留的不可路由地址，SYN得不到回应；没有路由的环境下connect会直接失败，同样走重试
+    TcpClient client(&loop, InetAddress(9, "10.255.255.1"), "TimeoutClient");
+    client.setConnectTimeout(0.2);
+    client.setRetryDelay(100, 200);
+    client.connect();
+    loop.runAfter(1.0, [&]() { loop.quit(); });
+    loop.loop();
+    client.stop();
+
+    printf("%d connect attempts within 1s\n", client.connectAttempts());
+    check(client.connectAttempts() >= 2 && !client.connection(), "timed out attempts were retried");
+}
+
+void testGiveUpAfterMaxAttempts()
+{
+    EventLoop loop;
+    TcpClient client(&loop, InetAddress(9922), "GiveUpClient");
+    client.setRetryDelay(20, 40);
+    client.setMaxConnectAttempts(3);
+    int failures = 0;
+    client.setConnectFailedCallback([&]() {
+        ++failures;
+        // 再等一会儿，确认放弃后不再重试
+        loop.runAfter(0.2, [&]() { loop.quit(); });
+    });
+    client.connect();
+    loop.runAfter(2.0, [&]() { loop.quit(); });
+    loop.loop();
+
+    printf("gave up after %d connect attempts, %d failure callbacks\n", client.connectAttempts(), failures);
+    check(failures == 1 && client.connectAttempts() == 3, "gave up after max attempts and reported it once");
+}
+
+void testDestroyConnectedClient(bool keepReference)
+{
+    // 选择io_uring后端，内核不支持时退回epoll
+    ::setenv("MUDUO_USE_IO_URING", "1", 1);
+    EventLoop loop;
+    ::unsetenv("MUDUO_USE_IO_URING");
+    InetAddress addr(9923);
+    TcpServer server(&loop, addr, "DestroyServer", TcpServer::kReusePort);
+    int serverDown = 0;
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (!conn->connected())
+        {
+            ++serverDown;
+        }
+    });
+    server.start();
+
+    std::unique_ptr<TcpClient> client(new TcpClient(&loop, addr, "DestroyClient"));
+    TcpConnectionPtr kept;
+    client->setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            // 不在连接自己的回调栈里析构
+            loop.queueInLoop([&]() {
+                if (keepReference)
+                {
+                    kept = client->connection();
+                }
+                client.reset();
+            });
+        }
+    });
+    client->connect();
+    // 析构后继续跑几轮，让loop处理已注销连接上可能到来的事件
+    loop.runAfter(0.2, [&]() { kept.reset(); });
+    loop.runAfter(0.4, [&]() { loop.quit(); });
+    loop.loop();
+
+    printf("client destroyed (%s), server saw %d disconnect(s)\n", keepReference ? "shared" : "unique", serverDown);
+    check(!client && serverDown == 1, keepReference ? "destroyed shared client, peer saw close" : "destroyed client, peer saw close");
+}
+
+int main(int argc, char *argv[])
+{
+    int numClients = argc > 1 ? atoi(argv[1]) : 500;
+    Logger::setLogLevel(ERROR);
+    testRetryUntilServerUp();
+    testManyConcurrentConnects(numClients);
+    testConnectTimeout();
+    testGiveUpAfterMaxAttempts();
+    testDestroyConnectedClient(false);
+    testDestroyConnectedClient(true);
+    return testExitCode();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <atomic>
+#include <stdio.h>
+
+/**
+ * 自检测试共用的检查工具
+ * 每项检查打印一行结果，失败时计数；main最后 return testExitCode()，由CTest根据退出码判断是否通过
+ * 计数是原子的，可以在loop线程的回调里调用check
+ **/
+
+inline std::atomic_int &testFailures()
+{
+    static std::atomic_int failures(0);
+    return failures;
+}
+
+inline void check(bool ok, const char *what)
+{
+    printf("%-56s %s\n", what, ok ? "ok" : "FAILED");
+    fflush(stdout);
+    if (!ok)
+    {
+        ++testFailures();
+    }
+}
+
+inline int testExitCode()
+{
+    return testFailures() == 0 ? 0 : 1;
+}
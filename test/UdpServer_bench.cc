@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+
+#include "UdpServer.h"
+#include "Logger.h"
+
+// 回环上的UDP回显服务器收包速率(pps)：对比逐个收发(批大小1)、recvmmsg/sendmmsg批量收发、GSO合并回复、
+// GRO合并接收(发送端用GSO发出大报文)以及每个loop一个SO_REUSEPORT socket
+// 若干发送线程各用一个socket不停地用sendmmsg发送，不读取回复
+// 用法：UdpServer_bench [seconds senders]
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+const uint16_t kPort = 9980;
+const size_t kPayload = 64;
+const int kSenderBatch = 64;
+
+std::atomic_bool g_stop(false);
+
+void sender(bool gso)
+{
+    int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    InetAddress server(kPort);
+    std::vector<char> payload(kPayload * kSenderBatch, 'm');
+    std::vector<mmsghdr> msgs(kSenderBatch);
+    std::vector<iovec> iovs(kSenderBatch);
+    for (int i = 0; i < kSenderBatch; ++i)
+    {
+        iovs[i].iov_base = &payload[i * kPayload];
+        iovs[i].iov_len = kPayload;
+        ::memset(&msgs[i], 0, sizeof(mmsghdr));
+        msgs[i].msg_hdr.msg_name = const_cast<sockaddr *>(server.getSockAddr());
+        msgs[i].msg_hdr.msg_namelen = server.length();
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    if (gso)
+    {
+        // 一次发出kSenderBatch个分段的大报文，由内核切分
+        int segment = static_cast<int>(kPayload);
+        ::setsockopt(fd, IPPROTO_UDP, UDP_SEGMENT, &segment, sizeof(segment));
+        iovs[0].iov_len = payload.size();
+    }
+    while (!g_stop)
+    {
+        ::sendmmsg(fd, msgs.data(), gso ? 1 : kSenderBatch, 0);
+    }
+    ::close(fd);
+}
+
+// 发送一组内容不同的数据报，检查回显一一对应
+bool echoCheck()
+{
+    int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    timeval timeout = {1, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    InetAddress server(kPort);
+    const int kCount = 100;
+    for (int i = 0; i < kCount; ++i)
+    {
+        std::string msg = "echo-" + std::to_string(i);
+        ::sendto(fd, msg.data(), msg.size(), 0, server.getSockAddr(), server.length());
+    }
+    int matched = 0;
+    char buf[128];
+    for (int i = 0; i < kCount; ++i)
+    {
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+        {
+            break;
+        }
+        if (std::string(buf, n) == "echo-" + std::to_string(i))
+        {
+            ++matched;
+        }
+    }
+    ::close(fd);
+    return matched == kCount;
+}
+
+void run(const char *name, UdpServer::Option option, int threads, int batch, bool gso, bool gro,
+         double seconds, int senders)
+{
+    EventLoop loop;
+    UdpServer server(&loop, InetAddress(kPort), name, option);
+    server.setThreadNum(threads);
+    server.setBatchSize(batch);
+    server.enableGso(gso);
+    server.enableGro(gro);
+    server.setReceiveBufferSize(4 << 20);
+    server.setDatagramCallback([](UdpEndpoint *endpoint, const InetAddress &peer, const char *data, size_t len, Timestamp) {
+        endpoint->send(peer, data, len);
+    });
+    server.start();
+
+    bool echoOk = false;
+    uint64_t received = 0, receiveCalls = 0, sent = 0, sendCalls = 0, dropped = 0;
+    std::thread driver([&]() {
+        ::usleep(100 * 1000);
+        echoOk = echoCheck();
+        g_stop = false;
+        std::vector<std::thread> workers;
+        for (int i = 0; i < senders; ++i)
+        {
+            workers.emplace_back(sender, gro);
+        }
+        ::usleep(200 * 1000);   // 预热
+        uint64_t startReceived = server.receivedDatagrams();
+        uint64_t startReceiveCalls = server.receiveCalls();
+        uint64_t startSent = server.sentDatagrams();
+        uint64_t startSendCalls = server.sendCalls();
+        uint64_t startDropped = server.droppedSends();
+        ::usleep(static_cast<useconds_t>(seconds * 1e6));
+        received = server.receivedDatagrams() - startReceived;
+        receiveCalls = server.receiveCalls() - startReceiveCalls;
+        sent = server.sentDatagrams() - startSent;
+        sendCalls = server.sendCalls() - startSendCalls;
+        dropped = server.droppedSends() - startDropped;
+        g_stop = true;
+        for (std::thread &t : workers)
+        {
+            t.join();
+        }
+        loop.quit();
+    });
+    loop.loop();
+    driver.join();
+
+    printf("%-24s %5s %10.0f %10.0f %9.1f %9.1f %9lu\n", name, echoOk ? "ok" : "FAIL",
+           received / seconds, sent / seconds,
+           receiveCalls ? static_cast<double>(received) / receiveCalls : 0.0,
+           sendCalls ? static_cast<double>(sent) / sendCalls : 0.0,
+           static_cast<unsigned long>(dropped));
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    int senders = argc > 2 ? atoi(argv[2]) : 2;
+    Logger::setLogLevel(ERROR);
+
+    printf("%d senders, %lu-byte datagrams, %.1fs per run\n", senders, static_cast<unsigned long>(kPayload), seconds);
+    printf("%-24s %5s %10s %10s %9s %9s %9s\n", "mode", "echo", "rx pps", "tx pps", "rx/call", "tx/call", "dropped");
+    run("batch 1", UdpServer::kSingleSocket, 0, 1, false, false, seconds, senders);
+    run("batch 64", UdpServer::kSingleSocket, 0, 64, false, false, seconds, senders);
+    run("batch 64 + GSO", UdpServer::kSingleSocket, 0, 64, true, false, seconds, senders);
+    run("batch 64 + GSO + GRO", UdpServer::kSingleSocket, 0, 64, true, true, seconds, senders);
+    run("reuseport x2, batch 64", UdpServer::kReusePortPerLoop, 2, 64, false, false, seconds, senders);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "EventLoopThread.h"
+#include "TcpClient.h"
+#include "TcpServer.h"
+#include "Logger.h"
+
+// 对比同一主机上回环TCP(IPv4/IPv6)与Unix域socket(文件路径/抽象命名空间)的请求-响应延迟
+// 服务端在单独的IO线程中回显，客户端每收到一个回显才发下一个消息
+// 用法：UnixSocket_bench [roundTrips messageBytes]
+
+struct Result
+{
+    int completed = 0;
+    double avgUs = 0;
+    int64_t p50Us = 0;
+    int64_t p99Us = 0;
+    std::string serverSide;     // 服务端看到的本端/对端地址
+};
+
+Result pingPong(const InetAddress &addr, int roundTrips, size_t messageBytes)
+{
+    Result result;
+
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    std::unique_ptr<TcpServer> server(new TcpServer(serverLoop, addr, "UnixSocketBench"));
+    server->setConnectionCallback([&result](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            result.serverSide = conn->localAddress().toIpPort() + " <- " + conn->peerAddress().toIpPort();
+        }
+    });
+    server->setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        conn->send(buf->retrieveAllAsString());
+    });
+    server->start();
+
+    EventLoop loop;
+    TcpClient client(&loop, addr, "UnixSocketBenchClient");
+    client.setRetryDelay(10, 100);
+    const std::string message(messageBytes, 'x');
+    std::vector<int64_t> latencies;
+    latencies.reserve(roundTrips);
+    Timestamp sentAt;
+    size_t received = 0;
+
+    client.setConnectionCallback([&](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            sentAt = Timestamp::now();
+            conn->send(message);
+        }
+    });
+    client.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        received += buf->readableBytes();
+        buf->retrieveAll();
+        if (received < messageBytes)
+        {
+            return;
+        }
+        received = 0;
+        Timestamp now = Timestamp::now();
+        latencies.push_back(now.microSecondsSinceEpoch() - sentAt.microSecondsSinceEpoch());
+        if (static_cast<int>(latencies.size()) == roundTrips)
+        {
+            loop.quit();
+            return;
+        }
+        sentAt = now;
+        conn->send(message);
+    });
+    client.connect();
+    loop.runAfter(30.0, [&loop]() { loop.quit(); });
+    loop.loop();
+
+    result.completed = static_cast<int>(latencies.size());
+    if (!latencies.empty())
+    {
+        int64_t sum = 0;
+        for (int64_t us : latencies)
+        {
+            sum += us;
+        }
+        result.avgUs = static_cast<double>(sum) / latencies.size();
+        std::sort(latencies.begin(), latencies.end());
+        result.p50Us = latencies[latencies.size() / 2];
+        result.p99Us = latencies[latencies.size() * 99 / 100];
+    }
+
+    client.disconnect();
+    std::atomic_bool destroyed(false);
+    serverLoop->runInLoop([&server, &destroyed]() {
+        server.reset();
+        destroyed = true;
+    });
+    while (!destroyed)
+    {
+        ::usleep(1000);
+    }
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int roundTrips = argc > 1 ? atoi(argv[1]) : 20000;
+    size_t messageBytes = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 64;
+    Logger::setLogLevel(ERROR);
+
+    struct Case
+    {
+        const char *name;
+        InetAddress addr;
+    };
+    std::string path = "/tmp/unixsocket_bench." + std::to_string(::getpid()) + ".sock";
+    Case cases[] = {
+        {"tcp 127.0.0.1", InetAddress(9970, "127.0.0.1")},
+        {"tcp [::1]", InetAddress(9971, "::1")},
+        {"unix path", InetAddress::fromUnixPath(path)},
+        {"unix abstract", InetAddress::fromUnixPath("@unixsocket_bench." + std::to_string(::getpid()))},
+    };
+
+    printf("%d round trips of %lu bytes\n", roundTrips, static_cast<unsigned long>(messageBytes));
+    printf("%-15s %9s %9s %9s %9s   %s\n", "transport", "completed", "avg(us)", "p50(us)", "p99(us)", "server side");
+    for (const Case &c : cases)
+    {
+        Result r = pingPong(c.addr, roundTrips, messageBytes);
+        printf("%-15s %9d %9.1f %9ld %9ld   %s\n", c.name, r.completed, r.avgUs,
+               static_cast<long>(r.p50Us), static_cast<long>(r.p99Us), r.serverSide.c_str());
+    }
+    // 监听文件由Acceptor析构时删除
+    printf("socket file removed: %s\n", ::access(path.c_str(), F_OK) == 0 ? "no" : "yes");
+    return 0;
+}
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdlib.h>
+#include <memory>
+#include <string>
+
+#include "EventLoopThread.h"
+#include "TcpClient.h"
+#include "TcpServer.h"
+#include "UpstreamPool.h"
+#include "Logger.h"
+#include "TestHarness.h"
+
+// UpstreamPool的功能检查，并对比每次调用新建连接与复用连接池的耗时
+// 后端是按行的请求/响应协议："REQ n\n" -> "RES n\n"
+
+const uint16_t kPort = 9910;
+
+double secondsSince(Timestamp start)
+{
+    return (Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1e6;
+}
+
+// 切出一行响应，"RES n"中的n作为请求id
+bool parseLine(Buffer *buf, uint64_t *requestId, std::string *response)
+{
+    const char *begin = buf->peek();
+    const char *end = begin + buf->readableBytes();
+    const char *eol = std::find(begin, end, '\n');
+    if (eol == end)
+    {
+        return false;
+    }
+    response->assign(begin, eol);
+    buf->retrieve(eol - begin + 1);
+    *requestId = strtoull(response->c_str() + 4, nullptr, 10);
+    return true;
+}
+
+std::string request(int n)
+{
+    return "REQ " + std::to_string(n) + "\n";
+}
+
+void testPipelinedCalls(EventLoop *loop, bool matchById)
+{
+    UpstreamPool pool(loop, InetAddress(kPort), "Pipeline");
+    pool.setMaxConnections(4);
+    pool.setMaxPipelineDepth(64);
+    pool.setResponseParser(parseLine, matchById);
+
+    const int kCalls = 10000;
+    int done = 0, mismatched = 0;
+    Timestamp start = Timestamp::now();
+    for (int i = 0; i < kCalls; ++i)
+    {
+        pool.call(request(i), [&, i](bool ok, const std::string &response) {
+            if (!ok || response != "RES " + std::to_string(i))
+            {
+                ++mismatched;
+            }
+            if (++done == kCalls)
+            {
+                loop->quit();
+            }
+        }, i);
+    }
+    loop->runAfter(10.0, [loop]() { loop->quit(); });
+    loop->loop();
+
+    printf("%d pipelined calls (%s) in %.3fs over %lu connections\n", done, matchById ? "by id" : "fifo",
+           secondsSince(start), static_cast<unsigned long>(pool.connectsStarted()));
+    check(done == kCalls && mismatched == 0, "every response matched its request");
+    check(pool.connectsStarted() <= 4, "connections capped by maxConnections");
+}
+
+void testSequentialReuse(EventLoop *loop)
+{
+    const int kCalls = 500;
+
+    // 基线：每次调用新建一个TcpClient
+    int done = 0;
+    Timestamp start = Timestamp::now();
+    std::unique_ptr<TcpClient> client;
+    std::function<void()> next = [&]() {
+        client.reset(new TcpClient(loop, InetAddress(kPort), "PerCall"));
+        int n = done;
+        client->setConnectionCallback([n](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                conn->send(request(n));
+            }
+        });
+        client->setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            if (std::find(buf->peek(), buf->peek() + buf->readableBytes(), '\n') == buf->peek() + buf->readableBytes())
+            {
+                return;
+            }
+            buf->retrieveAll();
+            conn->forceClose();
+            // 不能在客户端自己的回调里销毁它
+            loop->queueInLoop([&]() {
+                if (++done == kCalls)
+                {
+                    client.reset();
+                    loop->quit();
+                }
+                else
+                {
+                    next();
+                }
+            });
+        });
+        client->connect();
+    };
+    next();
+    loop->runAfter(20.0, [loop]() { loop->quit(); });
+    loop->loop();
+    double perCall = secondsSince(start) / kCalls * 1e6;
+
+    // 连接池：同样的调用串行地走池中的一条连接
+    UpstreamPool pool(loop, InetAddress(kPort), "Reuse");
+    pool.setResponseParser(parseLine);
+    int pooledDone = 0;
+    start = Timestamp::now();
+    std::function<void()> call = [&]() {
+        pool.call(request(pooledDone), [&](bool ok, const std::string &) {
+            if (++pooledDone == kCalls || !ok)
+            {
+                loop->quit();
+            }
+            else
+            {
+                call();
+            }
+        });
+    };
+    call();
+    loop->runAfter(20.0, [loop]() { loop->quit(); });
+    loop->loop();
+    double pooledPerCall = secondsSince(start) / kCalls * 1e6;
+
+    printf("sequential calls: connect per call %.1fus/call (%d), pooled %.1fus/call (%d, %lu connects)\n",
+           perCall, done, pooledPerCall, pooledDone, static_cast<unsigned long>(pool.connectsStarted()));
+    check(done == kCalls && pooledDone == kCalls, "all sequential calls completed");
+    check(pool.connectsStarted() == 1, "pooled calls reused a single connection");
+}
+
+void testCheckoutAndEviction(EventLoop *loop)
+{
+    UpstreamPool pool(loop, InetAddress(kPort), "Checkout");
+    pool.setMaxIdleSeconds(0.3);
+    pool.start(0.05);
+
+    const int kRounds = 200;
+    int rounds = 0;
+    std::function<void()> round = [&]() {
+        pool.checkout([&](const TcpConnectionPtr &conn) {
+            if (!conn)
+            {
+                loop->quit();
+                return;
+            }
+            // 借出期间由使用者处理消息
+            conn->setMessageCallback([&](const TcpConnectionPtr &c, Buffer *buf, Timestamp) {
+                buf->retrieveAll();
+                pool.checkin(c);
+                if (++rounds == kRounds)
+                {
+                    loop->quit();
+                }
+                else
+                {
+                    // 排在归还之后，拿到的仍是同一条连接
+                    loop->queueInLoop(round);
+                }
+            });
+            conn->send(request(rounds));
+        });
+    };
+    round();
+    loop->runAfter(10.0, [loop]() { loop->quit(); });
+    loop->loop();
+    printf("%d checkout/checkin rounds over %lu connects, %lu idle\n", rounds,
+           static_cast<unsigned long>(pool.connectsStarted()), static_cast<unsigned long>(pool.idleConnections()));
+    check(rounds == kRounds && pool.connectsStarted() == 1, "checkin returned the connection for reuse");
+
+    // 空闲超过0.3秒后被回收
+    loop->runAfter(0.8, [loop]() { loop->quit(); });
+    loop->loop();
+    printf("%lu connections left after idling\n", static_cast<unsigned long>(pool.totalConnections()));
+    check(pool.totalConnections() == 0, "idle connection evicted by timer");
+}
+
+// 上游没有监听时，排队的请求不会一直挂着：连接失败后立即以ok=false结束
+void testUpstreamDown(EventLoop *loop)
+{
+    UpstreamPool pool(loop, InetAddress(kPort + 1), "Down");
+    pool.setResponseParser(parseLine);
+
+    const int kCalls = 20;
+    int failed = 0, succeeded = 0;
+    double failedAfter = -1;
+    Timestamp start = Timestamp::now();
+    for (int i = 0; i < kCalls; ++i)
+    {
+        pool.call(request(i), [&](bool ok, const std::string &) {
+            ok ? ++succeeded : ++failed;
+            if (failed + succeeded == kCalls)
+            {
+                failedAfter = secondsSince(start);
+                loop->quit();
+            }
+        });
+    }
+    loop->runAfter(5.0, [loop]() { loop->quit(); });
+    loop->loop();
+    // 让推迟销毁的连接对象执行完
+    loop->runAfter(0.05, [loop]() { loop->quit(); });
+    loop->loop();
+
+    printf("upstream down: %d calls failed after %.3fs, %lu connects\n", failed, failedAfter,
+           static_cast<unsigned long>(pool.connectsStarted()));
+    check(failed == kCalls && succeeded == 0, "calls fail with ok=false when upstream is down");
+    check(failedAfter >= 0 && failedAfter < 0.5, "queued calls fail fast on connect failure");
+    check(pool.totalConnections() == 0, "failed connection removed from the pool");
+}
+
+// 上游接受连接但不回应：请求按callTimeout以ok=false结束，没有调用start()也生效
+void testCallTimeout(EventLoop *loop)
+{
+    TcpServer silent(loop, InetAddress(kPort + 2), "Silent", TcpServer::kReusePort);
+    silent.setConnectionCallback([](const TcpConnectionPtr &) {});
+    silent.setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    silent.start();
+
+    UpstreamPool pool(loop, InetAddress(kPort + 2), "Timeout");
+    pool.setResponseParser(parseLine);
+    pool.setCallTimeout(0.2);
+
+    const int kCalls = 5;
+    int failed = 0;
+    double failedAfter = -1;
+    Timestamp start = Timestamp::now();
+    for (int i = 0; i < kCalls; ++i)
+    {
+        pool.call(request(i), [&](bool ok, const std::string &) {
+            if (!ok && ++failed == kCalls)
+            {
+                failedAfter = secondsSince(start);
+                loop->quit();
+            }
+        });
+    }
+    loop->runAfter(5.0, [loop]() { loop->quit(); });
+    loop->loop();
+
+    printf("silent upstream: %d calls timed out after %.3fs\n", failed, failedAfter);
+    check(failed == kCalls, "in-flight calls fail after callTimeout");
+    check(failedAfter >= 0.2 && failedAfter < 1.0, "call deadline enforced without start()");
+}
+
+int main()
+{
+    Logger::setLogLevel(ERROR);
+
+    EventLoopThread backendThread;
+    EventLoop *backendLoop = backendThread.startLoop();
+    std::unique_ptr<TcpServer> backend(new TcpServer(backendLoop, InetAddress(kPort), "Backend", TcpServer::kReusePort));
+    backend->setConnectionCallback([](const TcpConnectionPtr &) {});
+    backend->setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        std::string out;
+        const char *begin = buf->peek();
+        const char *end = begin + buf->readableBytes();
+        const char *eol;
+        while ((eol = std::find(begin, end, '\n')) != end)
+        {
+            out += "RES";
+            out.append(begin + 3, eol + 1);
+            begin = eol + 1;
+        }
+        buf->retrieve(begin - buf->peek());
+        conn->send(out);
+    });
+    backend->start();
+    // start()在backend的loop中listen，等它执行完；连接池默认不重试，后端还没listen时请求会直接失败
+    backendLoop->runInLoopAndWait([]() {});
+
+    {
+        EventLoop loop;
+        testPipelinedCalls(&loop, false);
+        testPipelinedCalls(&loop, true);
+        testSequentialReuse(&loop);
+        testCheckoutAndEviction(&loop);
+        testUpstreamDown(&loop);
+        testCallTimeout(&loop);
+    }
+
+    backendLoop->runInLoop([&backend]() { backend.reset(); });
+    ::usleep(100 * 1000);
+    return testExitCode();
+}
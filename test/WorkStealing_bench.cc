@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "TcpServer.h"
+#include "Logger.h"
+#include "WorkStealingPool.h"
+
+// 对比CPU密集型请求在IO线程中直接处理和交给WorkStealingPool处理时，同一IO线程上轻量请求的延迟
+// 若干重客户端不停发送'H'，服务端每个'H'耗费kHeavyCostUs的CPU；一个探测客户端每毫秒发一个'P'并统计往返延迟
+// 用法：WorkStealing_bench [workers heavyClients]
+
+const int kHeavyCostUs = 2000;
+const int kPingSamples = 2000;
+
+std::atomic_bool g_stop(false);
+std::atomic<long> g_heavyReplies(0);
+
+void burnCpu(int us)
+{
+    int64_t end = Timestamp::now().microSecondsSinceEpoch() + us;
+    while (Timestamp::now().microSecondsSinceEpoch() < end)
+    {
+    }
+}
+
+int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::connect(fd, (sockaddr *)&addr, sizeof(addr));
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+void heavyClient(uint16_t port)
+{
+    int fd = connectTo(port);
+    char c = 'H';
+    while (!g_stop && ::write(fd, &c, 1) == 1 && ::read(fd, &c, 1) == 1)
+    {
+        ++g_heavyReplies;
+        c = 'H';
+    }
+    ::close(fd);
+}
+
+// 返回排好序的往返延迟(微秒)
+std::vector<int64_t> pingClient(uint16_t port)
+{
+    int fd = connectTo(port);
+    std::vector<int64_t> rtts;
+    for (int i = 0; i < kPingSamples; ++i)
+    {
+        char c = 'P';
+        int64_t start = Timestamp::now().microSecondsSinceEpoch();
+        if (::write(fd, &c, 1) != 1 || ::read(fd, &c, 1) != 1)
+        {
+            break;
+        }
+        rtts.push_back(Timestamp::now().microSecondsSinceEpoch() - start);
+        ::usleep(1000);
+    }
+    ::close(fd);
+    std::sort(rtts.begin(), rtts.end());
+    return rtts;
+}
+
+void runMode(const char *mode, WorkStealingPool *pool, uint16_t port, int heavyClients)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "WorkStealingBench");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            int one = 1;
+            ::setsockopt(conn->fd(), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+    });
+    server.setMessageCallback([pool](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        std::string msg = buf->retrieveAllAsString();
+        for (char c : msg)
+        {
+            if (c == 'P')
+            {
+                conn->send("p");
+            }
+            else if (pool == nullptr)
+            {
+                burnCpu(kHeavyCostUs);
+                conn->send("h");
+            }
+            else
+            {
+                pool->runAndPost(conn,
+                                 []() {
+                                     burnCpu(kHeavyCostUs);
+                                     return std::string("h");
+                                 },
+                                 [conn](const std::string &reply) { conn->send(reply); });
+            }
+        }
+    });
+    server.start();
+
+    g_stop = false;
+    g_heavyReplies = 0;
+    std::thread driver([&]() {
+        std::vector<std::thread> heavy;
+        for (int i = 0; i < heavyClients; ++i)
+        {
+            heavy.emplace_back(heavyClient, port);
+        }
+        ::usleep(100 * 1000);
+        int64_t start = Timestamp::now().microSecondsSinceEpoch();
+        long startReplies = g_heavyReplies;
+        std::vector<int64_t> rtts = pingClient(port);
+        double seconds = (Timestamp::now().microSecondsSinceEpoch() - start) / 1e6;
+        long replies = g_heavyReplies - startReplies;
+        g_stop = true;
+        for (std::thread &t : heavy)
+        {
+            t.join();
+        }
+        loop.quit();
+
+        if (rtts.empty())
+        {
+            printf("%-22s no samples\n", mode);
+            return;
+        }
+        printf("%-22s ping rtt us: p50 %6ld  p99 %6ld  max %6ld | heavy req/s %6.0f\n", mode,
+               static_cast<long>(rtts[rtts.size() / 2]), static_cast<long>(rtts[rtts.size() * 99 / 100]),
+               static_cast<long>(rtts.back()), replies / seconds);
+    });
+    loop.loop();
+    driver.join();
+}
+
+int main(int argc, char *argv[])
+{
+    int workers = argc > 1 ? atoi(argv[1]) : 2;
+    int heavyClients = argc > 2 ? atoi(argv[2]) : 4;
+    Logger::setLogLevel(FATAL);
+
+    runMode("inline on IO thread", nullptr, 9981, heavyClients);
+
+    WorkStealingPool pool("Worker");
+    pool.setThreadNum(workers);
+    pool.start();
+    runMode("offloaded to pool", &pool, 9982, heavyClients);
+    pool.stop();
+    printf("pool: %d workers, %lu tasks stolen\n", workers, static_cast<unsigned long>(pool.stolenTasks()));
+    return 0;
+}
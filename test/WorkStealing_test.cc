@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Logger.h"
+#include "WorkStealingPool.h"
+#include "TestHarness.h"
+
+// WorkStealingPool的正确性检查：
+//   1. 多个外部线程交错提交大量key的任务，同一key的任务按提交顺序执行、互不重叠
+//   2. 工作线程中递归派生任务(进入自己的队列，空闲线程从顶部窃取)，每个任务执行且只执行一次；
+//      任务中按自己的key提交后续任务，后续任务排在当前任务之后
+//   3. stop()返回前，已提交的任务，包括执行途中派生的、在key上排队的，全部执行完
+//   4. runAndPost的结果回调在loop线程中按请求顺序执行
+// 用法：WorkStealing_test [workers]
+
+int g_workers = 4;
+
+// 每个key记录下一个应执行的序号，以及是否有该key的任务正在执行
+struct KeyState
+{
+    std::atomic_int next{0};
+    std::atomic_bool running{false};
+};
+
+struct OrderCounters
+{
+    std::atomic<long> executed{0};
+    std::atomic<long> outOfOrder{0};
+    std::atomic<long> overlapped{0};
+};
+
+void runKeyed(KeyState *state, int seq, OrderCounters *counters)
+{
+    if (state->running.exchange(true))
+    {
+        ++counters->overlapped;
+    }
+    if (state->next.load() != seq)
+    {
+        ++counters->outOfOrder;
+    }
+    // 稍微占用一点时间，让同一key的下一个任务有机会被其他线程提前取走
+    volatile int spin = 0;
+    for (int i = 0; i < 200; ++i)
+    {
+        spin += i;
+    }
+    state->next.store(seq + 1);
+    state->running.store(false);
+    ++counters->executed;
+}
+
+bool waitFor(const std::atomic<long> &value, long expected, double timeoutSeconds)
+{
+    for (int i = 0; i < timeoutSeconds * 1000 && value.load() != expected; ++i)
+    {
+        ::usleep(1000);
+    }
+    return value.load() == expected;
+}
+
+void testManyKeysInOrder()
+{
+    const int kKeys = 257;
+    const int kTasksPerKey = 200;
+    const int kSubmitters = 4;
+
+    WorkStealingPool pool("OrderPool");
+    pool.setThreadNum(g_workers);
+    pool.start();
+
+    std::unique_ptr<KeyState[]> states(new KeyState[kKeys]);
+    OrderCounters counters;
+    // 每个提交线程负责一部分key，对这些key轮流提交，同一key的相邻任务之间穿插着其他key的任务
+    std::vector<std::thread> submitters;
+    for (int s = 0; s < kSubmitters; ++s)
+    {
+        submitters.emplace_back([&, s]() {
+            for (int seq = 0; seq < kTasksPerKey; ++seq)
+            {
+                for (int key = s; key < kKeys; key += kSubmitters)
+                {
+                    KeyState *state = &states[key];
+                    OrderCounters *c = &counters;
+                    pool.run(key, [state, seq, c]() { runKeyed(state, seq, c); });
+                }
+            }
+        });
+    }
+    for (std::thread &t : submitters)
+    {
+        t.join();
+    }
+
+    const long total = static_cast<long>(kKeys) * kTasksPerKey;
+    check(waitFor(counters.executed, total, 10.0), "keyed: every task executed");
+    check(counters.outOfOrder == 0, "keyed: each key runs in submission order");
+    check(counters.overlapped == 0, "keyed: tasks of one key never overlap");
+    bool allDone = true;
+    for (int key = 0; key < kKeys; ++key)
+    {
+        allDone = allDone && states[key].next == kTasksPerKey;
+    }
+    check(allDone, "keyed: every key reached its last task");
+    check(pool.pendingTasks() == 0, "keyed: no pending tasks left");
+    pool.stop();
+}
+
+// 每个任务派生两个子任务，深度为depth的树共有2^(depth+1)-1个任务
+void spawnTree(WorkStealingPool *pool, int depth, std::atomic<long> *executed)
+{
+    ++*executed;
+    if (depth > 0)
+    {
+        pool->run([pool, depth, executed]() { spawnTree(pool, depth - 1, executed); });
+        pool->run([pool, depth, executed]() { spawnTree(pool, depth - 1, executed); });
+    }
+}
+
+// 任务执行中按同一个key提交下一个任务
+void keyedChain(WorkStealingPool *pool, int key, KeyState *state, int seq, int length, OrderCounters *counters)
+{
+    if (seq + 1 < length)
+    {
+        pool->run(key, [pool, key, state, seq, length, counters]() {
+            keyedChain(pool, key, state, seq + 1, length, counters);
+        });
+    }
+    runKeyed(state, seq, counters);
+}
+
+void testRecursiveSpawn()
+{
+    const int kDepth = 15;
+    const int kChains = 64;
+    const int kChainLength = 100;
+
+    WorkStealingPool pool("SpawnPool");
+    pool.setThreadNum(g_workers);
+    pool.start();
+
+    std::atomic<long> executed(0);
+    pool.run([&pool, &executed]() { spawnTree(&pool, kDepth, &executed); });
+
+    std::unique_ptr<KeyState[]> states(new KeyState[kChains]);
+    OrderCounters counters;
+    for (int key = 0; key < kChains; ++key)
+    {
+        KeyState *state = &states[key];
+        OrderCounters *c = &counters;
+        WorkStealingPool *p = &pool;
+        pool.run(key, [p, key, state, c]() { keyedChain(p, key, state, 0, kChainLength, c); });
+    }
+
+    const long expected = (1L << (kDepth + 1)) - 1;
+    check(waitFor(executed, expected, 10.0), "spawn: every spawned task executed once");
+    check(waitFor(counters.executed, static_cast<long>(kChains) * kChainLength, 10.0),
+          "spawn: every chained keyed task executed");
+    check(counters.outOfOrder == 0 && counters.overlapped == 0, "spawn: chained tasks stay in order");
+    ::usleep(10 * 1000);
+    check(executed == expected, "spawn: no task executed twice");
+    printf("  %ld tasks, %lu stolen\n", expected, static_cast<unsigned long>(pool.stolenTasks()));
+    pool.stop();
+}
+
+void testStopDrains()
+{
+    const int kKeys = 64;
+    const int kTasksPerKey = 50;
+    const int kTrees = 8;
+    const int kDepth = 10;
+
+    WorkStealingPool pool("DrainPool");
+    pool.setThreadNum(g_workers);
+    pool.start();
+
+    std::unique_ptr<KeyState[]> states(new KeyState[kKeys]);
+    OrderCounters counters;
+    std::atomic<long> plain(0);
+    std::atomic<long> spawned(0);
+    for (int seq = 0; seq < kTasksPerKey; ++seq)
+    {
+        for (int key = 0; key < kKeys; ++key)
+        {
+            KeyState *state = &states[key];
+            OrderCounters *c = &counters;
+            pool.run(key, [state, seq, c]() { runKeyed(state, seq, c); });
+        }
+        pool.run([&plain]() { ++plain; });
+    }
+    for (int i = 0; i < kTrees; ++i)
+    {
+        pool.run([&pool, &spawned]() { spawnTree(&pool, kDepth, &spawned); });
+    }
+    // 不等待，直接stop
+    pool.stop();
+
+    check(counters.executed == static_cast<long>(kKeys) * kTasksPerKey, "stop: all keyed tasks ran before stop() returned");
+    check(counters.outOfOrder == 0 && counters.overlapped == 0, "stop: keyed tasks stayed in order while draining");
+    check(plain == kTasksPerKey, "stop: all plain tasks ran before stop() returned");
+    check(spawned == kTrees * ((1L << (kDepth + 1)) - 1), "stop: tasks spawned while draining also ran");
+    check(pool.pendingTasks() == 0, "stop: no pending tasks left");
+}
+
+void testRunAndPost()
+{
+    const int kKeys = 32;
+    const int kRequests = 100;
+
+    EventLoopThread loopThread;
+    EventLoop *loop = loopThread.startLoop();
+    WorkStealingPool pool("PostPool");
+    pool.setThreadNum(g_workers);
+    pool.start();
+
+    // 只在loop线程中访问
+    std::vector<int> nextResult(kKeys, 0);
+    std::atomic<long> done(0);
+    std::atomic<long> outOfOrder(0);
+    std::atomic<long> offLoop(0);
+    for (int seq = 0; seq < kRequests; ++seq)
+    {
+        for (int key = 0; key < kKeys; ++key)
+        {
+            pool.runAndPost(loop, key,
+                            [seq]() { return seq; },
+                            [&, key, loop](int result) {
+                                if (!loop->isInLoopThread())
+                                {
+                                    ++offLoop;
+                                }
+                                if (nextResult[key] != result)
+                                {
+                                    ++outOfOrder;
+                                }
+                                nextResult[key] = result + 1;
+                                ++done;
+                            });
+        }
+    }
+    pool.stop();
+
+    check(waitFor(done, static_cast<long>(kKeys) * kRequests, 10.0), "post: every result delivered");
+    check(offLoop == 0, "post: results run on the loop thread");
+    check(outOfOrder == 0, "post: results of one key arrive in request order");
+}
+
+int main(int argc, char *argv[])
+{
+    Logger::setLogLevel(ERROR);
+    if (argc > 1)
+    {
+        g_workers = atoi(argv[1]);
+    }
+    testManyKeysInOrder();
+    testRecursiveSpawn();
+    testStopDrains();
+    testRunAndPost();
+    return testExitCode();
+}